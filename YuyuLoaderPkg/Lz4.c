@@ -0,0 +1,88 @@
+#include "Lz4.h"
+
+#include <Library/BaseMemoryLib.h>
+
+// 4ビットのフィールドが15のとき、続くバイト列 (255 の並びと残り) を長さに加える
+static BOOLEAN ReadLength(const UINT8** ip, const UINT8* src_end, UINTN* length) {
+    UINT8 b;
+    do {
+        if (*ip >= src_end) {
+            return FALSE;
+        }
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return TRUE;
+}
+
+EFI_STATUS Lz4DecompressBlock(const UINT8* src, UINTN src_size, UINT8* dst, UINTN dst_size) {
+    const UINT8* ip = src;
+    const UINT8* const src_end = src + src_size;
+    UINT8* op = dst;
+    UINT8* const dst_end = dst + dst_size;
+
+    while (ip < src_end) {
+        const UINT8 token = *ip++;
+
+        // リテラル
+        UINTN lit_len = token >> 4;
+        if (lit_len == 15 && !ReadLength(&ip, src_end, &lit_len)) {
+            return EFI_COMPROMISED_DATA;
+        }
+        if (lit_len > (UINTN)(src_end - ip) || lit_len > (UINTN)(dst_end - op)) {
+            return EFI_COMPROMISED_DATA;
+        }
+        CopyMem(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        // 最後のシーケンスはリテラルだけで終わる
+        if (ip == src_end) {
+            break;
+        }
+
+        // 一致: 2バイトのオフセットと長さ
+        if (src_end - ip < 2) {
+            return EFI_COMPROMISED_DATA;
+        }
+        const UINTN offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        UINTN match_len = token & 0xf;
+        if (match_len == 15 && !ReadLength(&ip, src_end, &match_len)) {
+            return EFI_COMPROMISED_DATA;
+        }
+        match_len += 4;
+        if (offset == 0 || offset > (UINTN)(op - dst) || match_len > (UINTN)(dst_end - op)) {
+            return EFI_COMPROMISED_DATA;
+        }
+
+        const UINT8* match = op - offset;
+        if (offset >= match_len) {
+            // 重ならなければまとめてコピーする
+            CopyMem(op, match, match_len);
+            op += match_len;
+        } else if (offset >= 8) {
+            // 8バイト単位なら、コピー元はまだ書き込んでいない位置を読まない
+            while (match_len >= 8) {
+                *(UINT64*)op = *(const UINT64*)match;
+                op += 8;
+                match += 8;
+                match_len -= 8;
+            }
+            while (match_len--) {
+                *op++ = *match++;
+            }
+        } else if (offset == 1) {
+            // 同じバイトの繰り返し (0 埋めなど) は SetMem で書き込む
+            SetMem(op, match_len, *match);
+            op += match_len;
+        } else {
+            // 短い周期の繰り返し は1バイトずつ展開する
+            while (match_len--) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op == dst_end ? EFI_SUCCESS : EFI_COMPROMISED_DATA;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <Uefi.h>
+
+/**
+ * LZ4 ブロック形式のデータ src (src_size バイト) を dst に展開する
+ * 展開後の大きさがちょうど dst_size バイトになった場合だけ成功とし、
+ * 壊れたデータで dst や src の範囲外を読み書きすることはない
+ **/
+EFI_STATUS Lz4DecompressBlock(const UINT8* src, UINTN src_size, UINT8* dst, UINTN dst_size);
@@ -1,4 +1,6 @@
+#include <Guid/Acpi.h>
 #include <Guid/FileInfo.h>
+#include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/PrintLib.h>
@@ -9,17 +11,11 @@
 #include <Protocol/LoadedImage.h>
 #include <Protocol/SimpleFileSystem.h>
 #include <Uefi.h>
+#include "boot_trace.hpp"
 #include "elf.hpp"
+#include "Lz4.h"
 #include "frame_buffer_config.hpp"
-
-struct MemoryMap {
-    UINTN buffer_size;
-    VOID* buffer;
-    UINTN map_size;
-    UINTN map_key;
-    UINTN descriptor_size;
-    UINT32 descriptor_version;
-};
+#include "memory_map.hpp"
 
 EFI_STATUS GetMemoryMap(struct MemoryMap* map) {
     if (map->buffer == NULL) {
@@ -170,6 +166,95 @@ EFI_STATUS OpenGOP(EFI_HANDLE image_handle, EFI_GRAPHICS_OUTPUT_PROTOCOL** gop)
     return EFI_SUCCESS;
 }
 
+/*
+ * GOP のモードを選ぶ方針
+ * 解像度が大きいほど1画面の描画と転送に時間がかかるので、kMaxModeWidth x kMaxModeHeight を上限にする
+ * - カーネルが対応しているピクセル形式 (RGB / BGR の 8bit と、各色が連続したビットの PixelBitMask)
+ *   のモードだけを候補にする
+ * - 上限以下のモードを、上限を超えるモードより優先する
+ * - その中で画素数が最も多いモードを選ぶ
+ * - 画素数が同じなら、行の余白が無いモードを選ぶ
+ * GOP には表示するページを切り替える機能が無いので、VRAM に2画面分が収まるかは考慮しない
+ */
+#define kMaxModeWidth 1920
+#define kMaxModeHeight 1080
+
+// マスクが空でなく、1が連続して並んでいるか
+BOOLEAN IsContiguousMask(UINT32 mask) {
+    if (mask == 0) {
+        return FALSE;
+    }
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+    }
+    return (mask & (mask + 1)) == 0;
+}
+
+BOOLEAN IsSupportedPixelFormat(const EFI_GRAPHICS_OUTPUT_MODE_INFORMATION* info) {
+    switch (info->PixelFormat) {
+        case PixelRedGreenBlueReserved8BitPerColor:
+        case PixelBlueGreenRedReserved8BitPerColor: return TRUE;
+        case PixelBitMask:
+            return IsContiguousMask(info->PixelInformation.RedMask)
+                && IsContiguousMask(info->PixelInformation.GreenMask)
+                && IsContiguousMask(info->PixelInformation.BlueMask);
+        default: return FALSE;
+    }
+}
+
+// 1ピクセルのバイト数。PixelBitMask ではマスクの最上位のビットを含むバイトまでが1ピクセル
+UINT32 BytesPerPixel(const EFI_GRAPHICS_OUTPUT_MODE_INFORMATION* info) {
+    if (info->PixelFormat != PixelBitMask) {
+        return 4;
+    }
+    UINT32 bits = info->PixelInformation.RedMask | info->PixelInformation.GreenMask
+        | info->PixelInformation.BlueMask | info->PixelInformation.ReservedMask;
+    UINT32 bytes = 0;
+    while (bits != 0) {
+        bits >>= 8;
+        bytes++;
+    }
+    return bytes;
+}
+
+// 方針に従ってモードの優先度を比較するための値。大きいほど良い
+UINT64 ScoreGOPMode(const EFI_GRAPHICS_OUTPUT_MODE_INFORMATION* info) {
+    const UINT64 pixels = (UINT64)info->HorizontalResolution * info->VerticalResolution;
+    const BOOLEAN within_limit
+        = info->HorizontalResolution <= kMaxModeWidth && info->VerticalResolution <= kMaxModeHeight;
+    const BOOLEAN no_padding = info->PixelsPerScanLine == info->HorizontalResolution;
+    return ((UINT64)within_limit << 62) | (pixels << 1) | no_padding;
+}
+
+// QueryMode で全てのモードを調べ、方針に従って選んだモードに切り替える
+EFI_STATUS SelectGOPMode(EFI_GRAPHICS_OUTPUT_PROTOCOL* gop) {
+    UINT32 best_mode = gop->Mode->Mode;
+    UINT64 best_score = IsSupportedPixelFormat(gop->Mode->Info)
+        ? ScoreGOPMode(gop->Mode->Info)
+        : 0;
+
+    for (UINT32 mode = 0; mode < gop->Mode->MaxMode; mode++) {
+        UINTN info_size;
+        EFI_GRAPHICS_OUTPUT_MODE_INFORMATION* info;
+        if (EFI_ERROR(gop->QueryMode(gop, mode, &info_size, &info))) {
+            continue;
+        }
+        if (IsSupportedPixelFormat(info)) {
+            const UINT64 score = ScoreGOPMode(info);
+            if (score > best_score) {
+                best_mode = mode;
+                best_score = score;
+            }
+        }
+        FreePool(info);
+    }
+
+    if (best_mode == gop->Mode->Mode) {
+        return EFI_SUCCESS;
+    }
+    return gop->SetMode(gop, best_mode);
+}
+
 const CHAR16* GetPixelFormatUnicode(EFI_GRAPHICS_PIXEL_FORMAT fmt) {
     switch (fmt) {
         case PixelRedGreenBlueReserved8BitPerColor: return L"PixelRedGeenBlueReserved8BitPerColor";
@@ -187,13 +272,71 @@ void Halt(void) {
         __asm__("hlt");
 }
 
-void CalcLoadAddressRange(Elf64_Ehdr* ehdr, UINT64* first, UINT64* last) {
-    // プログラムヘッダの配列を指すポインタ
-    Elf64_Phdr* phdr = (Elf64_Phdr*)((UINT64)ehdr + ehdr->e_phoff);
+/**
+ * ローダの各段階の所要時間を TSC で計測する
+ * 結果はカーネルへ渡し、カーネルが自分の計測結果と合わせて画面とシリアルポートに出力する
+ * ExitBootServices の後は Print を使えないので、ローダでの表示はその前にまとめて行う
+ **/
+struct BootTrace boot_trace;
+
+// *last_tsc から現在までを name の段階として記録し、*last_tsc を現在の値に進める
+void RecordLoaderPhase(const CHAR8* name, UINT64* last_tsc) {
+    UINT64 now = AsmReadTsc();
+    if (boot_trace.num_samples < kBootTraceMaxSamples) {
+        struct BootTraceSample* sample = &boot_trace.samples[boot_trace.num_samples++];
+        UINTN i;
+        for (i = 0; i < kBootTraceNameLength - 1 && name[i] != '\0'; i++) {
+            sample->name[i] = name[i];
+        }
+        sample->name[i] = '\0';
+        sample->start_tsc = *last_tsc;
+        sample->cycles = now - *last_tsc;
+        sample->count = 1;
+    }
+    *last_tsc = now;
+}
+
+// 1マイクロ秒あたりの TSC のカウント数を、ブートサービスの Stall と比べて求める
+UINT64 CalibrateTscPerMicrosecond(void) {
+    UINT64 start = AsmReadTsc();
+    gBS->Stall(10000);
+    UINT64 tsc_per_us = (AsmReadTsc() - start) / 10000;
+    return tsc_per_us ? tsc_per_us : 1;
+}
+
+void PrintLoaderPhases(void) {
+    UINT64 total = 0;
+    for (UINTN i = 0; i < boot_trace.num_samples; i++) {
+        Print(L"  %-20a %10lu cycles %8lu us\n",
+            boot_trace.samples[i].name,
+            boot_trace.samples[i].cycles,
+            boot_trace.samples[i].cycles / boot_trace.tsc_per_us);
+        total += boot_trace.samples[i].cycles;
+    }
+    Print(L"  %-20s %10lu cycles %8lu us\n", L"total", total, total / boot_trace.tsc_per_us);
+}
+
+// file の offset から size バイトを buffer に読み込む
+EFI_STATUS ReadAt(EFI_FILE_PROTOCOL* file, UINT64 offset, UINTN size, VOID* buffer) {
+    EFI_STATUS status = file->SetPosition(file, offset);
+    if (EFI_ERROR(status)) {
+        return status;
+    }
+
+    UINTN read_size = size;
+    status = file->Read(file, &read_size, buffer);
+    if (EFI_ERROR(status)) {
+        return status;
+    }
+    // 要求した大きさに満たなければ、ファイルが途中で切れている
+    return read_size == size ? EFI_SUCCESS : EFI_END_OF_FILE;
+}
+
+void CalcLoadAddressRange(Elf64_Phdr* phdr, Elf64_Half phnum, UINT64* first, UINT64* last) {
     *first = MAX_UINT64;
     *last = 0;
     // カーネルファイル内の全てのLOADセグメントを順に辿り、アドレス範囲を更新する
-    for (Elf64_Half i = 0; i < ehdr->e_phnum; i++) {
+    for (Elf64_Half i = 0; i < phnum; i++) {
         // LOADセグメントのときのみ更新する
         if (phdr[i].p_type != PT_LOAD) continue;
         *first = MIN(*first, phdr[i].p_vaddr);
@@ -201,20 +344,304 @@ void CalcLoadAddressRange(Elf64_Ehdr* ehdr, UINT64* first, UINT64* last) {
     }
 }
 
-// 一時領域から最終目的地へLOADセグメントをコピーする
-void CopyLoadSegments(Elf64_Ehdr* ehdr) {
-    Elf64_Phdr* phdr = (Elf64_Phdr*)((UINT64)ehdr + ehdr->e_phoff);
-    for (Elf64_Half i = 0; i < ehdr->e_phnum; i++) {
+/**
+ * LOADセグメントをファイルから最終目的地 (p_vaddr) へ直接読み込む
+ * ファイル全体を一時領域に読んでからコピーすることはしないので、各バイトは1回しか書き込まれない
+ * ファイル上に無い部分 (BSS: p_filesz から p_memsz まで) だけを0で埋める
+ **/
+EFI_STATUS LoadSegments(EFI_FILE_PROTOCOL* file, Elf64_Phdr* phdr, Elf64_Half phnum) {
+    EFI_STATUS status;
+    for (Elf64_Half i = 0; i < phnum; i++) {
         if (phdr[i].p_type != PT_LOAD) continue;
 
-        UINT64 segm_in_file = (UINT64)ehdr + phdr[i].p_offset;
-        // segm_in_fileが指す一時領域からp_vaddrが指す最終目的地へデータをコピーする
-        CopyMem((VOID*)phdr[i].p_vaddr, (VOID*)segm_in_file, phdr[i].p_filesz);
+        status = ReadAt(file, phdr[i].p_offset, phdr[i].p_filesz, (VOID*)phdr[i].p_vaddr);
+        if (EFI_ERROR(status)) {
+            return status;
+        }
 
         UINTN remain_bytes = phdr[i].p_memsz - phdr[i].p_filesz;
-        // セグメントのメモリ上のサイズがファイル上のサイズより大きい場合、残りを0-paddingする
         SetMem((VOID*)(phdr[i].p_vaddr + phdr[i].p_filesz), remain_bytes, 0);
     }
+    return EFI_SUCCESS;
+}
+
+// [first, last) を含むページを、その物理アドレスのまま確保する
+EFI_STATUS AllocateKernelPages(UINT64 first, UINT64 last) {
+    /**
+     * first、lastからページ数を計算する
+     * ページ単位の大きさ(1ページ4KiB = 0x1000)
+     * 0xfffは切り上げ
+     **/
+    UINTN num_pages = (last - first + 0xfff) / 0x1000;
+    EFI_STATUS status = gBS->AllocatePages(AllocateAddress,    // メモリの確保の仕方
+        EfiLoaderData,                                         // 確保するメモリ領域の種別
+        num_pages,                                             // 確保するページ数
+        &first                                                 // 確保したメモリ領域のアドレス
+    );
+    if (EFI_ERROR(status)) {
+        Print(L"failed to allocate pages: %r\n", status);
+        return status;
+    }
+    Print(L"Kernel: 0x%0lx - 0x%0lx\n", first, last);
+    return EFI_SUCCESS;
+}
+
+/**
+ * kernel.elf を読み込む
+ * ファイル全体を読み込む代わりに、まずELFヘッダとプログラムヘッダだけを読む
+ * LOADセグメントはアドレス範囲を確保した後、ファイルから直接その場所へ読み込む
+ **/
+EFI_STATUS LoadElfKernel(EFI_FILE_PROTOCOL* file, UINT64* entry_addr, UINT64* last_tsc) {
+    EFI_STATUS status;
+    Elf64_Ehdr ehdr;
+    status = ReadAt(file, 0, sizeof(ehdr), &ehdr);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to read ELF header: %r\n", status);
+        return status;
+    }
+    if (ehdr.e_phentsize != sizeof(Elf64_Phdr)) {
+        Print(L"unexpected program header size: %u\n", ehdr.e_phentsize);
+        return EFI_UNSUPPORTED;
+    }
+
+    Elf64_Phdr* phdr;
+    UINTN phdr_size = sizeof(Elf64_Phdr) * ehdr.e_phnum;
+    status = gBS->AllocatePool(EfiLoaderData, phdr_size, (VOID**)&phdr);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to allocate pool: %r\n", status);
+        return status;
+    }
+    status = ReadAt(file, ehdr.e_phoff, phdr_size, phdr);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to read program headers: %r\n", status);
+        return status;
+    }
+
+    UINT64 first_addr, last_addr;
+    // 最終目的地の番地の範囲 = 0x100000から始まるアドレスの範囲を取得する
+    CalcLoadAddressRange(phdr, ehdr.e_phnum, &first_addr, &last_addr);
+    RecordLoaderPhase("ReadKernelHeaders", last_tsc);
+
+    status = AllocateKernelPages(first_addr, last_addr);
+    if (EFI_ERROR(status)) {
+        return status;
+    }
+
+    status = LoadSegments(file, phdr, ehdr.e_phnum);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to load segments: %r\n", status);
+        return status;
+    }
+    RecordLoaderPhase("LoadSegments", last_tsc);
+
+    // KernelMain()の実態が置かれているアドレスは、読み込んだELFヘッダに書かれている
+    *entry_addr = ehdr.e_entry;
+    // プログラムヘッダの領域を解放する
+    return gBS->FreePool(phdr);
+}
+
+/**
+ * 圧縮カーネルイメージ (tools/compresskernel.py が作る kernel.lz4) の形式
+ * [ヘッダ][セグメント表][セグメントごとの LZ4 ブロック]
+ * ELF のデバッグ情報などは含まれず、LOADセグメントの内容だけが圧縮されている
+ **/
+#define kKernelImageMagic 0x315a4b59    // "YKZ1"
+
+struct KernelImageHeader {
+    UINT32 magic;
+    UINT32 num_segments;
+    UINT64 entry;
+};
+
+struct KernelImageSegment {
+    UINT64 vaddr;
+    UINT64 file_size;
+    UINT64 mem_size;
+    // ファイル先頭からの圧縮データの位置と大きさ
+    UINT64 compressed_offset;
+    UINT64 compressed_size;
+};
+
+/**
+ * 1つのセグメントの値がファイルとメモリの範囲に収まっているか
+ * 表の値はファイルから読んだものなので、展開先の計算で桁あふれしないことも確かめる
+ **/
+BOOLEAN IsValidKernelSegment(
+    const struct KernelImageSegment* seg, UINT64 data_begin, UINT64 image_size) {
+    if (seg->mem_size < seg->file_size) {
+        return FALSE;
+    }
+    if (seg->vaddr + seg->mem_size < seg->vaddr) {
+        return FALSE;
+    }
+    if (seg->compressed_offset < data_begin || seg->compressed_offset > image_size
+        || seg->compressed_size > image_size - seg->compressed_offset) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * kernel.lz4 を読み込む
+ * 圧縮データをまとめて1回で読み込み、各セグメントを最終目的地へ直接展開する
+ **/
+EFI_STATUS LoadCompressedKernel(EFI_FILE_PROTOCOL* file, UINT64* entry_addr, UINT64* last_tsc) {
+    EFI_STATUS status;
+
+    // EFI_FILE_INFO の後ろにファイル名が続くので、その分も含めて確保する
+    UINT8 file_info_buffer[sizeof(EFI_FILE_INFO) + sizeof(CHAR16) * 16];
+    UINTN file_info_size = sizeof(file_info_buffer);
+    status = file->GetInfo(file, &gEfiFileInfoGuid, &file_info_size, file_info_buffer);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to get kernel image info: %r\n", status);
+        return status;
+    }
+    UINT64 image_size = ((EFI_FILE_INFO*)file_info_buffer)->FileSize;
+
+    struct KernelImageHeader header;
+    if (image_size < sizeof(header)) {
+        return EFI_COMPROMISED_DATA;
+    }
+    status = ReadAt(file, 0, sizeof(header), &header);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to read kernel image header: %r\n", status);
+        return status;
+    }
+    if (header.magic != kKernelImageMagic) {
+        Print(L"invalid kernel image magic: %08x\n", header.magic);
+        return EFI_UNSUPPORTED;
+    }
+    const UINT64 max_segments = (image_size - sizeof(header)) / sizeof(struct KernelImageSegment);
+    if (header.num_segments == 0 || header.num_segments > max_segments) {
+        return EFI_COMPROMISED_DATA;
+    }
+
+    struct KernelImageSegment* segments;
+    UINTN table_size = sizeof(struct KernelImageSegment) * header.num_segments;
+    status = gBS->AllocatePool(EfiLoaderData, table_size, (VOID**)&segments);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to allocate pool: %r\n", status);
+        return status;
+    }
+    status = ReadAt(file, sizeof(header), table_size, segments);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to read segment table: %r\n", status);
+        gBS->FreePool(segments);
+        return status;
+    }
+
+    // 圧縮データは表の直後に隙間なく並んでいるので、全体の範囲を求めて1回で読む
+    UINT64 first_addr = MAX_UINT64, last_addr = 0;
+    UINT64 data_start = MAX_UINT64, data_end = 0;
+    for (UINT32 i = 0; i < header.num_segments; i++) {
+        if (!IsValidKernelSegment(&segments[i], sizeof(header) + table_size, image_size)) {
+            Print(L"invalid kernel image segment %u\n", i);
+            gBS->FreePool(segments);
+            return EFI_COMPROMISED_DATA;
+        }
+        first_addr = MIN(first_addr, segments[i].vaddr);
+        last_addr = MAX(last_addr, segments[i].vaddr + segments[i].mem_size);
+        data_start = MIN(data_start, segments[i].compressed_offset);
+        data_end = MAX(data_end, segments[i].compressed_offset + segments[i].compressed_size);
+    }
+
+    UINT8* data;
+    status = gBS->AllocatePool(EfiLoaderData, data_end - data_start, (VOID**)&data);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to allocate pool: %r\n", status);
+        gBS->FreePool(segments);
+        return status;
+    }
+    status = ReadAt(file, data_start, data_end - data_start, data);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to read kernel image: %r\n", status);
+        gBS->FreePool(data);
+        gBS->FreePool(segments);
+        return status;
+    }
+    RecordLoaderPhase("ReadKernelImage", last_tsc);
+
+    status = AllocateKernelPages(first_addr, last_addr);
+    if (EFI_ERROR(status)) {
+        gBS->FreePool(data);
+        gBS->FreePool(segments);
+        return status;
+    }
+
+    for (UINT32 i = 0; i < header.num_segments; i++) {
+        struct KernelImageSegment* seg = &segments[i];
+        status = Lz4DecompressBlock(data + (seg->compressed_offset - data_start),
+            seg->compressed_size,
+            (UINT8*)seg->vaddr,
+            seg->file_size);
+        if (EFI_ERROR(status)) {
+            Print(L"failed to decompress segment %u: %r\n", i, status);
+            gBS->FreePool(data);
+            gBS->FreePool(segments);
+            return status;
+        }
+        SetMem((VOID*)(seg->vaddr + seg->file_size), seg->mem_size - seg->file_size, 0);
+    }
+    RecordLoaderPhase("DecompressSegments", last_tsc);
+
+    *entry_addr = header.entry;
+    gBS->FreePool(data);
+    return gBS->FreePool(segments);
+}
+
+/**
+ * カーネルが参照するファイルをまとめた初期 RAM ディスク (\initrd, ustar 形式の tar アーカイブ)
+ * カーネルは 1GiB 単位のアイデンティティマッピングしか持たないので、その範囲内のページに読み込む。
+ * EfiLoaderData のページはカーネルのメモリ管理が空き領域として扱わないので、そのまま参照できる
+ **/
+#define kInitrdMaxAddress (64ULL * 1024 * 1024 * 1024 - 1)
+
+/**
+ * \initrd があれば EfiLoaderData のページへ読み込み、その位置と大きさを返す
+ * ファイルが無ければ *base に NULL、*size に 0 を設定して成功を返す
+ **/
+EFI_STATUS LoadInitrd(EFI_FILE_PROTOCOL* root_dir, VOID** base, UINT64* size, UINT64* last_tsc) {
+    *base = NULL;
+    *size = 0;
+
+    EFI_FILE_PROTOCOL* file;
+    EFI_STATUS status = root_dir->Open(root_dir, &file, L"\\initrd", EFI_FILE_MODE_READ, 0);
+    if (EFI_ERROR(status)) {
+        return EFI_SUCCESS;
+    }
+
+    // EFI_FILE_INFO の後ろにファイル名が続くので、その分も含めて確保する
+    UINT8 file_info_buffer[sizeof(EFI_FILE_INFO) + sizeof(CHAR16) * 16];
+    UINTN file_info_size = sizeof(file_info_buffer);
+    status = file->GetInfo(file, &gEfiFileInfoGuid, &file_info_size, file_info_buffer);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to get initrd info: %r\n", status);
+        file->Close(file);
+        return status;
+    }
+    UINT64 file_size = ((EFI_FILE_INFO*)file_info_buffer)->FileSize;
+
+    EFI_PHYSICAL_ADDRESS addr = kInitrdMaxAddress;
+    status = gBS->AllocatePages(
+        AllocateMaxAddress, EfiLoaderData, EFI_SIZE_TO_PAGES(file_size), &addr);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to allocate pages for initrd: %r\n", status);
+        file->Close(file);
+        return status;
+    }
+    status = ReadAt(file, 0, file_size, (VOID*)addr);
+    file->Close(file);
+    if (EFI_ERROR(status)) {
+        Print(L"failed to read initrd: %r\n", status);
+        gBS->FreePages(addr, EFI_SIZE_TO_PAGES(file_size));
+        return status;
+    }
+    RecordLoaderPhase("ReadInitrd", last_tsc);
+
+    Print(L"Initrd: 0x%0lx - 0x%0lx\n", addr, addr + file_size);
+    *base = (VOID*)addr;
+    *size = file_size;
+    return EFI_SUCCESS;
 }
 
 EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_table) {
@@ -222,6 +649,9 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_tab
 
     Print(L"Hello, Yuyu World!\n");
 
+    boot_trace.tsc_per_us = CalibrateTscPerMicrosecond();
+    UINT64 last_tsc = AsmReadTsc();
+
     CHAR8 memmap_buf[4096 * 4];    // メモリマップ用に16KiB確保しておく
     struct MemoryMap memmap = {sizeof(memmap_buf), memmap_buf, 0, 0, 0, 0};
     status = GetMemoryMap(&memmap);
@@ -229,6 +659,7 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_tab
         Print(L"failed to get memory map: %r\n", status);
         Halt();
     }
+    RecordLoaderPhase("GetMemoryMap", &last_tsc);
 
     EFI_FILE_PROTOCOL* root_dir;
     status = OpenRootDir(image_handle, &root_dir);
@@ -260,6 +691,7 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_tab
             Halt();
         }
     }
+    RecordLoaderPhase("SaveMemoryMap", &last_tsc);
 
     /*
      * ブートローダからピクセルを描く
@@ -270,6 +702,11 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_tab
         Print(L"failed to open GOP: %r\n", status);
         Halt();
     }
+    status = SelectGOPMode(gop);
+    if (EFI_ERROR(status)) {
+        // 切り替えに失敗しても、元のモードのまま続ける
+        Print(L"failed to set GOP mode: %r\n", status);
+    }
 
     Print(L"Resolution: %ux%u, Pixel Format: %s, %u pixels/line\n",
         gop->Mode->Info->HorizontalResolution,
@@ -283,83 +720,44 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_tab
         gop->Mode->FrameBufferSize    // 全体サイズ
     );
 
-    UINT8* frame_buffer = (UINT8*)gop->Mode->FrameBufferBase;
-    for (UINTN i = 0; i < gop->Mode->FrameBufferSize; i++) {
-        frame_buffer[i] = 255;    // 0xff にすると白になる
-    }
+    // 0xff にすると白になる
+    // 1バイトずつ書き込まず、BaseMemoryLibSse2 の SetMem で16バイト単位の非テンポラルストアを使う
+    SetMem((VOID*)gop->Mode->FrameBufferBase, gop->Mode->FrameBufferSize, 255);
+    RecordLoaderPhase("OpenGOP", &last_tsc);
 
     /*
      * カーネルを読み込む
+     * 圧縮イメージ (kernel.lz4) があればそちらを使い、無ければ kernel.elf を読む
      */
     EFI_FILE_PROTOCOL* kernel_file;
-    status = root_dir->Open(root_dir, &kernel_file, L"\\kernel.elf", EFI_FILE_MODE_READ, 0);
-    if (EFI_ERROR(status)) {
-        Print(L"failed to open file '\\kernel.elf': %r\n", status);
-        Halt();
-    }
-
-    // kernel.elf の12文字(塗る文字を含む)分 = sizeof(CHAR16) * 12だけ余分に確保する
-    UINTN file_info_size = sizeof(EFI_FILE_INFO) + sizeof(CHAR16) * 12;
-    UINT8 file_info_buffer[file_info_size];
-    // ファイル情報を取得する
-    status
-        = kernel_file->GetInfo(kernel_file, &gEfiFileInfoGuid, &file_info_size, file_info_buffer);
-    if (EFI_ERROR(status)) {
-        Print(L"failed to get file information: %r\n", status);
-        Halt();
-    }
-
-    // UINT8からEFI_FILE_INFOにキャストして、FileSizeを取り出す
-    EFI_FILE_INFO* file_info = (EFI_FILE_INFO*)file_info_buffer;
-    UINTN kernel_file_size = file_info->FileSize;    // バイト単位
-
-    VOID* kernel_buffer;
-    status = gBS->AllocatePool(EfiLoaderData,    // 確保するメモリ領域の種別
-        kernel_file_size,    // 確保するファイルサイズ(バイト単位)
-        &kernel_buffer       // 確保したメモリ領域のアドレス
-    );
-    if (EFI_ERROR(status)) {
-        Print(L"failed to allocate pool: %r\n", status);
-        Halt();
+    UINT64 entry_addr;
+    status = root_dir->Open(root_dir, &kernel_file, L"\\kernel.lz4", EFI_FILE_MODE_READ, 0);
+    if (!EFI_ERROR(status)) {
+        status = LoadCompressedKernel(kernel_file, &entry_addr, &last_tsc);
+    } else {
+        status = root_dir->Open(root_dir, &kernel_file, L"\\kernel.elf", EFI_FILE_MODE_READ, 0);
+        if (EFI_ERROR(status)) {
+            Print(L"failed to open file '\\kernel.elf': %r\n", status);
+            Halt();
+        }
+        status = LoadElfKernel(kernel_file, &entry_addr, &last_tsc);
     }
-
-    // ファイルを読み込む
-    status = kernel_file->Read(kernel_file, &kernel_file_size, kernel_buffer);
     if (EFI_ERROR(status)) {
-        Print(L"error: %r", status);
+        Print(L"failed to load kernel: %r\n", status);
         Halt();
     }
+    kernel_file->Close(kernel_file);
 
-    Elf64_Ehdr* kernel_ehdr = (Elf64_Ehdr*)kernel_buffer;
-    UINT64 kernel_first_addr, kernel_last_addr;
-    // 最終目的地の番地の範囲 = 0x100000から始まるアドレスの範囲を取得する
-    CalcLoadAddressRange(kernel_ehdr, &kernel_first_addr, &kernel_last_addr);
-
-    /**
-     * kernel_first_addr、kernel_last_addrからページ数を計算する
-     * ページ単位の大きさ(1ページ4KiB = 0x1000)
-     * 0xfffは切り上げ
-     **/
-    UINTN num_pages = (kernel_last_addr - kernel_first_addr + 0xfff) / 0x1000;
-    status = gBS->AllocatePages(AllocateAddress,    // メモリの確保の仕方
-        EfiLoaderData,                              // 確保するメモリ領域の種別
-        num_pages,                                  // 確保するページ数
-        &kernel_first_addr                          // 確保したメモリ領域のアドレス
-    );
+    // 初期 RAM ディスクは任意。読み込みに失敗しても、無いものとして起動を続ける
+    VOID* initrd_base;
+    UINT64 initrd_size;
+    status = LoadInitrd(root_dir, &initrd_base, &initrd_size, &last_tsc);
     if (EFI_ERROR(status)) {
-        Print(L"failed to allocate pages: %r\n", status);
-        Halt();
+        Print(L"failed to load initrd: %r\n", status);
     }
 
-    CopyLoadSegments(kernel_ehdr);
-    Print(L"Kernel: 0x%0lx - 0x%0lx\n", kernel_first_addr, kernel_last_addr);
-
-    // 一時領域を解放する
-    status = gBS->FreePool(kernel_buffer);
-    if (EFI_ERROR(status)) {
-        Print(L"failed to free pool: %r\n", status);
-        Halt();
-    }
+    PrintLoaderPhases();
+    RecordLoaderPhase("PrintLoaderPhases", &last_tsc);
 
     // ブートサービスを停止する
     status = gBS->ExitBootServices(image_handle, memmap.map_key);
@@ -377,31 +775,64 @@ EFI_STATUS EFIAPI UefiMain(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE* system_tab
             Halt();
         }
     }
-
-    // 64bit ELFにおいて、KernelMain()の実態が置かれているアドレス
-    UINT64 entry_addr = *(UINT64*)(kernel_first_addr + 24);
+    RecordLoaderPhase("ExitBootServices", &last_tsc);
 
     struct FrameBufferConfig config = {(UINT8*)gop->Mode->FrameBufferBase,
         gop->Mode->Info->PixelsPerScanLine,
         gop->Mode->Info->HorizontalResolution,
         gop->Mode->Info->VerticalResolution,
-        0};
+        0,
+        gop->Mode->FrameBufferSize,
+        {0, 0, 0, 0}};
 
+    // RGB / BGR の形式にも、同じ配置を表すマスクを設定しておく
     switch (gop->Mode->Info->PixelFormat) {
         case PixelRedGreenBlueReserved8BitPerColor:
             config.pixel_format = kPixelRGBResv8BitPerColor;
+            config.pixel_bitmask
+                = (struct PixelBitMask) {0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000};
             break;
         case PixelBlueGreenRedReserved8BitPerColor:
             config.pixel_format = kPixelBGRResv8BitPerColor;
+            config.pixel_bitmask
+                = (struct PixelBitMask) {0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000};
+            break;
+        case PixelBitMask:
+            if (!IsSupportedPixelFormat(gop->Mode->Info)) {
+                Print(L"Unsupported pixel bit mask\n");
+                Halt();
+            }
+            config.pixel_format = kPixelBitMask;
+            config.pixel_bitmask = (struct PixelBitMask) {gop->Mode->Info->PixelInformation.RedMask,
+                gop->Mode->Info->PixelInformation.GreenMask,
+                gop->Mode->Info->PixelInformation.BlueMask,
+                gop->Mode->Info->PixelInformation.ReservedMask};
             break;
         default: Print(L"Unimplemented pixel format: %d\n", gop->Mode->Info->PixelFormat); Halt();
     }
 
-    // 引数と戻り値をvoid型とする関数型をEntryPointTypeとしてエイリアスする
-    typedef void EntryPointType(const struct FrameBufferConfig*);
+    // UEFI の構成テーブルから ACPI 2.0 の RSDP を探す。カーネルは MADT から CPU の一覧を得る
+    VOID* acpi_table = NULL;
+    for (UINTN i = 0; i < system_table->NumberOfTableEntries; i++) {
+        if (CompareGuid(&gEfiAcpiTableGuid, &system_table->ConfigurationTable[i].VendorGuid)) {
+            acpi_table = system_table->ConfigurationTable[i].VendorTable;
+            break;
+        }
+    }
+
+    // 戻り値をvoid型とする関数型をEntryPointTypeとしてエイリアスする
+    // メモリマップを渡して、カーネルが空き領域を管理できるようにする
+    // ローダの計測結果も渡して、カーネルの計測結果と一緒に出力する
+    // 初期 RAM ディスクは位置と大きさを渡す。無ければ NULL と 0
+    typedef void EntryPointType(const struct FrameBufferConfig*,
+        const struct MemoryMap*,
+        const struct BootTrace*,
+        const VOID*,
+        const VOID*,
+        UINT64);
     EntryPointType* entry_point = (EntryPointType*)entry_addr;
     // カーネルを起動する
-    entry_point(&config);
+    entry_point(&config, &memmap, &boot_trace, acpi_table, initrd_base, initrd_size);
 
     Print(L"All done\n");
 
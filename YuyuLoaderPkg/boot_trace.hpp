@@ -0,0 +1 @@
+../kernel/boot_trace.hpp
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "acpi.hpp"
+
+#include <cstring>
+#include "asmfunc.h"
+
+namespace {
+    template <typename T>
+    uint8_t SumBytes(const T* data, size_t bytes) {
+        auto p = reinterpret_cast<const uint8_t*>(data);
+        uint8_t sum = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            sum += p[i];
+        }
+        return sum;
+    }
+}  // namespace
+
+namespace acpi {
+    const FADT* fadt;
+    const MADT* madt;
+    const MCFG* mcfg;
+
+    bool RSDP::IsValid() const {
+        if (strncmp(this->signature, "RSD PTR ", 8) != 0) return false;
+        // XSDT を使うので ACPI 2.0 以降 (revision 2) が必要
+        if (this->revision != 2) return false;
+        if (SumBytes(this, 20) != 0) return false;
+        return SumBytes(this, 36) == 0;
+    }
+
+    bool DescriptionHeader::IsValid(const char* expected_signature) const {
+        if (strncmp(this->signature, expected_signature, 4) != 0) return false;
+        return SumBytes(this, this->length) == 0;
+    }
+
+    const DescriptionHeader& XSDT::operator[](size_t i) const {
+        // エントリは4バイト境界にしか揃っていないので、memcpy で読み出す
+        auto entries = reinterpret_cast<const uint8_t*>(&this->header) + sizeof(DescriptionHeader);
+        uint64_t addr;
+        memcpy(&addr, entries + sizeof(uint64_t) * i, sizeof(addr));
+        return *reinterpret_cast<const DescriptionHeader*>(addr);
+    }
+
+    size_t XSDT::Count() const {
+        return (this->header.length - sizeof(DescriptionHeader)) / sizeof(uint64_t);
+    }
+
+    const MCFGEntry& MCFG::operator[](size_t i) const {
+        auto entries = reinterpret_cast<const MCFGEntry*>(
+            reinterpret_cast<const uint8_t*>(&this->header) + sizeof(MCFG));
+        return entries[i];
+    }
+
+    size_t MCFG::Count() const {
+        return (this->header.length - sizeof(MCFG)) / sizeof(MCFGEntry);
+    }
+
+    Error Initialize(const RSDP* rsdp) {
+        if (rsdp == nullptr) {
+            return MAKE_ERROR(Error::kNotSupported);
+        }
+        if (!rsdp->IsValid()) {
+            return MAKE_ERROR(Error::kInvalidParameter);
+        }
+
+        const XSDT& xsdt = *reinterpret_cast<const XSDT*>(rsdp->xsdt_address);
+        if (!xsdt.header.IsValid("XSDT")) {
+            return MAKE_ERROR(Error::kInvalidParameter);
+        }
+
+        for (size_t i = 0; i < xsdt.Count(); ++i) {
+            const auto& entry = xsdt[i];
+            if (entry.IsValid("FACP")) {
+                fadt = reinterpret_cast<const FADT*>(&entry);
+            } else if (entry.IsValid("APIC")) {
+                madt = reinterpret_cast<const MADT*>(&entry);
+            } else if (entry.IsValid("MCFG")) {
+                mcfg = reinterpret_cast<const MCFG*>(&entry);
+            }
+        }
+
+        if (fadt == nullptr || madt == nullptr) {
+            return MAKE_ERROR(Error::kNotSupported);
+        }
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    uint32_t ReadPMTimer() {
+        return IoIn32(fadt->pm_tmr_blk);
+    }
+
+    int PMTimerBits() {
+        // FADT の flags の bit 8 (TMR_VAL_EXT) が立っていればカウンタは32ビット
+        return (fadt->flags >> 8) & 1 ? 32 : 24;
+    }
+
+    void WaitMicroseconds(unsigned long usec) {
+        const uint32_t mask = PMTimerBits() == 32 ? 0xffffffffu : 0x00ffffffu;
+        const uint32_t start = ReadPMTimer();
+        const uint64_t ticks = static_cast<uint64_t>(kPMTimerFreq) * usec / 1000000;
+        // カウンタは mask で折り返すので、開始時点からの差で比較する
+        while (((ReadPMTimer() - start) & mask) < ticks) {
+            __asm__ volatile("pause");
+        }
+    }
+
+    void WaitMilliseconds(unsigned long msec) {
+        WaitMicroseconds(msec * 1000);
+    }
+}  // namespace acpi
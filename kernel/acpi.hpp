@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "error.hpp"
+
+namespace acpi {
+    // Root System Description Pointer。UEFI の構成テーブルからブートローダが受け取る
+    struct RSDP {
+        char signature[8];
+        uint8_t checksum;
+        char oem_id[6];
+        uint8_t revision;
+        uint32_t rsdt_address;
+        uint32_t length;
+        uint64_t xsdt_address;
+        uint8_t extended_checksum;
+        char reserved[3];
+
+        bool IsValid() const;
+    } __attribute__((packed));
+
+    // 全ての記述テーブルに共通するヘッダ
+    struct DescriptionHeader {
+        char signature[4];
+        uint32_t length;
+        uint8_t revision;
+        uint8_t checksum;
+        char oem_id[6];
+        char oem_table_id[8];
+        uint32_t oem_revision;
+        uint32_t creator_id;
+        uint32_t creator_revision;
+
+        bool IsValid(const char* expected_signature) const;
+    } __attribute__((packed));
+
+    // Extended System Description Table。他の記述テーブルへの64ビットのポインタが並ぶ
+    struct XSDT {
+        DescriptionHeader header;
+
+        const DescriptionHeader& operator[](size_t i) const;
+        size_t Count() const;
+    } __attribute__((packed));
+
+    // Fixed ACPI Description Table。ここでは ACPI PM タイマーの情報だけを使う
+    struct FADT {
+        DescriptionHeader header;
+
+        char reserved1[76 - sizeof(header)];
+        uint32_t pm_tmr_blk;
+        char reserved2[112 - 80];
+        uint32_t flags;
+        char reserved3[276 - 116];
+    } __attribute__((packed));
+
+    // Multiple APIC Description Table。ヘッダの後ろに可変長のエントリが並ぶ
+    struct MADT {
+        DescriptionHeader header;
+        uint32_t local_apic_address;
+        uint32_t flags;
+    } __attribute__((packed));
+
+    // MADT のエントリの共通部分
+    struct MADTEntry {
+        uint8_t type;
+        uint8_t length;
+    } __attribute__((packed));
+
+    // MADT のエントリ type 0: Processor Local APIC
+    struct MADTLocalAPIC {
+        MADTEntry entry;
+        uint8_t processor_id;
+        uint8_t apic_id;
+        uint32_t flags;  // bit 0: 有効, bit 1: 起動時に無効でも有効にできる
+    } __attribute__((packed));
+
+    const uint8_t kMADTTypeLocalAPIC = 0;
+
+    // MCFG のエントリ。PCI セグメントグループ1つ分の ECAM 領域を表す
+    struct MCFGEntry {
+        // バス 0 の設定空間が置かれる物理アドレス。バス n の設定空間は base_address + (n << 20)
+        uint64_t base_address;
+        uint16_t segment_group;
+        uint8_t start_bus;
+        uint8_t end_bus;
+        uint32_t reserved;
+    } __attribute__((packed));
+
+    // PCI Express Memory Mapped Configuration Space Base Address Description Table
+    struct MCFG {
+        DescriptionHeader header;
+        char reserved[8];
+
+        const MCFGEntry& operator[](size_t i) const;
+        size_t Count() const;
+    } __attribute__((packed));
+
+    extern const FADT* fadt;
+    extern const MADT* madt;
+    // ECAM を持たない環境では nullptr
+    extern const MCFG* mcfg;
+
+    /**
+     * RSDP から XSDT をたどり、FADT と MADT (あれば MCFG も) を探す
+     * ブートローダが RSDP を見つけられなかった場合 (rsdp が nullptr) は kNotSupported を返す
+     **/
+    Error Initialize(const RSDP* rsdp);
+
+    /**
+     * ACPI PM タイマー (3.579545 MHz) を使って指定した時間だけ待つ
+     * 割り込みやキャリブレーションを必要としないので、他のタイマーの較正にも使える
+     * 待ち時間はカウンタが一周する時間 (24 ビットのカウンタで約 4.7 秒) より短くすること
+     **/
+    const uint32_t kPMTimerFreq = 3579545;
+    void WaitMicroseconds(unsigned long usec);
+    void WaitMilliseconds(unsigned long msec);
+    // PM タイマーの現在のカウント値と、カウンタのビット幅 (24 または 32)
+    uint32_t ReadPMTimer();
+    int PMTimerBits();
+}  // namespace acpi
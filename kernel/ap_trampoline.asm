@@ -0,0 +1,139 @@
+; ap_trampoline.asm
+;
+; アプリケーションプロセッサ (AP) の起動コード
+; BSP が 1MiB 未満の 4KiB 境界のページへコピーし、そのページ番号を SIPI で AP に通知する。
+; AP はリアルモードでここから実行を始め、プロテクトモードを経てロングモードへ移り、
+; カーネルの GDT とページテーブルに切り替えてから ap_params.entry を呼び出す。
+;
+; コピー先のアドレスは実行時に決まるので、コード中のアドレスは全て先頭からのオフセットで書き、
+; 絶対アドレスが必要な箇所 (GDTR のベース、far jump の飛び先) は BSP がコピー後に書き込む。
+
+bits 16
+section .text
+
+global ap_trampoline
+global ap_protected_mode
+global ap_long_mode
+global ap_gdt
+global ap_gdtr
+global ap_trampoline_params
+global ap_trampoline_end
+
+%define OFFSET(label) ((label) - ap_trampoline)
+
+ap_trampoline:
+    cli
+    mov ax, cs
+    mov ds, ax      ; リアルモードでは ds:offset = コピー先 + offset
+
+    ; ebx = コピー先の先頭アドレス。この時点ではスタックが無いので、cs から計算しておく
+    xor ebx, ebx
+    mov bx, cs
+    shl ebx, 4
+
+    lgdt [OFFSET(ap_gdtr)]
+
+    mov eax, cr0
+    or eax, 1       ; CR0.PE: プロテクトモードを有効にする
+    mov cr0, eax
+    o32 jmp far [OFFSET(ap_params.pm_jump)]
+
+bits 32
+ap_protected_mode:
+    mov ax, 0x10    ; 32ビットのデータセグメント
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; CR4.PAE, CR4.OSFXSR, CR4.OSXMMEXCPT
+    mov eax, cr4
+    or eax, (1 << 5) | (1 << 9) | (1 << 10)
+    mov cr4, eax
+
+    mov eax, [ebx + OFFSET(ap_params.cr3)]
+    mov cr3, eax
+
+    ; IA32_EFER.LME: ロングモードを有効にする
+    mov ecx, 0xc0000080
+    rdmsr
+    or eax, 1 << 8
+    wrmsr
+
+    ; CR0.PG と CR0.MP を立て、CR0.EM (x87 のエミュレーション) を落とす
+    mov eax, cr0
+    or eax, (1 << 31) | (1 << 1)
+    and eax, ~(1 << 2)
+    mov cr0, eax
+    jmp far [ebx + OFFSET(ap_params.lm_jump)]
+
+bits 64
+ap_long_mode:
+    ; rbx の上位32ビットは 0 なので、そのままコピー先の先頭アドレスとして使える
+    lgdt [rbx + OFFSET(ap_params.kernel_gdtr)]
+    mov rsp, [rbx + OFFSET(ap_params.stack_top)]
+
+    mov ax, [rbx + OFFSET(ap_params.kernel_ss)]
+    mov ss, ax
+    xor ax, ax
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    ; CS をカーネルのコードセグメントに切り替える
+    movzx rax, word [rbx + OFFSET(ap_params.kernel_cs)]
+    push rax
+    lea rax, [rel .kernel_cs]
+    push rax
+    o64 retf
+.kernel_cs:
+    mov edi, [rbx + OFFSET(ap_params.cpu_index)]
+    mov rax, [rbx + OFFSET(ap_params.entry)]
+    call rax
+.fin:
+    hlt
+    jmp .fin
+
+; 起動時だけに使う GDT: null, 32ビットコード (0x08), 32ビットデータ (0x10), 64ビットコード (0x18)
+align 8
+ap_gdt:
+    dq 0
+    dq 0x00cf9a000000ffff
+    dq 0x00cf92000000ffff
+    dq 0x00af9a000000ffff
+ap_gdt_end:
+
+ap_gdtr:
+    dw ap_gdt_end - ap_gdt - 1
+    dd 0            ; BSP が ap_gdt の絶対アドレスを書き込む
+
+; BSP が書き込む起動パラメータ。smp.cpp の APTrampolineParams と同じ配置にすること
+align 8
+ap_trampoline_params:
+ap_params:
+.pm_jump:           ; m16:32 の far ポインタ: ap_protected_mode の絶対アドレスとセレクタ 0x08
+    dd 0
+    dw 0x08
+    dw 0
+.lm_jump:           ; m16:32 の far ポインタ: ap_long_mode の絶対アドレスとセレクタ 0x18
+    dd 0
+    dw 0x18
+    dw 0
+.cr3:
+    dq 0
+.kernel_gdtr:       ; 64ビットの GDTR (limit 2バイト + base 8バイト)
+    dw 0
+    dq 0
+    times 6 db 0
+.stack_top:
+    dq 0
+.entry:
+    dq 0
+.cpu_index:
+    dd 0
+.kernel_cs:
+    dw 0
+.kernel_ss:
+    dw 0
+
+ap_trampoline_end:
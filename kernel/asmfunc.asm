@@ -0,0 +1,234 @@
+; asmfunc.asm
+;
+; C++ から直接書けない命令をまとめたアセンブリ関数群
+; System V AMD64 Calling Convention
+; Registers: RDI, RSI, RDX, RCX, R8, R9
+
+bits 64
+section .text
+
+global IoOut8  ; void IoOut8(uint16_t addr, uint8_t data);
+IoOut8:
+    mov dx, di    ; dx = addr
+    mov al, sil   ; al = data
+    out dx, al
+    ret
+
+global IoIn8  ; uint8_t IoIn8(uint16_t addr);
+IoIn8:
+    mov dx, di    ; dx = addr
+    in al, dx
+    ret
+
+global IoOut32  ; void IoOut32(uint16_t addr, uint32_t data);
+IoOut32:
+    mov dx, di    ; dx = addr
+    mov eax, esi  ; eax = data
+    out dx, eax
+    ret
+
+global IoIn32  ; uint32_t IoIn32(uint16_t addr);
+IoIn32:
+    mov dx, di    ; dx = addr
+    in eax, dx
+    ret
+
+global ReadMSR  ; uint64_t ReadMSR(uint32_t msr);
+ReadMSR:
+    mov ecx, edi
+    rdmsr           ; edx:eax = MSR[ecx]
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+global WriteMSR  ; void WriteMSR(uint32_t msr, uint64_t value);
+WriteMSR:
+    mov ecx, edi
+    mov eax, esi    ; 下位32ビット
+    mov rdx, rsi
+    shr rdx, 32     ; 上位32ビット
+    wrmsr
+    ret
+
+global GetCR0  ; uint64_t GetCR0();
+GetCR0:
+    mov rax, cr0
+    ret
+
+global SetCR0  ; void SetCR0(uint64_t value);
+SetCR0:
+    mov cr0, rdi
+    ret
+
+global GetCR4  ; uint64_t GetCR4();
+GetCR4:
+    mov rax, cr4
+    ret
+
+global SetCR4  ; void SetCR4(uint64_t value);
+SetCR4:
+    mov cr4, rdi
+    ret
+
+global SetXCR0  ; void SetXCR0(uint64_t value);
+SetXCR0:
+    mov eax, edi    ; 下位32ビット
+    mov rdx, rdi
+    shr rdx, 32     ; 上位32ビット
+    xor ecx, ecx    ; XCR0 を指定する
+    xsetbv
+    ret
+
+global LoadGDT  ; void LoadGDT(uint16_t limit, uint64_t offset);
+LoadGDT:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 10
+    mov [rsp], di       ; limit
+    mov [rsp + 2], rsi  ; offset
+    lgdt [rsp]
+    mov rsp, rbp
+    pop rbp
+    ret
+
+global SetDSAll  ; void SetDSAll(uint16_t value);
+SetDSAll:
+    mov ds, di
+    mov es, di
+    mov fs, di
+    mov gs, di
+    ret
+
+global SetCSSS  ; void SetCSSS(uint16_t cs, uint16_t ss);
+SetCSSS:
+    push rbp
+    mov rbp, rsp
+    mov ss, si
+    mov rax, .next
+    push rdi    ; CS
+    push rax    ; RIP
+    o64 retf
+.next:
+    mov rsp, rbp
+    pop rbp
+    ret
+
+global GetCR3  ; uint64_t GetCR3();
+GetCR3:
+    mov rax, cr3
+    ret
+
+global SetCR3  ; void SetCR3(uint64_t value);
+SetCR3:
+    mov cr3, rdi
+    ret
+
+global LoadIDT  ; void LoadIDT(uint16_t limit, uint64_t offset);
+LoadIDT:
+    push rbp
+    mov rbp, rsp
+    sub rsp, 10
+    mov [rsp], di       ; limit
+    mov [rsp + 2], rsi  ; offset
+    lidt [rsp]
+    mov rsp, rbp
+    pop rbp
+    ret
+
+; 割り込みハンドラの入口
+; C++ の関数を呼ぶ前に、呼び出し側が保存すべきレジスタ (caller-saved) と SSE / x87 の状態を保存する。
+; 割り込まれた処理は SIMD カーネルを実行中かもしれないため、fxsave で XMM レジスタも退避する。
+%macro INTERRUPT_ENTRY 2  ; 入口の名前, 呼び出す関数
+extern %2
+global %1
+%1:
+    push rbp
+    mov rbp, rsp
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+    and rsp, -16
+    sub rsp, 512
+    fxsave64 [rsp]
+    cld
+    call %2
+    fxrstor64 [rsp]
+    lea rsp, [rbp - 8 * 9]
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    pop rbp
+    iretq
+%endmacro
+
+INTERRUPT_ENTRY IntHandlerLAPICTimer, LAPICTimerOnInterrupt  ; void IntHandlerLAPICTimer();
+INTERRUPT_ENTRY IntHandlerWakeup, WakeupOnInterrupt  ; void IntHandlerWakeup();
+
+; スプリアス割り込みは EOI を送らずに戻る
+global IntHandlerSpurious  ; void IntHandlerSpurious();
+IntHandlerSpurious:
+    iretq
+
+; タスクを切り替える
+; 呼び出し先が保存すべきレジスタと MXCSR・x87 制御ワードを現在のスタックに積み、
+; スタックポインタを *current_rsp に保存してから next_rsp のスタックで同じものを復元して戻る
+global SwitchContext  ; void SwitchContext(uint64_t* current_rsp, uint64_t next_rsp);
+SwitchContext:
+    push rbp
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    sub rsp, 8
+    stmxcsr [rsp]
+    fnstcw [rsp + 4]
+
+    mov [rdi], rsp
+    mov rsp, rsi
+
+    ldmxcsr [rsp]
+    fldcw [rsp + 4]
+    add rsp, 8
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    pop rbp
+    ret
+
+; 新しいタスクが最初に SwitchContext から戻る先。TaskManager::NewTask が r12 にタスクを入れておく
+extern TaskMain
+global TaskEntryPoint  ; void TaskEntryPoint();
+TaskEntryPoint:
+    mov rdi, r12
+    call TaskMain
+.fin:
+    hlt
+    jmp .fin
+
+extern kernel_main_stack
+extern KernelMainNewStack
+
+; ブートローダから呼ばれるカーネルのエントリポイント
+; UEFI のスタックはブートサービス用の領域にあるので、カーネルのスタックに切り替える
+global KernelMain
+KernelMain:
+    mov rsp, kernel_main_stack + 1024 * 1024
+    call KernelMainNewStack
+.fin:
+    hlt
+    jmp .fin
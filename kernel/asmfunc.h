@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+extern "C" {
+    void IoOut8(uint16_t addr, uint8_t data);
+    uint8_t IoIn8(uint16_t addr);
+    void IoOut32(uint16_t addr, uint32_t data);
+    uint32_t IoIn32(uint16_t addr);
+    uint64_t ReadMSR(uint32_t msr);
+    void WriteMSR(uint32_t msr, uint64_t value);
+    uint64_t GetCR0();
+    void SetCR0(uint64_t value);
+    uint64_t GetCR4();
+    void SetCR4(uint64_t value);
+    void SetXCR0(uint64_t value);
+    void LoadGDT(uint16_t limit, uint64_t offset);
+    void SetDSAll(uint16_t value);
+    void SetCSSS(uint16_t cs, uint16_t ss);
+    uint64_t GetCR3();
+    void SetCR3(uint64_t value);
+    void LoadIDT(uint16_t limit, uint64_t offset);
+    void IntHandlerLAPICTimer();
+    void IntHandlerWakeup();
+    void IntHandlerSpurious();
+    void SwitchContext(uint64_t* current_rsp, uint64_t next_rsp);
+    void TaskEntryPoint();
+}
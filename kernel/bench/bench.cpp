@@ -0,0 +1,699 @@
+/**
+ * カーネルの描画処理とメモリ管理のベンチマーク (ホスト上で実行する)
+ *
+ * カーネルのソースをそのままホスト用にコンパイルし、RAM 上に確保した偽のフレームバッファに対して
+ * 塗りつぶし・コピー・文字描画の速度を測る。結果は1行1件の JSON で標準出力に書き出す。
+ *   {"bench":"fill","kernels":"avx2","resolution":"1920x1080","ns_per_pixel":...,"gb_per_s":...}
+ *   {"bench":"frames_fragmented_stats","kernels":"avx2","largest_free_run":...,"fragmentation":...}
+ *   {"bench":"heap_small","kernels":"avx2","ns_per_op":...}
+ *   {"bench":"heap_trace_stats","kernels":"avx2","bytes_in_use":...,"bytes_reserved":...,"utilization":...}
+ *   {"bench":"shadow_flush","kernels":"avx2","resolution":"1920x1080","ns_per_pixel":...,"drawn_per_flushed":...}
+ *   {"bench":"shadow_flush_rgb565","kernels":"avx2","resolution":"1920x1080","ns_per_pixel":...}
+ *   {"bench":"raster_polygon","kernels":"avx2","resolution":"1920x1080","shapes_per_s":...}
+ *   {"bench":"decode_qoi","kernels":"avx2","resolution":"1920x1080","mb_per_s":...,"mpixels_per_s":...}
+ *   {"bench":"snapshot_delta_box","kernels":"avx2","resolution":"1920x1080","ms_per_snapshot":...}
+ *   {"bench":"compose_scene","kernels":"avx2","resolution":"1920x1080","layers":...,"ms_per_frame":...}
+ *
+ * 使い方: make bench (kernel/ で実行する)
+ **/
+
+#include <sys/mman.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "../console.hpp"
+#include "../font.hpp"
+#include "../graphics.hpp"
+#include "../heap.hpp"
+#include "../image.hpp"
+#include "../layer.hpp"
+#include "../memory_manager.hpp"
+#include "../pixel_bitmask.hpp"
+#include "../rasterizer.hpp"
+#include "../shadow_buffer.hpp"
+#include "../snapshot.hpp"
+#include "../simd.hpp"
+
+// console.hpp で宣言されている関数。ベンチマークでは使わない
+int printk(const char*, ...) {
+    return 0;
+}
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // 1回の計測で最低限かける時間
+    const double kMinSeconds = 0.2;
+
+    struct Resolution {
+        int width, height;
+    };
+
+    const Resolution kResolutions[] = {{1024, 768}, {1920, 1080}, {3840, 2160}};
+
+    // func を kMinSeconds 以上繰り返し実行し、1回あたりの秒数を返す
+    template <typename Func>
+    double Measure(Func&& func) {
+        func();  // ウォームアップ
+        long iterations = 0;
+        const auto start = Clock::now();
+        double elapsed = 0;
+        do {
+            func();
+            ++iterations;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < kMinSeconds);
+        return elapsed / iterations;
+    }
+
+    // pixels ピクセル、bytes バイトを seconds 秒で処理した結果を出力する
+    void ReportPixels(const char* name, const Resolution& res, double seconds, double pixels, double bytes) {
+        printf("{\"bench\":\"%s\",\"kernels\":\"%s\",\"resolution\":\"%dx%d\","
+               "\"ns_per_pixel\":%.4f,\"gb_per_s\":%.3f}\n",
+            name,
+            pixel_kernels.name,
+            res.width,
+            res.height,
+            seconds * 1e9 / pixels,
+            bytes / seconds / 1e9);
+    }
+
+    void ReportOps(const char* name, double seconds, double ops) {
+        printf("{\"bench\":\"%s\",\"kernels\":\"%s\",\"ns_per_op\":%.2f}\n",
+            name,
+            pixel_kernels.name,
+            seconds * 1e9 / ops);
+    }
+
+    const PixelBitMask kBGRMask {0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000};
+    const PixelBitMask kRGB565Mask {0xf800, 0x07e0, 0x001f, 0};
+    const PixelBitMask kRGB10Mask {0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000};
+
+    /**
+     * RAM 上の偽のフレームバッファ。行の末尾に余白を持つ実機の配置を真似る
+     * format が kPixelBitMask なら、mask に従った1ピクセルのバイト数で確保する
+     **/
+    struct FakeFrameBuffer {
+        explicit FakeFrameBuffer(const Resolution& res,
+            PixelFormat format = kPixelBGRResv8BitPerColor,
+            const PixelBitMask& mask = kBGRMask) {
+            const uint32_t stride = (res.width + 63) / 64 * 64;
+            config = {nullptr,
+                stride,
+                static_cast<uint32_t>(res.width),
+                static_cast<uint32_t>(res.height),
+                format,
+                0,
+                mask};
+            bytes = size_t {1} * BytesPerPixel(config) * stride * res.height;
+            buffer = static_cast<uint8_t*>(aligned_alloc(4096, bytes));
+            memset(buffer, 0, bytes);
+            config.frame_buffer = buffer;
+            config.frame_buffer_size = bytes;
+        }
+        ~FakeFrameBuffer() {
+            free(buffer);
+        }
+
+        uint8_t* buffer;
+        size_t bytes;
+        FrameBufferConfig config;
+    };
+
+    void BenchBitMaskFlush(const char* name, const Resolution& res, const PixelBitMask& mask) {
+        FakeFrameBuffer fb {res, kPixelBitMask, mask};
+        const double pixels = double {1} * res.width * res.height;
+        alignas(64) static char shadow_buf[sizeof(ShadowBuffer)];
+        uint8_t* shadow_mem = static_cast<uint8_t*>(
+            aligned_alloc(4096, (ShadowBuffer::BytesRequired(fb.config) + 4095) / 4096 * 4096));
+        auto shadow = new (shadow_buf) ShadowBuffer {fb.config, shadow_mem};
+        DispatchPixelFormat(shadow->Config(), [&](auto& writer) {
+            for (int y = 0; y < res.height; ++y) {
+                writer.FillRect(0, y, res.width, 1, {static_cast<uint8_t>(y), 128, 255});
+            }
+        });
+        const double t = Measure([&] {
+            shadow->MarkDirty({0, 0, res.width, res.height});
+            shadow->Flush();
+        });
+        ReportPixels(name, res, t, pixels, (4 + BytesPerPixel(fb.config)) * pixels);
+        shadow->~ShadowBuffer();
+        free(shadow_mem);
+    }
+
+    void BenchGraphics(const Resolution& res) {
+        FakeFrameBuffer fb {res};
+        const double pixels = double {1} * res.width * res.height;
+
+        BasicPixelWriter<kPixelBGRResv8BitPerColor> writer {fb.config};
+        BGRResv8BitPerColorPixelWriter adapter {fb.config};
+
+        // 画面全体の塗りつぶし
+        uint8_t c = 0;
+        double t = Measure([&] { writer.FillRect(0, 0, res.width, res.height, {c++, 0, 0}); });
+        ReportPixels("fill", res, t, pixels, 4 * pixels);
+
+        // 小さな矩形 (64x64) を敷き詰める塗りつぶし。仮想関数経由の呼び出しを含む
+        t = Measure([&] {
+            for (int y = 0; y + 64 <= res.height; y += 64) {
+                for (int x = 0; x + 64 <= res.width; x += 64) {
+                    adapter.FillRect(x, y, 64, 64, {0, c, 0});
+                }
+            }
+            ++c;
+        });
+        const double tiled = double {1} * (res.width / 64 * 64) * (res.height / 64 * 64);
+        ReportPixels("fill_rect_64", res, t, tiled, 4 * tiled);
+
+        // 1行 (16ピクセル) 分の上方向スクロール。全幅なので1回の memmove になる
+        const int scroll_h = res.height - kFontHeight;
+        t = Measure([&] { adapter.CopyRect(0, 0, 0, kFontHeight, res.width, scroll_h); });
+        const double scrolled = double {1} * res.width * scroll_h;
+        ReportPixels("copy_scroll", res, t, scrolled, 8 * scrolled);
+
+        // 全幅でない矩形のコピー。行ごとに SIMD カーネルで転送する
+        const int w = res.width / 2, h = res.height / 2;
+        t = Measure([&] { adapter.CopyRect(w, h, 0, 0, w, h); });
+        ReportPixels("copy_rect", res, t, double {1} * w * h, 8.0 * w * h);
+
+        // 画面を文字で埋める。ピクセル数は文字のセルの合計
+        const int cols = res.width / kFontWidth, rows = res.height / kFontHeight;
+        char line[1024];
+        for (int i = 0; i < cols; ++i) line[i] = '!' + i % 94;
+        line[cols] = '\0';
+        t = Measure([&] {
+            for (int row = 0; row < rows; ++row) {
+                WriteString(adapter, 0, row * kFontHeight, line, {255, 255, 255}, {0, 0, 0});
+            }
+        });
+        const double text_pixels = double {1} * cols * rows * kFontWidth * kFontHeight;
+        ReportPixels("text", res, t, text_pixels, 4 * text_pixels);
+
+        /**
+         * 影のバッファに画面全体の塗りつぶしと文字を重ねて描き、VRAM へ転送する
+         * 重ね描きは影のバッファの中で済むので、描画したバイト数と転送したバイト数の比が
+         * VRAM への書き込みを減らせた割合になる
+         **/
+        alignas(64) static char shadow_buf[sizeof(ShadowBuffer)];
+        uint8_t* shadow_mem = static_cast<uint8_t*>(
+            aligned_alloc(4096, (ShadowBuffer::BytesRequired(fb.config) + 4095) / 4096 * 4096));
+        auto shadow = new (shadow_buf) ShadowBuffer {fb.config, shadow_mem};
+        BGRResv8BitPerColorPixelWriter shadow_writer {shadow->Config(), shadow};
+        t = Measure([&] {
+            shadow_writer.FillRect(0, 0, res.width, res.height, {0, 0, 0});
+            for (int row = 0; row < rows; ++row) {
+                WriteString(shadow_writer, 0, row * kFontHeight, line, {255, 255, 255}, {0, 0, 0});
+            }
+            shadow->Flush();
+        });
+        const auto shadow_stats = shadow->GetStats();
+        printf("{\"bench\":\"shadow_flush\",\"kernels\":\"%s\",\"resolution\":\"%dx%d\","
+               "\"ns_per_pixel\":%.4f,\"bytes_drawn\":%llu,\"bytes_flushed\":%llu,"
+               "\"drawn_per_flushed\":%.3f}\n",
+            pixel_kernels.name,
+            res.width,
+            res.height,
+            t * 1e9 / pixels,
+            static_cast<unsigned long long>(shadow_stats.bytes_drawn),
+            static_cast<unsigned long long>(shadow_stats.bytes_flushed),
+            static_cast<double>(shadow_stats.bytes_drawn) / shadow_stats.bytes_flushed);
+        shadow->~ShadowBuffer();
+        free(shadow_mem);
+
+        // PixelBitMask 形式の VRAM への転送。影のバッファの32ビット値を変換しながら書き込む
+        BenchBitMaskFlush("shadow_flush_rgb565", res, kRGB565Mask);
+        BenchBitMaskFlush("shadow_flush_rgb10", res, kRGB10Mask);
+    }
+
+    /**
+     * レイヤーの合成のベンチマーク
+     * 画面全体の壁紙の上に、不透明・全体が半透明・ピクセルごとに半透明のウィンドウを重ね、
+     * 毎フレーム全てのウィンドウを動かして、ダメージのある領域を合成する時間を測る
+     **/
+    const int kSceneWindows = 48;
+
+    void BenchCompose(const Resolution& res) {
+        FakeFrameBuffer fb {res};
+        auto manager = new LayerManager {fb.config, nullptr, {0, 0, 0}};
+
+        Layer* wallpaper = manager->NewLayer(res.width, res.height, Layer::Blend::kOpaque);
+        wallpaper->FillRect({0, 0, res.width, res.height}, {32, 64, 96});
+        manager->Move(*wallpaper, 0, 0);
+
+        struct Window {
+            Layer* layer;
+            int x, y, vx, vy;
+        } windows[kSceneWindows];
+        const int w = res.width / 5, h = res.height / 4;
+        uint32_t seed = 1;
+        auto next = [&seed] {
+            seed = seed * 1103515245 + 12345;
+            return static_cast<int>(seed >> 16);
+        };
+        for (int i = 0; i < kSceneWindows; ++i) {
+            // 4つに1つはピクセルごと、4つに1つは全体が半透明
+            const auto blend = i % 4 == 1 ? Layer::Blend::kPerPixelAlpha
+                : i % 4 == 3              ? Layer::Blend::kConstantAlpha
+                                          : Layer::Blend::kOpaque;
+            Layer* layer = manager->NewLayer(w, h, blend);
+            const uint8_t c = static_cast<uint8_t>(i * 5);
+            layer->FillRect({0, 0, w, h}, {c, 200, 100, 160});
+            layer->FillRect({0, 0, w, 24}, {0, 0, 160, 255});
+            if (blend == Layer::Blend::kConstantAlpha) manager->SetAlpha(*layer, 128);
+            windows[i] = {layer, next() % (res.width - w), next() % (res.height - h), next() % 9 - 4,
+                next() % 9 - 4};
+            manager->Move(*layer, windows[i].x, windows[i].y);
+        }
+        manager->Compose();
+        manager->TakeStats();
+
+        long frames = 0;
+        const double t = Measure([&] {
+            for (auto& win : windows) {
+                if (win.x + win.vx < 0 || win.x + win.vx > res.width - w) win.vx = -win.vx;
+                if (win.y + win.vy < 0 || win.y + win.vy > res.height - h) win.vy = -win.vy;
+                win.x += win.vx;
+                win.y += win.vy;
+                manager->Move(*win.layer, win.x, win.y);
+            }
+            manager->Compose();
+            ++frames;
+        });
+        const auto stats = manager->TakeStats();
+        printf("{\"bench\":\"compose_scene\",\"kernels\":\"%s\",\"resolution\":\"%dx%d\","
+               "\"layers\":%d,\"ms_per_frame\":%.3f,\"mpixels_per_frame\":%.2f,"
+               "\"blended_ratio\":%.2f,\"culled_ratio\":%.2f}\n",
+            pixel_kernels.name,
+            res.width,
+            res.height,
+            kSceneWindows + 1,
+            t * 1e3,
+            stats.pixels_composed / 1e6 / frames,
+            double {1} * stats.pixels_blended / stats.pixels_composed,
+            double {1} * stats.pixels_culled / stats.pixels_composed);
+        // レイヤーの画像とレイヤー自身は解放しない (ホスト上ではプロセスの終了で回収される)
+        delete manager;
+    }
+
+    /**
+     * 図形の描画のベンチマーク
+     * 画面内の決まった位置の並び (線形合同法で作る) に図形を描き、1秒あたりに描ける図形の数を測る
+     * 位置の一部は画面の外にはみ出し、クリップの処理も含めて測る
+     **/
+    const int kRasterShapes = 1024;
+
+    void BenchRaster(const Resolution& res) {
+        FakeFrameBuffer fb {res};
+        const Rectangle screen {0, 0, res.width, res.height};
+        Point origins[kRasterShapes];
+        uint32_t seed = 1;
+        auto next = [&seed](int range) {
+            seed = seed * 1103515245 + 12345;
+            return static_cast<int>((seed >> 8) % (range + 200)) - 100;
+        };
+        for (auto& p : origins) p = {next(res.width), next(res.height)};
+
+        auto report = [&](const char* name, double seconds) {
+            printf("{\"bench\":\"%s\",\"kernels\":\"%s\",\"resolution\":\"%dx%d\","
+                   "\"shapes_per_s\":%.0f}\n",
+                name,
+                pixel_kernels.name,
+                res.width,
+                res.height,
+                kRasterShapes / seconds);
+        };
+
+        // 長さ 200 程度の線分。向きは図形ごとに変える
+        double t = Measure([&] {
+            for (int i = 0; i < kRasterShapes; ++i) {
+                const Point p = origins[i], q = origins[(i + 1) % kRasterShapes];
+                DrawLine(fb.config, screen, p, {p.x + (q.x & 255) - 128, p.y + (q.y & 255) - 128}, {255, 0, 0});
+            }
+        });
+        report("raster_line", t);
+
+        t = Measure([&] {
+            for (const Point& p : origins) DrawCircle(fb.config, screen, p, 50, {0, 255, 0});
+        });
+        report("raster_circle", t);
+
+        t = Measure([&] {
+            for (const Point& p : origins) FillCircle(fb.config, screen, p, 50, {0, 0, 255});
+        });
+        report("raster_fill_circle", t);
+
+        // 外径 60、内径 25 の10頂点の星形 (凹多角形)
+        const Point star[10] = {{0, -60}, {15, -20}, {57, -19}, {23, 8}, {35, 49},
+            {0, 25}, {-35, 49}, {-23, 8}, {-57, -19}, {-15, -20}};
+        t = Measure([&] {
+            for (const Point& p : origins) {
+                Point points[10];
+                for (int i = 0; i < 10; ++i) points[i] = {p.x + star[i].x, p.y + star[i].y};
+                FillPolygon(fb.config, screen, points, 10, {255, 255, 0});
+            }
+        });
+        report("raster_polygon", t);
+    }
+
+    /**
+     * 画像の復号のベンチマーク
+     * 画面と同じ大きさの合成画像 (グラデーションの背景、単色の四角、細かな模様の帯) を
+     * BMP (24 / 32 ビット) と QOI に符号化しておき、DrawImage で画面全体へ描く速さを測る。
+     * 入力のバイト数で割った MB/s と、1秒あたりのピクセル数を出力する
+     **/
+    PixelColor SampleImage(int x, int y, int width, int height) {
+        if (y > height / 2 && y < height / 2 + 64) {
+            // 模様の帯: 隣のピクセルとの差が大きく、QOI では QOI_OP_LUMA や QOI_OP_RGB になる
+            const uint32_t h = (x * 2654435761u) ^ (y * 40503u);
+            return {static_cast<uint8_t>(h >> 8), static_cast<uint8_t>(h >> 16), static_cast<uint8_t>(h >> 24)};
+        }
+        if (x % 256 < 160 && y % 192 < 120) return {40, 90, 200};
+        return {static_cast<uint8_t>(255 * x / width), static_cast<uint8_t>(255 * y / height), 128};
+    }
+
+    void Put16LE(uint8_t* p, uint16_t v) {
+        memcpy(p, &v, 2);
+    }
+    void Put32LE(uint8_t* p, uint32_t v) {
+        memcpy(p, &v, 4);
+    }
+    void Put32BE(uint8_t* p, uint32_t v) {
+        p[0] = v >> 24;
+        p[1] = v >> 16;
+        p[2] = v >> 8;
+        p[3] = v;
+    }
+
+    // 下から上の順に行を並べた BI_RGB の BMP を作る
+    std::vector<uint8_t> EncodeBMP(int width, int height, int bits_per_pixel) {
+        const size_t stride = (size_t {1} * width * bits_per_pixel + 31) / 32 * 4;
+        std::vector<uint8_t> out(54 + stride * height);
+        out[0] = 'B';
+        out[1] = 'M';
+        Put32LE(&out[2], out.size());
+        Put32LE(&out[10], 54);
+        Put32LE(&out[14], 40);
+        Put32LE(&out[18], width);
+        Put32LE(&out[22], height);
+        Put16LE(&out[26], 1);
+        Put16LE(&out[28], bits_per_pixel);
+        for (int y = 0; y < height; ++y) {
+            uint8_t* row = &out[54 + stride * (height - 1 - y)];
+            for (int x = 0; x < width; ++x) {
+                const PixelColor c = SampleImage(x, y, width, height);
+                uint8_t* p = row + bits_per_pixel / 8 * x;
+                p[0] = c.b;
+                p[1] = c.g;
+                p[2] = c.r;
+                if (bits_per_pixel == 32) p[3] = 255;
+            }
+        }
+        return out;
+    }
+
+    // QOI の仕様書の参照実装と同じ手順で符号化する (3 チャンネル)
+    std::vector<uint8_t> EncodeQOI(int width, int height) {
+        std::vector<uint8_t> out(14);
+        memcpy(&out[0], "qoif", 4);
+        Put32BE(&out[4], width);
+        Put32BE(&out[8], height);
+        out[12] = 3;
+        out[13] = 0;
+        uint32_t index[64] = {};
+        PixelColor prev {0, 0, 0, 255};
+        int run = 0;
+        auto pack = [](const PixelColor& c) {
+            return c.r | (c.g << 8) | (c.b << 16) | (uint32_t {c.a} << 24);
+        };
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const PixelColor c = SampleImage(x, y, width, height);
+                const bool last = y == height - 1 && x == width - 1;
+                if (pack(c) == pack(prev)) {
+                    if (++run == 62 || last) {
+                        out.push_back(0xc0 | (run - 1));
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run > 0) {
+                    out.push_back(0xc0 | (run - 1));
+                    run = 0;
+                }
+                const int slot = (c.r * 3 + c.g * 5 + c.b * 7 + c.a * 11) % 64;
+                if (index[slot] == pack(c)) {
+                    out.push_back(slot);
+                } else {
+                    index[slot] = pack(c);
+                    const int8_t dr = c.r - prev.r, dg = c.g - prev.g, db = c.b - prev.b;
+                    const int8_t dr_dg = dr - dg, db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                    } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8
+                               && db_dg <= 7) {
+                        out.push_back(0x80 | (dg + 32));
+                        out.push_back((dr_dg + 8) << 4 | (db_dg + 8));
+                    } else {
+                        out.insert(out.end(), {0xfe, c.r, c.g, c.b});
+                    }
+                }
+                prev = c;
+            }
+        }
+        out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+        return out;
+    }
+
+    void BenchImage(const Resolution& res) {
+        FakeFrameBuffer fb {res};
+        const Rectangle screen {0, 0, res.width, res.height};
+        const double pixels = double {1} * res.width * res.height;
+        struct {
+            const char* name;
+            std::vector<uint8_t> file;
+        } images[] = {
+            {"decode_bmp24", EncodeBMP(res.width, res.height, 24)},
+            {"decode_bmp32", EncodeBMP(res.width, res.height, 32)},
+            {"decode_qoi", EncodeQOI(res.width, res.height)},
+        };
+        for (const auto& image : images) {
+            const double t = Measure([&] {
+                DrawImage(fb.config, screen, {0, 0}, image.file.data(), image.file.size());
+            });
+            printf("{\"bench\":\"%s\",\"kernels\":\"%s\",\"resolution\":\"%dx%d\","
+                   "\"bytes\":%zu,\"mb_per_s\":%.1f,\"mpixels_per_s\":%.1f}\n",
+                image.name,
+                pixel_kernels.name,
+                res.width,
+                res.height,
+                image.file.size(),
+                image.file.size() / t / 1e6,
+                pixels / t / 1e6);
+        }
+    }
+
+    /**
+     * 画面のスナップショットのベンチマーク
+     * 四角と図形を描いた画面について、キーフレーム、変化のない画面の差分、
+     * 16x16 の四角が1つ動いた画面の差分を符号化する時間と、書き出す行のバイト数を測る
+     **/
+    uint64_t snapshot_line_bytes;
+
+    void CountSnapshotLine(const char* line) {
+        snapshot_line_bytes += strlen(line);
+    }
+
+    void BenchSnapshot(const Resolution& res) {
+        FakeFrameBuffer fb {res};
+        const Rectangle screen {0, 0, res.width, res.height};
+        DispatchPixelFormat(fb.config, [&](auto& writer) {
+            writer.FillRect(0, 0, res.width, res.height, {255, 255, 255});
+            for (int i = 0; i < 64; ++i) {
+                writer.FillRect((i * 97) % res.width, (i * 61) % res.height, 120, 80,
+                    {static_cast<uint8_t>(i * 4), 128, static_cast<uint8_t>(255 - i * 4)});
+            }
+        });
+        for (int i = 0; i < 256; ++i) {
+            FillCircle(fb.config, screen, {(i * 131) % res.width, (i * 71) % res.height}, 20,
+                {static_cast<uint8_t>(i), 0, 0});
+        }
+
+        const size_t bytes = Snapshotter::BytesRequired(fb.config);
+        uint8_t* previous = static_cast<uint8_t*>(aligned_alloc(4096, (bytes + 4095) / 4096 * 4096));
+        auto report = [&](const char* name, double seconds, uint64_t line_bytes) {
+            printf("{\"bench\":\"%s\",\"kernels\":\"%s\",\"resolution\":\"%dx%d\","
+                   "\"ms_per_snapshot\":%.3f,\"serial_bytes\":%llu}\n",
+                name,
+                pixel_kernels.name,
+                res.width,
+                res.height,
+                seconds * 1e3,
+                static_cast<unsigned long long>(line_bytes));
+        };
+
+        uint64_t line_bytes = 0;
+        double t = Measure([&] {
+            Snapshotter snapshotter {fb.config, previous, CountSnapshotLine};
+            snapshot_line_bytes = 0;
+            snapshotter.Capture(screen);
+            line_bytes = snapshot_line_bytes;
+        });
+        report("snapshot_key", t, line_bytes);
+
+        Snapshotter snapshotter {fb.config, previous, CountSnapshotLine};
+        snapshotter.Capture(screen);
+        t = Measure([&] {
+            snapshot_line_bytes = 0;
+            snapshotter.Capture(screen);
+            line_bytes = snapshot_line_bytes;
+        });
+        report("snapshot_delta_idle", t, line_bytes);
+
+        int box_x = 0;
+        BasicPixelWriter<kPixelBGRResv8BitPerColor> writer {fb.config};
+        t = Measure([&] {
+            writer.FillRect(box_x, res.height - 16, 16, 16, {255, 255, 255});
+            box_x = (box_x + 4) % (res.width - 16);
+            writer.FillRect(box_x, res.height - 16, 16, 16, {0, 0, 255});
+            snapshot_line_bytes = 0;
+            snapshotter.Capture(screen);
+            line_bytes = snapshot_line_bytes;
+        });
+        report("snapshot_delta_box", t, line_bytes);
+        free(previous);
+    }
+
+    /**
+     * メモリ管理のベンチマーク
+     * フレームのアドレスはそのままポインタとして使われるので、
+     * 物理アドレスと同じ値の仮想アドレス (kArenaBase から) に実際のメモリを割り当てておく
+     **/
+    const uintptr_t kArenaBase = 0x40000000;
+    const size_t kArenaBytes = 256 * 1024 * 1024;
+
+    void BenchAllocators() {
+        void* arena = mmap(reinterpret_cast<void*>(kArenaBase),
+            kArenaBytes,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+            -1,
+            0);
+        if (arena != reinterpret_cast<void*>(kArenaBase)) {
+            fprintf(stderr, "failed to map the allocator arena at %#lx\n", kArenaBase);
+            return;
+        }
+
+        auto frames = new BitmapMemoryManager;
+        const size_t first = kArenaBase / kBytesPerFrame;
+        const size_t end = (kArenaBase + kArenaBytes) / kBytesPerFrame;
+        frames->MarkAllocated(FrameID {0}, first);
+        frames->SetMemoryRange(FrameID {1}, FrameID {end});
+
+        // 1フレームの確保と解放
+        double t = Measure([&] {
+            for (int i = 0; i < 1000; ++i) {
+                auto f = frames->AllocateFrames(1);
+                frames->FreeFrames(f.value, 1);
+            }
+        });
+        ReportOps("frames_alloc_free_1", t, 1000);
+
+        // 断片化した状態での複数フレームの確保: 1つおきに確保済みのフレームを読み飛ばす
+        static size_t held[4096];
+        for (auto& h : held) h = frames->AllocateFrames(1).value.ID();
+        for (int i = 0; i < 4096; i += 2) frames->FreeFrames(FrameID {held[i]}, 1);
+        t = Measure([&] {
+            for (int i = 0; i < 100; ++i) {
+                auto f = frames->AllocateFrames(16);
+                frames->FreeFrames(f.value, 16);
+            }
+        });
+        ReportOps("frames_alloc_free_16_fragmented", t, 100);
+        // 断片化の度合い: 空きフレームのうち最長の連続した空きに含まれない割合
+        const auto frame_stats = frames->GetStats();
+        const size_t free_frames = frame_stats.total_frames - frame_stats.allocated_frames;
+        printf("{\"bench\":\"frames_fragmented_stats\",\"kernels\":\"%s\",\"free_frames\":%zu,"
+               "\"largest_free_run\":%zu,\"fragmentation\":%.3f}\n",
+            pixel_kernels.name,
+            free_frames,
+            frame_stats.largest_free_run,
+            1.0 - static_cast<double>(frame_stats.largest_free_run) / free_frames);
+        for (int i = 1; i < 4096; i += 2) frames->FreeFrames(FrameID {held[i]}, 1);
+
+        // ヒープ: 大きさの異なる小さなオブジェクトの確保と解放を繰り返す
+        auto heap = new KernelHeap {*frames};
+        static void* objects[1024];
+        uint32_t seed = 1;
+        t = Measure([&] {
+            for (int i = 0; i < 1024; ++i) {
+                seed = seed * 1103515245 + 12345;
+                objects[i] = heap->Allocate(16 + (seed >> 16) % 1000);
+            }
+            for (int i = 0; i < 1024; ++i) heap->Free(objects[i]);
+        });
+        ReportOps("heap_small", t, 2 * 1024);
+
+        t = Measure([&] {
+            for (int i = 0; i < 64; ++i) objects[i] = heap->Allocate(64 * 1024);
+            for (int i = 0; i < 64; ++i) heap->Free(objects[i]);
+        });
+        ReportOps("heap_large_64k", t, 2 * 64);
+
+        /**
+         * カーネルの確保を真似た合成の列: 大半は数十〜数百バイトのオブジェクト (タスクや描画の記録) で、
+         * 16 回に1回レイヤーのバッファ程度の大きな領域を確保する。寿命は乱数で決める
+         * 列を流し終えた時点の使用中と保持中のバイト数から、ヒープの断片化による無駄を報告する
+         **/
+        static void* live[4096];
+        size_t num_live = 0;
+        size_t ops = 0;
+        KernelHeap::Stats peak {};
+        seed = 1;
+        t = Measure([&] {
+            ops = 0;
+            for (int i = 0; i < 20000; ++i, ++ops) {
+                seed = seed * 1103515245 + 12345;
+                const uint32_t r = seed >> 8;
+                if (num_live < 64 || (num_live < 4096 && r % 8 < 4)) {
+                    const size_t bytes = r % 16 == 0 ? 16 * 1024 + r % (240 * 1024) : 8 + r % 600;
+                    live[num_live++] = heap->Allocate(bytes);
+                } else {
+                    const size_t k = r % num_live;
+                    heap->Free(live[k]);
+                    live[k] = live[--num_live];
+                }
+            }
+            peak = heap->GetStats();
+            while (num_live > 0) heap->Free(live[--num_live]);
+        });
+        ReportOps("heap_trace", t, ops);
+        printf("{\"bench\":\"heap_trace_stats\",\"kernels\":\"%s\",\"bytes_in_use\":%zu,"
+               "\"bytes_reserved\":%zu,\"utilization\":%.3f}\n",
+            pixel_kernels.name,
+            peak.bytes_in_use,
+            peak.bytes_reserved,
+            static_cast<double>(peak.bytes_in_use) / peak.bytes_reserved);
+
+        delete heap;
+        delete frames;
+        munmap(arena, kArenaBytes);
+    }
+}  // namespace
+
+int main() {
+    SelectPixelKernels();
+    // 大きな画面バッファが固定アドレスの領域と重ならないよう、アロケータを先に計測する
+    BenchAllocators();
+    for (const auto& res : kResolutions) {
+        BenchGraphics(res);
+        BenchRaster(res);
+        BenchImage(res);
+        BenchSnapshot(res);
+        BenchCompose(res);
+    }
+    return 0;
+}
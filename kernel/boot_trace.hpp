@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * 起動処理の各段階の所要時間 (TSC のカウント数)
+ * ブートローダが計測した結果をこの形でカーネルへ渡し、カーネルは同じ表に自分の計測結果を追加する
+ * ExitBootServices の後にローダの領域は再利用されるので、名前も構造体の中に持つ
+ **/
+#define kBootTraceMaxSamples 48
+#define kBootTraceNameLength 24
+
+struct BootTraceSample {
+    char name[kBootTraceNameLength];
+    // 最初に計測を始めた時点の TSC の値
+    uint64_t start_tsc;
+    // 計測した区間の合計のカウント数と、計測した回数
+    uint64_t cycles;
+    uint64_t count;
+};
+
+struct BootTrace {
+    // 1マイクロ秒あたりの TSC のカウント数。ブートローダが Stall を使って求める
+    uint64_t tsc_per_us;
+    uint32_t num_samples;
+    struct BootTraceSample samples[kBootTraceMaxSamples];
+};
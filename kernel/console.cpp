@@ -0,0 +1,45 @@
+#include "console.hpp"
+
+#include "font.hpp"
+
+Console::Console(PixelWriter& writer, const PixelColor& fg_color, const PixelColor& bg_color) :
+    writer_ {writer},
+    fg_color_ {fg_color},
+    bg_color_ {bg_color},
+    rows_ {writer.Height() / kFontHeight},
+    columns_ {writer.Width() / kFontWidth},
+    cursor_row_ {0},
+    cursor_column_ {0} {}
+
+void Console::PutString(const char* s) {
+    while (*s) {
+        if (*s == '\n') {
+            Newline();
+        } else {
+            if (cursor_column_ == columns_) {
+                Newline();
+            }
+            WriteAscii(writer_,
+                kFontWidth * cursor_column_,
+                kFontHeight * cursor_row_,
+                *s,
+                fg_color_,
+                bg_color_);
+            ++cursor_column_;
+        }
+        ++s;
+    }
+}
+
+void Console::Newline() {
+    cursor_column_ = 0;
+    if (cursor_row_ < rows_ - 1) {
+        ++cursor_row_;
+        return;
+    }
+
+    // 2行目以降を1行分上へ移動し、空いた最下行を背景色で塗りつぶす
+    const int width = kFontWidth * columns_;
+    writer_.CopyRect(0, 0, 0, kFontHeight, width, kFontHeight * (rows_ - 1));
+    writer_.FillRect(0, kFontHeight * (rows_ - 1), width, kFontHeight, bg_color_);
+}
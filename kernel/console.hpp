@@ -0,0 +1,25 @@
+#pragma once
+
+#include "graphics.hpp"
+
+/**
+ * 画面全体を文字の格子として使うコンソール
+ * 最下行で改行すると、フレームバッファの内容を1行分上へまとめて移動 (CopyRect) し、
+ * 最下行だけを背景色で塗りつぶす。文字を描き直すことはしない。
+ **/
+class Console {
+public:
+    Console(PixelWriter& writer, const PixelColor& fg_color, const PixelColor& bg_color);
+    void PutString(const char* s);
+
+private:
+    void Newline();
+
+    PixelWriter& writer_;
+    const PixelColor fg_color_, bg_color_;
+    const int rows_, columns_;
+    int cursor_row_, cursor_column_;
+};
+
+// 画面のコンソールへ書式付きの文字列を出力する (main.cpp で定義)
+int printk(const char* format, ...) __attribute__((format(printf, 1, 2)));
@@ -0,0 +1,42 @@
+#include "cpu.hpp"
+
+#include <cpuid.h>
+#include "asmfunc.h"
+
+namespace {
+    const uint64_t kCR0MonitorCoprocessor = 1u << 1;
+    const uint64_t kCR0Emulation = 1u << 2;
+    const uint64_t kCR4OSFXSR = 1u << 9;
+    const uint64_t kCR4OSXMMEXCPT = 1u << 10;
+    const uint64_t kCR4OSXSAVE = 1u << 18;
+
+    const uint64_t kXCR0X87 = 1u << 0;
+    const uint64_t kXCR0SSE = 1u << 1;
+    const uint64_t kXCR0AVX = 1u << 2;
+}  // namespace
+
+void EnableSIMDState() {
+    uint64_t cr0 = GetCR0();
+    cr0 &= ~kCR0Emulation;
+    cr0 |= kCR0MonitorCoprocessor;
+    SetCR0(cr0);
+
+    uint64_t cr4 = GetCR4();
+    cr4 |= kCR4OSFXSR | kCR4OSXMMEXCPT;
+
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    const bool xsave = ecx & (1u << 26);
+    const bool avx = ecx & (1u << 28);
+    if (!xsave) {
+        SetCR4(cr4);
+        return;
+    }
+
+    SetCR4(cr4 | kCR4OSXSAVE);
+    uint64_t xcr0 = kXCR0X87 | kXCR0SSE;
+    if (avx) {
+        xcr0 |= kXCR0AVX;
+    }
+    SetXCR0(xcr0);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+/**
+ * SSE / AVX を使うための CPU の状態を設定する
+ * CR0.EM を落として CR0.MP を立て、CR4.OSFXSR / OSXMMEXCPT で SSE 命令と SIMD 例外を有効にする。
+ * XSAVE が使える CPU では CR4.OSXSAVE を立て、XCR0 で x87 / SSE / AVX の状態を有効にする。
+ * UEFI が設定した状態を当てにせず、SIMD 命令を実行するコアごとに1回呼び出す。
+ **/
+void EnableSIMDState();
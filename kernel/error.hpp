@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+
+class Error {
+public:
+    enum Code
+    {
+        kSuccess,
+        kNoEnoughMemory,
+        kIndexOutOfRange,
+        kInvalidParameter,
+        kNotSupported,
+        kInvalidFormat,
+        kFull,
+        kLastOfCode,    // この列挙子は常に最後に配置する
+    };
+
+    Error(Code code, const char* file, int line) : code_ {code}, line_ {line}, file_ {file} {}
+
+    Code Cause() const {
+        return this->code_;
+    }
+
+    operator bool() const {
+        return this->code_ != kSuccess;
+    }
+
+    const char* Name() const {
+        return code_names_[static_cast<int>(this->code_)];
+    }
+
+    const char* File() const {
+        return this->file_;
+    }
+
+    int Line() const {
+        return this->line_;
+    }
+
+private:
+    static constexpr std::array code_names_ {
+        "kSuccess",
+        "kNoEnoughMemory",
+        "kIndexOutOfRange",
+        "kInvalidParameter",
+        "kNotSupported",
+        "kInvalidFormat",
+        "kFull",
+    };
+    static_assert(Error::Code::kLastOfCode == code_names_.size());
+
+    Code code_;
+    int line_;
+    const char* file_;
+};
+
+// エラーが発生したファイルと行番号を記録する
+#define MAKE_ERROR(code) Error((code), __FILE__, __LINE__)
+
+// 値とエラーの組。関数が値を返しつつ失敗を通知するときに使う
+template <class T>
+struct WithError {
+    T value;
+    Error error;
+};
@@ -0,0 +1,123 @@
+#include "font.hpp"
+
+#include <new>
+
+// hankaku.o (hankaku.txt から生成) に埋め込まれたフォントデータ
+extern const uint8_t _binary_hankaku_bin_start;
+extern const uint8_t _binary_hankaku_bin_end;
+extern const uint8_t _binary_hankaku_bin_size;
+
+namespace {
+    const int kNumGlyphs = 256;
+    const int kTilePixels = kFontWidth * kFontHeight;
+    // キャッシュしておく前景色と背景色の組の数
+    const int kCacheSlots = 4;
+
+    /**
+     * 前景色と背景色の組1つ分のタイル
+     * 全ての文字を一度に展開するのではなく、初めて使われたときに展開する
+     **/
+    struct GlyphCacheSlot {
+        uint32_t fg, bg;
+        // 最後に使った時刻。置き換えるスロットを選ぶのに使う
+        uint64_t last_used;
+        // 展開済みの文字のビットマップ
+        uint64_t expanded[kNumGlyphs / 64];
+        // kNumGlyphs 個のタイル
+        uint32_t* tiles;
+    };
+
+    GlyphCacheSlot cache_slots[kCacheSlots];
+    uint64_t cache_clock;
+
+    void ExpandGlyph(uint32_t* tile, char c, uint32_t fg, uint32_t bg) {
+        const uint8_t* font = GetFont(c);
+        for (int dy = 0; dy < kFontHeight; ++dy) {
+            const uint8_t bits = font ? font[dy] : 0;
+            for (int dx = 0; dx < kFontWidth; ++dx) {
+                tile[dy * kFontWidth + dx] = ((bits << dx) & 0x80u) ? fg : bg;
+            }
+        }
+    }
+
+    // 色の組に対応するスロットを探す。無ければ最も長く使われていないスロットを置き換える
+    GlyphCacheSlot* FindSlot(uint32_t fg, uint32_t bg) {
+        GlyphCacheSlot* victim = &cache_slots[0];
+        for (auto& slot : cache_slots) {
+            if (slot.tiles && slot.fg == fg && slot.bg == bg) {
+                slot.last_used = ++cache_clock;
+                return &slot;
+            }
+            if (slot.last_used < victim->last_used) {
+                victim = &slot;
+            }
+        }
+
+        if (victim->tiles == nullptr) {
+            victim->tiles = new (std::nothrow) uint32_t[kNumGlyphs * kTilePixels];
+            if (victim->tiles == nullptr) return nullptr;
+        }
+        victim->fg = fg;
+        victim->bg = bg;
+        victim->last_used = ++cache_clock;
+        for (auto& bits : victim->expanded) {
+            bits = 0;
+        }
+        return victim;
+    }
+
+    void DrawGlyph(PixelWriter& writer,
+        GlyphCacheSlot* slot,
+        int x,
+        int y,
+        char c,
+        uint32_t fg_value,
+        uint32_t bg_value) {
+        if (slot == nullptr) {
+            // キャッシュ用の領域を確保できなければ、その場で展開して描画する
+            uint32_t tile[kTilePixels];
+            ExpandGlyph(tile, c, fg_value, bg_value);
+            writer.BlitNative(x, y, tile, kFontWidth, kFontHeight, kFontWidth);
+            return;
+        }
+
+        const auto code = static_cast<uint8_t>(c);
+        uint32_t* tile = slot->tiles + code * kTilePixels;
+        const uint64_t bit = uint64_t {1} << (code % 64);
+        if ((slot->expanded[code / 64] & bit) == 0) {
+            ExpandGlyph(tile, c, fg_value, bg_value);
+            slot->expanded[code / 64] |= bit;
+        }
+        writer.BlitNative(x, y, tile, kFontWidth, kFontHeight, kFontWidth);
+    }
+}  // namespace
+
+const uint8_t* GetFont(char c) {
+    auto index = kFontHeight * static_cast<unsigned int>(static_cast<uint8_t>(c));
+    if (index >= reinterpret_cast<uintptr_t>(&_binary_hankaku_bin_size)) {
+        return nullptr;
+    }
+    return &_binary_hankaku_bin_start + index;
+}
+
+void WriteAscii(
+    PixelWriter& writer, int x, int y, char c, const PixelColor& fg, const PixelColor& bg) {
+    const uint32_t fg_value = writer.EncodeColor(fg);
+    const uint32_t bg_value = writer.EncodeColor(bg);
+    DrawGlyph(writer, FindSlot(fg_value, bg_value), x, y, c, fg_value, bg_value);
+}
+
+void WriteString(PixelWriter& writer,
+    int x,
+    int y,
+    const char* s,
+    const PixelColor& fg,
+    const PixelColor& bg) {
+    // 色の変換とスロットの検索は文字列全体で1回だけ行う
+    const uint32_t fg_value = writer.EncodeColor(fg);
+    const uint32_t bg_value = writer.EncodeColor(bg);
+    GlyphCacheSlot* slot = FindSlot(fg_value, bg_value);
+    for (int i = 0; s[i] != '\0'; ++i) {
+        DrawGlyph(writer, slot, x + kFontWidth * i, y, s[i], fg_value, bg_value);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include "graphics.hpp"
+
+const int kFontWidth = 8;
+const int kFontHeight = 16;
+
+// 文字 c のビットマップ (1行1バイト、kFontHeight 行) を返す
+const uint8_t* GetFont(char c);
+
+/**
+ * 文字 c を前景色 fg、背景色 bg の 8x16 のタイルとして (x, y) に描画する
+ * 文字のビットマップはピクセル形式に変換済みのタイルとしてキャッシュしておき、
+ * 描画はタイルを行単位でコピーするだけにする
+ **/
+void WriteAscii(
+    PixelWriter& writer, int x, int y, char c, const PixelColor& fg, const PixelColor& bg);
+void WriteString(PixelWriter& writer,
+    int x,
+    int y,
+    const char* s,
+    const PixelColor& fg,
+    const PixelColor& bg);
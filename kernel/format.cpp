@@ -0,0 +1,164 @@
+#include "format.hpp"
+
+#include <cstdint>
+
+namespace {
+    // 出力先の大きさを超えた分は数えるだけにする書き出し先
+    class Output {
+    public:
+        Output(char* buf, size_t size) : buf_ {buf}, size_ {size}, len_ {0} {}
+
+        void Put(char c) {
+            if (len_ + 1 < size_) buf_[len_] = c;
+            ++len_;
+        }
+
+        void Fill(char c, int n) {
+            for (int i = 0; i < n; ++i) Put(c);
+        }
+
+        int Finish() {
+            if (size_ > 0) buf_[len_ < size_ ? len_ : size_ - 1] = '\0';
+            return static_cast<int>(len_);
+        }
+
+    private:
+        char* buf_;
+        size_t size_;
+        size_t len_;
+    };
+
+    struct Spec {
+        bool left_align;
+        bool zero_pad;
+        int width;
+    };
+
+    void PutPadded(Output& out, const Spec& spec, const char* s, int len, const char* prefix) {
+        int prefix_len = 0;
+        while (prefix[prefix_len]) ++prefix_len;
+        const int pad = spec.width > len + prefix_len ? spec.width - len - prefix_len : 0;
+
+        if (!spec.left_align && !spec.zero_pad) out.Fill(' ', pad);
+        for (int i = 0; i < prefix_len; ++i) out.Put(prefix[i]);
+        if (!spec.left_align && spec.zero_pad) out.Fill('0', pad);
+        for (int i = 0; i < len; ++i) out.Put(s[i]);
+        if (spec.left_align) out.Fill(' ', pad);
+    }
+
+    void PutNumber(Output& out,
+        const Spec& spec,
+        unsigned long long value,
+        bool negative,
+        unsigned int base,
+        bool upper,
+        const char* prefix) {
+        const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        char tmp[24];
+        int len = 0;
+        do {
+            tmp[len++] = digits[value % base];
+            value /= base;
+        } while (value);
+
+        char s[24];
+        for (int i = 0; i < len; ++i) s[i] = tmp[len - 1 - i];
+        PutPadded(out, spec, s, len, negative ? "-" : prefix);
+    }
+}  // namespace
+
+int VSNPrintf(char* buf, size_t size, const char* format, va_list ap) {
+    Output out {buf, size};
+
+    for (const char* p = format; *p; ++p) {
+        if (*p != '%') {
+            out.Put(*p);
+            continue;
+        }
+        ++p;
+
+        Spec spec {false, false, 0};
+        for (;; ++p) {
+            if (*p == '-') {
+                spec.left_align = true;
+            } else if (*p == '0') {
+                spec.zero_pad = true;
+            } else {
+                break;
+            }
+        }
+        while ('0' <= *p && *p <= '9') {
+            spec.width = spec.width * 10 + (*p - '0');
+            ++p;
+        }
+
+        int longs = 0;
+        for (;; ++p) {
+            if (*p == 'l') {
+                ++longs;
+            } else if (*p == 'z') {
+                longs = 2;
+            } else {
+                break;
+            }
+        }
+
+        switch (*p) {
+            case 'd':
+            case 'i': {
+                long long v = longs >= 2 ? va_arg(ap, long long)
+                    : longs == 1         ? va_arg(ap, long)
+                                         : va_arg(ap, int);
+                const bool negative = v < 0;
+                const unsigned long long magnitude
+                    = negative ? 0ull - static_cast<unsigned long long>(v) : v;
+                PutNumber(out, spec, magnitude, negative, 10, false, "");
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                unsigned long long v = longs >= 2 ? va_arg(ap, unsigned long long)
+                    : longs == 1                  ? va_arg(ap, unsigned long)
+                                                  : va_arg(ap, unsigned int);
+                PutNumber(out, spec, v, false, *p == 'u' ? 10 : 16, *p == 'X', "");
+                break;
+            }
+            case 'p': {
+                auto v = reinterpret_cast<uintptr_t>(va_arg(ap, void*));
+                PutNumber(out, spec, v, false, 16, false, "0x");
+                break;
+            }
+            case 's': {
+                const char* s = va_arg(ap, const char*);
+                if (s == nullptr) s = "(null)";
+                int len = 0;
+                while (s[len]) ++len;
+                spec.zero_pad = false;
+                PutPadded(out, spec, s, len, "");
+                break;
+            }
+            case 'c': {
+                const char c = static_cast<char>(va_arg(ap, int));
+                spec.zero_pad = false;
+                PutPadded(out, spec, &c, 1, "");
+                break;
+            }
+            case '%': out.Put('%'); break;
+            case '\0': return out.Finish();
+            default:
+                out.Put('%');
+                out.Put(*p);
+                break;
+        }
+    }
+    return out.Finish();
+}
+
+int SNPrintf(char* buf, size_t size, const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    const int result = VSNPrintf(buf, size, format, ap);
+    va_end(ap);
+    return result;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+
+/**
+ * printf 形式の文字列を buf に書き出す (最大 size - 1 文字と終端の '\0')
+ * 対応する変換指定: %d %i %u %x %X %p %s %c %%
+ * フラグ '-' '0'、最小幅、長さ修飾子 l ll z に対応する
+ * 戻り値は buf が十分に大きかった場合に書き出される文字数
+ **/
+int VSNPrintf(char* buf, size_t size, const char* format, va_list ap);
+int SNPrintf(char* buf, size_t size, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
@@ -6,6 +6,19 @@ enum PixelFormat
 {
     kPixelRGBResv8BitPerColor,
     kPixelBGRResv8BitPerColor,
+    // 各色の位置を PixelBitMask で表す形式 (RGB565 や 10 ビット色など)
+    kPixelBitMask,
+};
+
+/*
+ * 1ピクセルの中で各色が占めるビット (GOP の EFI_PIXEL_BITMASK と同じ並び)
+ * kPixelBitMask 以外の形式でも、ローダがその形式に相当するマスクを設定する
+ */
+struct PixelBitMask {
+    uint32_t red_mask;
+    uint32_t green_mask;
+    uint32_t blue_mask;
+    uint32_t reserved_mask;
 };
 
 struct FrameBufferConfig {
@@ -19,4 +32,12 @@ struct FrameBufferConfig {
     uint32_t vertical_resolution;
     // ピクセルのデータ形式
     enum PixelFormat pixel_format;
+    /*
+     * フレームバッファ全体のバイト数
+     * 表示されている1画面分 (1ピクセルのバイト数 * pixels_per_scan_line * vertical_resolution)
+     * より大きければ、その後ろの領域を画面外のバッファとして使える
+     */
+    uint64_t frame_buffer_size;
+    // 各色のビット位置。1ピクセルのバイト数はマスクの最上位のビットから決まる
+    struct PixelBitMask pixel_bitmask;
 };
\ No newline at end of file
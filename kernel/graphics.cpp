@@ -0,0 +1,68 @@
+#include "graphics.hpp"
+
+#include <cstring>
+
+void PixelWriter::DrawHLine(int x0, int x1, int y, const PixelColor& c) {
+    if (x0 > x1) {
+        int tmp = x0;
+        x0 = x1;
+        x1 = tmp;
+    }
+    FillSpan(x0, y, x1 - x0 + 1, c);
+}
+
+void PixelWriter::CopyRect(int dst_x, int dst_y, int src_x, int src_y, int width, int height) {
+    // コピー元とコピー先の両方が画面内に収まるように、同じ量だけ切り詰める
+    int sx = src_x, sy = src_y, w = width, h = height;
+    if (!ClipRect(sx, sy, w, h, Width(), Height())) return;
+    int dx = dst_x + (sx - src_x), dy = dst_y + (sy - src_y);
+    int cx = dx, cy = dy;
+    if (!ClipRect(cx, cy, w, h, Width(), Height())) return;
+    sx += cx - dx;
+    sy += cy - dy;
+    if (Tracker()) Tracker()->MarkDirty({cx, cy, w, h});
+
+    // 行の全幅をコピーする場合 (縦方向のスクロール) は、連続した1つの領域として memmove する
+    if (cx == 0 && sx == 0 && static_cast<uint32_t>(w) == config_.pixels_per_scan_line) {
+        memmove(PixelAt(0, cy), PixelAt(0, sy), 4 * static_cast<size_t>(w) * h);
+        return;
+    }
+
+    // 同じ行の中で重なる場合 (横方向のスクロール) だけは memmove で処理する
+    if (cy == sy && cx < sx + w && sx < cx + w) {
+        for (int i = 0; i < h; ++i) {
+            memmove(PixelAt(cx, cy + i), PixelAt(sx, sy + i), 4 * w);
+        }
+        return;
+    }
+
+    if (cy <= sy) {
+        // 上方向へのコピーは上の行から順に処理する
+        for (int i = 0; i < h; ++i) {
+            CopyPixels32(Pixel32At(cx, cy + i), Pixel32At(sx, sy + i), w);
+        }
+    } else {
+        // 下方向へのコピーは、未コピーの行を上書きしないように下の行から処理する
+        for (int i = h - 1; i >= 0; --i) {
+            CopyPixels32(Pixel32At(cx, cy + i), Pixel32At(sx, sy + i), w);
+        }
+    }
+}
+
+void PixelWriter::BlitNative(
+    int x, int y, const uint32_t* src, int width, int height, int src_stride) {
+    int cx = x, cy = y;
+    if (!ClipRect(cx, cy, width, height, Width(), Height())) return;
+    if (Tracker()) Tracker()->MarkDirty({cx, cy, width, height});
+    src += (cy - y) * src_stride + (cx - x);
+
+    const uint32_t stride = config_.pixels_per_scan_line;
+    uint32_t* row = Pixel32At(cx, cy);
+    for (int dy = 0; dy < height; ++dy) {
+        for (int dx = 0; dx < width; ++dx) {
+            row[dx] = src[dx];
+        }
+        row += stride;
+        src += src_stride;
+    }
+}
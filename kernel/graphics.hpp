@@ -0,0 +1,286 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "frame_buffer_config.hpp"
+#include "simd.hpp"
+
+struct PixelColor {
+    uint8_t r, g, b;
+    // 不透明度。ピクセルごとの不透明度を持つレイヤーだけが使い、フレームバッファへの描画では無視する
+    uint8_t a = 255;
+};
+
+struct Rectangle {
+    int x, y, width, height;
+};
+
+struct Point {
+    int x, y;
+};
+
+/**
+ * 描画された領域の通知を受け取るインターフェース
+ * 描画関数はクリップ後の領域を1回の描画につき1回だけ通知する
+ **/
+class DamageTracker {
+public:
+    virtual ~DamageTracker() = default;
+    virtual void MarkDirty(const Rectangle& area) = 0;
+};
+
+/**
+ * ピクセル形式ごとの変換規則
+ * PixelFormat の値ごとに特殊化し、PixelColor をフレームバッファに書き込む32ビット値へ変換する
+ * リトルエンディアンなので、メモリ上のバイト順が下位バイトから並ぶ
+ **/
+template <PixelFormat F>
+struct PixelTraits;
+
+template <>
+struct PixelTraits<kPixelRGBResv8BitPerColor> {
+    // バイト順 R, G, B, Reserved
+    static uint32_t Encode(const PixelColor& c) {
+        return c.r | (c.g << 8) | (c.b << 16);
+    }
+};
+
+template <>
+struct PixelTraits<kPixelBGRResv8BitPerColor> {
+    // バイト順 B, G, R, Reserved
+    static uint32_t Encode(const PixelColor& c) {
+        return c.b | (c.g << 8) | (c.r << 16);
+    }
+};
+
+/**
+ * 矩形を screen_width x screen_height の画面に収まるように切り詰める
+ * 描画すべき領域が残らなければ false を返す
+ **/
+inline bool ClipRect(int& x, int& y, int& width, int& height, int screen_width, int screen_height) {
+    if (x < 0) {
+        width += x;
+        x = 0;
+    }
+    if (y < 0) {
+        height += y;
+        y = 0;
+    }
+    if (x + width > screen_width) width = screen_width - x;
+    if (y + height > screen_height) height = screen_height - y;
+    return width > 0 && height > 0;
+}
+
+/**
+ * ピクセル形式をテンプレート引数で固定した描画クラス
+ * 仮想関数を持たず、全ての描画関数がインライン展開できるため、
+ * 内側のループは色変換を含めてコンパイラが自動ベクトル化できる。
+ * 形式の切り替えは DispatchPixelFormat で描画処理のまとまりの先頭で1回だけ行う。
+ **/
+template <PixelFormat F>
+class BasicPixelWriter {
+public:
+    using Traits = PixelTraits<F>;
+    // この幅以上の行は SIMD カーネルで処理する。短い行では呼び出しと境界合わせの方が高くつく
+    static const int kMinSIMDPixels = 16;
+
+    explicit BasicPixelWriter(const FrameBufferConfig& config, DamageTracker* tracker = nullptr) :
+        config_ {config}, tracker_ {tracker} {}
+
+    static uint32_t Encode(const PixelColor& c) {
+        return Traits::Encode(c);
+    }
+
+    void Write(int x, int y, const PixelColor& c) {
+        if (x < 0 || y < 0 || x >= Width() || y >= Height()) return;
+        *PixelAt(x, y) = Encode(c);
+        MarkDirty(x, y, 1, 1);
+    }
+
+    void FillRect(int x, int y, int width, int height, const PixelColor& c) {
+        if (!ClipRect(x, y, width, height, Width(), Height())) return;
+        MarkDirty(x, y, width, height);
+
+        // ループ内で config_ を読み直さないよう、ストア先と別名にならないローカル変数へ取り出す
+        const uint32_t value = Encode(c);
+        const uint32_t stride = config_.pixels_per_scan_line;
+        uint32_t* row = PixelAt(x, y);
+        if (width >= kMinSIMDPixels) {
+            // 十分に長い行は非テンポラルストアの SIMD カーネルで書き込む
+            for (int dy = 0; dy < height; ++dy) {
+                FillPixels32(row, width, value);
+                row += stride;
+            }
+            return;
+        }
+        for (int dy = 0; dy < height; ++dy) {
+            for (int dx = 0; dx < width; ++dx) {
+                row[dx] = value;
+            }
+            row += stride;
+        }
+    }
+
+    void FillSpan(int x, int y, int width, const PixelColor& c) {
+        FillRect(x, y, width, 1, c);
+    }
+
+    void BlitBuffer(int x, int y, const PixelColor* src, int width, int height, int src_stride) {
+        int cx = x, cy = y;
+        if (!ClipRect(cx, cy, width, height, Width(), Height())) return;
+        MarkDirty(cx, cy, width, height);
+        src += (cy - y) * src_stride + (cx - x);
+
+        const uint32_t stride = config_.pixels_per_scan_line;
+        uint32_t* row = PixelAt(cx, cy);
+        for (int dy = 0; dy < height; ++dy) {
+            for (int dx = 0; dx < width; ++dx) {
+                row[dx] = Encode(src[dx]);
+            }
+            row += stride;
+            src += src_stride;
+        }
+    }
+
+    int Width() const {
+        return config_.horizontal_resolution;
+    }
+    int Height() const {
+        return config_.vertical_resolution;
+    }
+
+    uint32_t* PixelAt(int x, int y) {
+        return reinterpret_cast<uint32_t*>(config_.frame_buffer)
+            + config_.pixels_per_scan_line * y + x;
+    }
+
+private:
+    void MarkDirty(int x, int y, int width, int height) {
+        if (tracker_) tracker_->MarkDirty({x, y, width, height});
+    }
+
+    const FrameBufferConfig& config_;
+    DamageTracker* tracker_;
+};
+
+/**
+ * config のピクセル形式に対応する BasicPixelWriter を生成し、func に渡して呼び出す
+ * 形式による分岐は呼び出しごとに1回だけ行われ、func の中の描画処理は形式ごとに実体化される
+ * tracker を指定すると、描画した領域が通知される
+ * kPixelBitMask の形式には直接描画せず、影のバッファ (BGR) に描いてから変換して転送する
+ * 例: DispatchPixelFormat(config, [&](auto& writer) { writer.FillRect(...); });
+ **/
+template <typename Func>
+void DispatchPixelFormat(
+    const FrameBufferConfig& config, Func&& func, DamageTracker* tracker = nullptr) {
+    switch (config.pixel_format) {
+        case kPixelRGBResv8BitPerColor: {
+            BasicPixelWriter<kPixelRGBResv8BitPerColor> writer {config, tracker};
+            func(writer);
+            break;
+        }
+        case kPixelBGRResv8BitPerColor: {
+            BasicPixelWriter<kPixelBGRResv8BitPerColor> writer {config, tracker};
+            func(writer);
+            break;
+        }
+        case kPixelBitMask: break;
+    }
+}
+
+class PixelWriter {
+public:
+    PixelWriter(const FrameBufferConfig& config, DamageTracker* tracker = nullptr) :
+        config_ {config}, tracker_ {tracker} {}
+    virtual ~PixelWriter() = default;
+    /**
+     * ピクセルを描画する関数
+     * =0 は純粋仮想関数でインターフェースを表現している
+     **/
+    virtual void Write(int x, int y, const PixelColor& c) = 0;
+
+    /**
+     * 一括描画関数
+     * Write を1ピクセルずつ呼ぶと、仮想関数呼び出しと PixelAt の乗算がピクセル毎に発生する。
+     * 一括描画関数は色の変換を1回だけ行い、行単位(row-major)に32ビットずつ書き込む。
+     * 描画範囲は画面の範囲にクリップされる。
+     **/
+    // (x, y) から横方向に width ピクセルを塗りつぶす
+    virtual void FillSpan(int x, int y, int width, const PixelColor& c) = 0;
+    // (x, y) を左上とする width x height の矩形を塗りつぶす
+    virtual void FillRect(int x, int y, int width, int height, const PixelColor& c) = 0;
+    // src_stride (ピクセル数) 間隔で並んだ width x height の画像を (x, y) へ転送する
+    virtual void BlitBuffer(
+        int x, int y, const PixelColor* src, int width, int height, int src_stride)
+        = 0;
+
+    // PixelColor をこのフレームバッファの形式の32ビット値に変換する
+    virtual uint32_t EncodeColor(const PixelColor& c) const = 0;
+
+    // x0 から x1 まで(両端を含む)の水平線を描画する
+    void DrawHLine(int x0, int x1, int y, const PixelColor& c);
+    // フレームバッファ内の矩形をコピーする。領域が重なっていても良い
+    void CopyRect(int dst_x, int dst_y, int src_x, int src_y, int width, int height);
+    // EncodeColor で変換済みの画像 (src_stride ピクセル間隔) を (x, y) へ転送する
+    void BlitNative(int x, int y, const uint32_t* src, int width, int height, int src_stride);
+
+    int Width() const {
+        return config_.horizontal_resolution;
+    }
+    int Height() const {
+        return config_.vertical_resolution;
+    }
+
+protected:
+    uint8_t* PixelAt(int x, int y) {
+        return config_.frame_buffer + 4 * (config_.pixels_per_scan_line * y + x);
+    }
+    uint32_t* Pixel32At(int x, int y) {
+        return reinterpret_cast<uint32_t*>(PixelAt(x, y));
+    }
+    DamageTracker* Tracker() const {
+        return tracker_;
+    }
+
+private:
+    const FrameBufferConfig& config_;
+    DamageTracker* tracker_;
+};
+
+/**
+ * BasicPixelWriter を PixelWriter の仮想関数インターフェースに適合させるクラス
+ * ピクセル形式を気にしない呼び出し元のための薄いアダプタで、
+ * 仮想関数呼び出しは描画関数1回につき1回だけ発生する
+ **/
+template <PixelFormat F>
+class PixelWriterAdapter : public PixelWriter {
+public:
+    PixelWriterAdapter(const FrameBufferConfig& config, DamageTracker* tracker = nullptr) :
+        PixelWriter {config, tracker}, writer_ {config, tracker} {}
+    virtual void Write(int x, int y, const PixelColor& c) override {
+        writer_.Write(x, y, c);
+    }
+    virtual void FillSpan(int x, int y, int width, const PixelColor& c) override {
+        writer_.FillSpan(x, y, width, c);
+    }
+    virtual void FillRect(int x, int y, int width, int height, const PixelColor& c) override {
+        writer_.FillRect(x, y, width, height, c);
+    }
+    virtual void BlitBuffer(int x,
+        int y,
+        const PixelColor* src,
+        int width,
+        int height,
+        int src_stride) override {
+        writer_.BlitBuffer(x, y, src, width, height, src_stride);
+    }
+    virtual uint32_t EncodeColor(const PixelColor& c) const override {
+        return BasicPixelWriter<F>::Encode(c);
+    }
+
+private:
+    BasicPixelWriter<F> writer_;
+};
+
+using RGBResv8BitPerColorPixelWriter = PixelWriterAdapter<kPixelRGBResv8BitPerColor>;
+using BGRResv8BitPerColorPixelWriter = PixelWriterAdapter<kPixelBGRResv8BitPerColor>;
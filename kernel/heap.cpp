@@ -0,0 +1,259 @@
+#include "heap.hpp"
+
+#include <new>
+
+namespace {
+    alignas(KernelHeap) char kernel_heap_buf[sizeof(KernelHeap)];
+
+    size_t FrameOf(const void* p) {
+        return reinterpret_cast<uintptr_t>(p) / kBytesPerFrame;
+    }
+
+    uintptr_t FrameBase(size_t frame) {
+        return frame * kBytesPerFrame;
+    }
+}  // namespace
+
+KernelHeap* kernel_heap;
+
+KernelHeap::KernelHeap(BitmapMemoryManager& frames) :
+    frames_ {frames},
+    classes_ {},
+    info_leaves_ {},
+    info_frames_ {0},
+    large_allocations_ {0},
+    large_frees_ {0},
+    large_frames_in_use_ {0},
+    large_bytes_in_use_ {0},
+    boot_arena_begin_ {0},
+    boot_arena_cur_ {0},
+    boot_arena_end_ {0} {
+    for (int i = 0; i < kNumSizeClasses; ++i) {
+        classes_[i].stats.object_bytes = kMinObjectBytes << i;
+    }
+
+    const size_t arena_frames = kBootArenaBytes / kBytesPerFrame;
+    const auto arena = frames_.AllocateFrames(arena_frames);
+    if (!arena.error) {
+        boot_arena_begin_ = reinterpret_cast<uintptr_t>(arena.value.Frame());
+        boot_arena_cur_ = boot_arena_begin_;
+        boot_arena_end_ = boot_arena_begin_ + kBootArenaBytes;
+    }
+}
+
+void* KernelHeap::Allocate(size_t bytes) {
+    const int size_class = SizeClassOf(bytes);
+    if (size_class < 0) {
+        return AllocateLarge(bytes);
+    }
+    return AllocateSmall(size_class);
+}
+
+void KernelHeap::Free(void* p) {
+    if (p == nullptr) return;
+    const auto addr = reinterpret_cast<uintptr_t>(p);
+    if (boot_arena_begin_ <= addr && addr < boot_arena_end_) return;
+
+    const size_t frame = FrameOf(p);
+    FrameInfo* info = FindInfo(frame);
+    if (info == nullptr) return;
+    if (info->kind == FrameKind::kSlab) {
+        FreeSmall(frame, info, p);
+    } else if (info->kind == FrameKind::kLarge && addr == FrameBase(frame)) {
+        FreeLarge(frame, info);
+    }
+}
+
+void* KernelHeap::AllocateBoot(size_t bytes, size_t align) {
+    const uintptr_t p = (boot_arena_cur_ + align - 1) & ~(align - 1);
+    if (boot_arena_begin_ == 0 || p + bytes > boot_arena_end_) {
+        // 専用領域を使い切ったら通常のヒープから確保する (解放されないだけで動作は同じ)
+        return Allocate(bytes);
+    }
+    boot_arena_cur_ = p + bytes;
+    return reinterpret_cast<void*>(p);
+}
+
+KernelHeap::Stats KernelHeap::GetStats() const {
+    Stats stats {};
+    for (int i = 0; i < kNumSizeClasses; ++i) {
+        const ClassStats& cs = classes_[i].stats;
+        stats.classes[i] = cs;
+        stats.bytes_in_use += cs.objects_in_use * cs.object_bytes;
+        stats.bytes_reserved += cs.slabs * kBytesPerFrame;
+    }
+    stats.large_allocations = large_allocations_;
+    stats.large_frees = large_frees_;
+    stats.large_frames_in_use = large_frames_in_use_;
+    stats.bytes_in_use += large_bytes_in_use_;
+    stats.bytes_reserved += (large_frames_in_use_ + info_frames_) * kBytesPerFrame;
+    stats.info_frames = info_frames_;
+    stats.boot_arena_used = boot_arena_cur_ - boot_arena_begin_;
+    stats.boot_arena_capacity = boot_arena_end_ - boot_arena_begin_;
+    return stats;
+}
+
+int KernelHeap::SizeClassOf(size_t bytes) {
+    if (bytes > kMaxSlabObjectBytes) return -1;
+    int size_class = 0;
+    size_t class_bytes = kMinObjectBytes;
+    while (class_bytes < bytes) {
+        class_bytes <<= 1;
+        ++size_class;
+    }
+    return size_class;
+}
+
+KernelHeap::FrameInfo* KernelHeap::FindInfo(size_t frame) const {
+    if (frame >= BitmapMemoryManager::kFrameCount) return nullptr;
+    FrameInfo* leaf = info_leaves_[frame / kInfoPerLeaf];
+    return leaf ? &leaf[frame % kInfoPerLeaf] : nullptr;
+}
+
+KernelHeap::FrameInfo* KernelHeap::GetInfo(size_t frame) {
+    if (frame >= BitmapMemoryManager::kFrameCount) return nullptr;
+    FrameInfo*& leaf = info_leaves_[frame / kInfoPerLeaf];
+    if (leaf == nullptr) {
+        const auto leaf_frame = frames_.AllocateFrames(1);
+        if (leaf_frame.error) return nullptr;
+        leaf = reinterpret_cast<FrameInfo*>(leaf_frame.value.Frame());
+        for (size_t i = 0; i < kInfoPerLeaf; ++i) {
+            leaf[i] = FrameInfo {};
+        }
+        ++info_frames_;
+    }
+    return &leaf[frame % kInfoPerLeaf];
+}
+
+void* KernelHeap::AllocateSmall(int size_class) {
+    SizeClass& sc = classes_[size_class];
+    const size_t object_bytes = sc.stats.object_bytes;
+
+    size_t frame = sc.partial;
+    FrameInfo* slab;
+    if (frame == 0) {
+        const auto new_frame = frames_.AllocateFrames(1);
+        if (new_frame.error) return nullptr;
+        frame = new_frame.value.ID();
+        slab = GetInfo(frame);
+        if (slab == nullptr) {
+            frames_.FreeFrames(new_frame.value, 1);
+            return nullptr;
+        }
+        slab->kind = FrameKind::kSlab;
+        slab->size_class = size_class;
+        slab->objects_in_use = 0;
+        slab->free_list = nullptr;
+        slab->prev = slab->next = 0;
+        slab->unused = 0;
+        PushFront(sc, frame, slab);
+        ++sc.stats.slabs;
+    } else {
+        slab = FindInfo(frame);
+    }
+
+    void* p;
+    if (slab->free_list) {
+        p = slab->free_list;
+        slab->free_list = slab->free_list->next;
+    } else {
+        p = reinterpret_cast<void*>(FrameBase(frame) + slab->unused);
+        slab->unused += object_bytes;
+    }
+    ++slab->objects_in_use;
+
+    // 使い切ったスラブは空きのあるスラブのリストから外す
+    if (slab->free_list == nullptr && slab->unused + object_bytes > kBytesPerFrame) {
+        Unlink(sc, slab);
+    }
+
+    ++sc.stats.allocations;
+    ++sc.stats.objects_in_use;
+    return p;
+}
+
+void KernelHeap::FreeSmall(size_t frame, FrameInfo* slab, void* p) {
+    SizeClass& sc = classes_[slab->size_class];
+    const size_t object_bytes = sc.stats.object_bytes;
+    const bool was_full
+        = slab->free_list == nullptr && slab->unused + object_bytes > kBytesPerFrame;
+
+    auto obj = reinterpret_cast<FreeObject*>(p);
+    obj->next = slab->free_list;
+    slab->free_list = obj;
+    --slab->objects_in_use;
+    ++sc.stats.frees;
+    --sc.stats.objects_in_use;
+
+    if (was_full) {
+        PushFront(sc, frame, slab);
+    }
+
+    /**
+     * 空になったスラブは、他にも空きのあるスラブがあればフレームを返却する
+     * 最後の1つは残しておき、確保と解放を繰り返すときにフレームの確保が往復しないようにする
+     **/
+    if (slab->objects_in_use == 0 && (slab->prev || slab->next)) {
+        Unlink(sc, slab);
+        slab->kind = FrameKind::kUnused;
+        frames_.FreeFrames(FrameID {frame}, 1);
+        --sc.stats.slabs;
+    }
+}
+
+void* KernelHeap::AllocateLarge(size_t bytes) {
+    const size_t num_frames = (bytes + kBytesPerFrame - 1) / kBytesPerFrame;
+    if (num_frames > UINT32_MAX) return nullptr;
+    const auto frame = frames_.AllocateFrames(num_frames);
+    if (frame.error) return nullptr;
+
+    FrameInfo* info = GetInfo(frame.value.ID());
+    if (info == nullptr) {
+        frames_.FreeFrames(frame.value, num_frames);
+        return nullptr;
+    }
+    info->kind = FrameKind::kLarge;
+    info->num_frames = num_frames;
+    ++large_allocations_;
+    large_frames_in_use_ += num_frames;
+    large_bytes_in_use_ += num_frames * kBytesPerFrame;
+    return frame.value.Frame();
+}
+
+void KernelHeap::FreeLarge(size_t frame, FrameInfo* info) {
+    const size_t num_frames = info->num_frames;
+    info->kind = FrameKind::kUnused;
+    frames_.FreeFrames(FrameID {frame}, num_frames);
+    ++large_frees_;
+    large_frames_in_use_ -= num_frames;
+    large_bytes_in_use_ -= num_frames * kBytesPerFrame;
+}
+
+void KernelHeap::Unlink(SizeClass& sc, FrameInfo* slab) {
+    if (slab->prev) {
+        FindInfo(slab->prev)->next = slab->next;
+    } else {
+        sc.partial = slab->next;
+    }
+    if (slab->next) {
+        FindInfo(slab->next)->prev = slab->prev;
+    }
+    slab->prev = slab->next = 0;
+}
+
+void KernelHeap::PushFront(SizeClass& sc, size_t frame, FrameInfo* slab) {
+    slab->prev = 0;
+    slab->next = sc.partial;
+    if (sc.partial) {
+        FindInfo(sc.partial)->prev = frame;
+    }
+    sc.partial = frame;
+}
+
+Error InitializeHeap(BitmapMemoryManager& frames) {
+    kernel_heap = new (kernel_heap_buf) KernelHeap {frames};
+    if (kernel_heap->GetStats().boot_arena_capacity == 0) {
+        return MAKE_ERROR(Error::kNoEnoughMemory);
+    }
+    return MAKE_ERROR(Error::kSuccess);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "error.hpp"
+#include "memory_manager.hpp"
+
+/**
+ * カーネルのヒープ
+ * 物理フレームの上に、大きさに応じた3種類の確保方法を用意する。
+ *
+ * - 小さなオブジェクト (kMaxSlabObjectBytes バイト以下):
+ *   16 バイトから 2 倍ずつのサイズクラスに切り上げ、クラスごとのスラブから確保する。
+ *   スラブは1フレーム (4KiB) で、フレーム全体をオブジェクトに使う。
+ *   オブジェクトは自身の大きさの境界に揃う。
+ * - 大きなオブジェクト: 必要な数のフレームを直接確保する。フレーム境界に揃う。
+ * - 起動時に確保して解放しないオブジェクト: AllocateBoot で専用領域から前詰めで確保する。
+ *
+ * スラブや大きなオブジェクトの管理情報はフレームの中には置かず、
+ * フレーム番号で引く2段の表 (FrameInfo) に置く。
+ * Free はポインタのフレーム番号から表を引いて種類と大きさを判別する。
+ **/
+class KernelHeap {
+public:
+    static const size_t kMinObjectBytes = 16;
+    static const int kNumSizeClasses = 7;
+    static const size_t kMaxSlabObjectBytes = kMinObjectBytes << (kNumSizeClasses - 1);
+    // AllocateBoot 用に確保しておく領域の大きさ
+    static const size_t kBootArenaBytes = 1024 * 1024;
+
+    struct ClassStats {
+        // このクラスのオブジェクトの大きさ
+        size_t object_bytes;
+        // これまでの確保と解放の回数
+        uint64_t allocations;
+        uint64_t frees;
+        // 現在使用中のオブジェクト数
+        size_t objects_in_use;
+        // 現在保持しているスラブの数
+        size_t slabs;
+    };
+
+    struct Stats {
+        ClassStats classes[kNumSizeClasses];
+        uint64_t large_allocations;
+        uint64_t large_frees;
+        size_t large_frames_in_use;
+        size_t boot_arena_used;
+        size_t boot_arena_capacity;
+        // 使用中のオブジェクトの大きさの合計 (サイズクラスへの切り上げを含む)
+        size_t bytes_in_use;
+        // ヒープがフレームとして保持しているバイト数 (管理情報の表を含む)
+        // bytes_in_use との差が断片化と管理情報による無駄
+        size_t bytes_reserved;
+        // 管理情報の表に使っているフレーム数
+        size_t info_frames;
+    };
+
+    explicit KernelHeap(BitmapMemoryManager& frames);
+
+    // 失敗すると nullptr を返す
+    void* Allocate(size_t bytes);
+    void Free(void* p);
+    // 解放しないことが分かっているオブジェクトを確保する。Free に渡しても何もしない
+    void* AllocateBoot(size_t bytes, size_t align);
+
+    Stats GetStats() const;
+
+private:
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    enum class FrameKind : uint8_t {
+        kUnused,
+        kSlab,
+        // 大きなオブジェクトの先頭のフレーム
+        kLarge,
+    };
+
+    // ヒープが使うフレーム1つ分の管理情報
+    struct FrameInfo {
+        // スラブの空きオブジェクトのリスト
+        FreeObject* free_list;
+        // 大きなオブジェクトのフレーム数
+        uint32_t num_frames;
+        // 空きのあるスラブの双方向リスト。フレーム番号で、0 は無し
+        uint32_t prev, next;
+        FrameKind kind;
+        uint8_t size_class;
+        uint16_t objects_in_use;
+        // まだ一度も使っていない領域のフレーム先頭からのオフセット
+        // free_list が空ならここから切り出す
+        uint16_t unused;
+    };
+
+    /**
+     * 管理情報の表は、1フレーム分の FrameInfo (kInfoPerLeaf 個) を葉とする2段の表
+     * 葉は、その範囲のフレームを初めてヒープが使うときにフレームから確保し、解放しない
+     **/
+    static const size_t kInfoPerLeaf = kBytesPerFrame / sizeof(FrameInfo);
+    static const size_t kNumInfoLeaves = BitmapMemoryManager::kFrameCount / kInfoPerLeaf;
+
+    struct SizeClass {
+        // 空きのあるスラブのリスト。先頭のフレーム番号で、0 は無し
+        uint32_t partial;
+        ClassStats stats;
+    };
+
+    static int SizeClassOf(size_t bytes);
+    // 管理情報を返す。葉がまだ無ければ nullptr
+    FrameInfo* FindInfo(size_t frame) const;
+    // 管理情報を返す。葉がまだ無ければ確保し、確保できなければ nullptr
+    FrameInfo* GetInfo(size_t frame);
+    void* AllocateSmall(int size_class);
+    void FreeSmall(size_t frame, FrameInfo* slab, void* p);
+    void* AllocateLarge(size_t bytes);
+    void FreeLarge(size_t frame, FrameInfo* info);
+    void Unlink(SizeClass& sc, FrameInfo* slab);
+    void PushFront(SizeClass& sc, size_t frame, FrameInfo* slab);
+
+    BitmapMemoryManager& frames_;
+    SizeClass classes_[kNumSizeClasses];
+    FrameInfo* info_leaves_[kNumInfoLeaves];
+    size_t info_frames_;
+    uint64_t large_allocations_, large_frees_;
+    size_t large_frames_in_use_;
+    size_t large_bytes_in_use_;
+    uintptr_t boot_arena_begin_, boot_arena_cur_, boot_arena_end_;
+};
+
+extern KernelHeap* kernel_heap;
+
+/**
+ * kernel_heap を初期化する
+ * 以降、グローバルな operator new / delete は kernel_heap を使う
+ **/
+Error InitializeHeap(BitmapMemoryManager& frames);
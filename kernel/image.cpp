@@ -0,0 +1,345 @@
+#include "image.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    uint16_t Load16LE(const uint8_t* p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    uint32_t Load32LE(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    uint32_t Load32BE(const uint8_t* p) {
+        return (uint32_t {p[0]} << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    // BMP のファイルヘッダと情報ヘッダ (BITMAPINFOHEADER) の大きさ
+    const size_t kBMPFileHeaderBytes = 14;
+    const size_t kBMPInfoHeaderBytes = 40;
+    const uint32_t kBMPCompressionRGB = 0;
+    const uint32_t kBMPCompressionBitFields = 3;
+
+    // QOI のヘッダと、ファイルの最後に付く終端の並び (0 が7バイトと 1) の大きさ
+    const size_t kQOIHeaderBytes = 14;
+    const size_t kQOIEndBytes = 8;
+
+    struct BMPImage {
+        int bits_per_pixel;
+        // 上から下の順に行が並んでいれば true
+        bool top_down;
+        const uint8_t* pixels;
+        // 1行のバイト数。4 バイト単位に切り上げられている
+        size_t stride;
+        // B, G, R, 予約 の 4 バイトずつ並んだ色の表。8 ビット以下のときだけ使う
+        const uint8_t* palette;
+        int palette_size;
+    };
+
+    struct Image {
+        ImageInfo info;
+        BMPImage bmp;
+    };
+
+    Error ParseBMP(const uint8_t* data, size_t size, Image& image) {
+        if (size < kBMPFileHeaderBytes + kBMPInfoHeaderBytes) return MAKE_ERROR(Error::kInvalidFormat);
+        const uint32_t pixel_offset = Load32LE(data + 10);
+        const uint8_t* info = data + kBMPFileHeaderBytes;
+        const uint32_t info_bytes = Load32LE(info);
+        if (info_bytes < kBMPInfoHeaderBytes || info_bytes > size - kBMPFileHeaderBytes) {
+            return MAKE_ERROR(Error::kInvalidFormat);
+        }
+
+        const int32_t width = Load32LE(info + 4);
+        const int32_t height = Load32LE(info + 8);
+        const int bits_per_pixel = Load16LE(info + 14);
+        const uint32_t compression = Load32LE(info + 16);
+        const uint32_t colors_used = Load32LE(info + 32);
+        if (Load16LE(info + 12) != 1 || width <= 0 || height == 0) {
+            return MAKE_ERROR(Error::kInvalidFormat);
+        }
+        const int64_t rows = height < 0 ? -int64_t {height} : height;
+        if (width > kMaxImageSide || rows > kMaxImageSide) return MAKE_ERROR(Error::kNotSupported);
+
+        switch (bits_per_pixel) {
+            case 1:
+            case 4:
+            case 8:
+            case 24:
+            case 32: break;
+            default: return MAKE_ERROR(Error::kNotSupported);
+        }
+        if (compression == kBMPCompressionBitFields) {
+            // 色のマスクは BITMAPINFOHEADER の直後 (V4 / V5 ヘッダでは同じ位置のフィールド) にある
+            const size_t masks = kBMPFileHeaderBytes + kBMPInfoHeaderBytes;
+            if (bits_per_pixel != 32 || size < masks + 12) return MAKE_ERROR(Error::kInvalidFormat);
+            if (Load32LE(data + masks) != 0x00ff0000 || Load32LE(data + masks + 4) != 0x0000ff00
+                || Load32LE(data + masks + 8) != 0x000000ff)
+            {
+                return MAKE_ERROR(Error::kNotSupported);
+            }
+        } else if (compression != kBMPCompressionRGB) {
+            // RLE などの圧縮形式は扱わない
+            return MAKE_ERROR(Error::kNotSupported);
+        }
+
+        BMPImage& bmp = image.bmp;
+        bmp.bits_per_pixel = bits_per_pixel;
+        bmp.top_down = height < 0;
+        bmp.palette = nullptr;
+        bmp.palette_size = 0;
+        if (bits_per_pixel <= 8) {
+            const uint32_t colors = colors_used ? colors_used : 1u << bits_per_pixel;
+            const size_t palette_offset = kBMPFileHeaderBytes + info_bytes;
+            if (colors > 256 || 4 * colors > size - palette_offset) {
+                return MAKE_ERROR(Error::kInvalidFormat);
+            }
+            bmp.palette = data + palette_offset;
+            bmp.palette_size = colors;
+        }
+
+        bmp.stride = (size_t {1} * width * bits_per_pixel + 31) / 32 * 4;
+        if (pixel_offset > size || bmp.stride * rows > size - pixel_offset) {
+            return MAKE_ERROR(Error::kInvalidFormat);
+        }
+        bmp.pixels = data + pixel_offset;
+        image.info = {kImageBMP, width, static_cast<int>(rows)};
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    Error ParseQOI(const uint8_t* data, size_t size, Image& image) {
+        if (size < kQOIHeaderBytes + kQOIEndBytes) return MAKE_ERROR(Error::kInvalidFormat);
+        const uint32_t width = Load32BE(data + 4);
+        const uint32_t height = Load32BE(data + 8);
+        const uint8_t channels = data[12], colorspace = data[13];
+        if (width == 0 || height == 0 || (channels != 3 && channels != 4) || colorspace > 1) {
+            return MAKE_ERROR(Error::kInvalidFormat);
+        }
+        if (width > kMaxImageSide || height > kMaxImageSide) return MAKE_ERROR(Error::kNotSupported);
+        image.info = {kImageQOI, static_cast<int>(width), static_cast<int>(height)};
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    Error ParseImage(const uint8_t* data, size_t size, Image& image) {
+        if (size >= 2 && data[0] == 'B' && data[1] == 'M') return ParseBMP(data, size, image);
+        if (size >= 4 && memcmp(data, "qoif", 4) == 0) return ParseQOI(data, size, image);
+        return MAKE_ERROR(Error::kInvalidFormat);
+    }
+
+    // 1行の中の x 番目のパレット番号。1 / 4 ビットでは上位のビットが左のピクセル
+    template <int Bits>
+    uint8_t PaletteIndex(const uint8_t* row, int x) {
+        if (Bits == 8) return row[x];
+        const int per_byte = 8 / Bits;
+        const int shift = 8 - Bits * (x % per_byte + 1);
+        return (row[x / per_byte] >> shift) & ((1 << Bits) - 1);
+    }
+
+
+    // パレットを使う BMP の1行を、変換済みの色の表 palette を引きながら書き込む
+    template <int Bits>
+    void ConvertPaletteRow(
+        uint32_t* dst, const uint8_t* row, int x, int width, const uint32_t* palette) {
+        for (int i = 0; i < width; ++i) {
+            dst[i] = palette[PaletteIndex<Bits>(row, x + i)];
+        }
+    }
+
+    /**
+     * BMP の見える部分 visible (画面座標) を1行ずつ変換して書き込む
+     * BMP の行は決まったバイト数で並んでいるので、見える行と列だけを読む
+     **/
+    template <typename Writer>
+    void DrawBMP(Writer& writer, const Image& image, Point pos, const Rectangle& visible) {
+        const BMPImage& bmp = image.bmp;
+        const int image_x = visible.x - pos.x;
+        const int width = visible.width;
+
+        // パレットは書き込む形式へ先に変換しておき、ピクセルごとには表を引くだけにする
+        uint32_t palette[256];
+        if (bmp.palette) {
+            std::fill_n(palette, 256, writer.Encode({0, 0, 0}));
+            for (int i = 0; i < bmp.palette_size; ++i) {
+                const uint8_t* p = bmp.palette + 4 * i;
+                palette[i] = writer.Encode({p[2], p[1], p[0]});
+            }
+        }
+
+        for (int y = visible.y; y < visible.y + visible.height; ++y) {
+            const int image_y = y - pos.y;
+            // 下から上の順の BMP では、画像の1行目がファイルの最後の行にある
+            const int file_y = bmp.top_down ? image_y : image.info.height - 1 - image_y;
+            const uint8_t* row = bmp.pixels + bmp.stride * file_y;
+            uint32_t* dst = writer.PixelAt(visible.x, y);
+            switch (bmp.bits_per_pixel) {
+                case 1: ConvertPaletteRow<1>(dst, row, image_x, width, palette); break;
+                case 4: ConvertPaletteRow<4>(dst, row, image_x, width, palette); break;
+                case 8: ConvertPaletteRow<8>(dst, row, image_x, width, palette); break;
+                case 24: {
+                    const uint8_t* src = row + 3 * image_x;
+                    for (int i = 0; i < width; ++i) {
+                        dst[i] = writer.Encode({src[3 * i + 2], src[3 * i + 1], src[3 * i]});
+                    }
+                    break;
+                }
+                case 32: {
+                    // バイト順は B, G, R, (アルファまたは予約)
+                    const uint8_t* src = row + 4 * image_x;
+                    for (int i = 0; i < width; ++i) {
+                        dst[i] = writer.Encode({src[4 * i + 2], src[4 * i + 1], src[4 * i]});
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    /**
+     * QOI を先頭から復号し、見える部分 visible (画面座標) に入るピクセルだけを書き込む
+     * 各操作は直前のピクセルと、過去の色の表 (64 色) だけに依存するので、1ピクセルずつ復号しながら
+     * その場で書き込む形式に変換する。同じ色の連続 (QOI_OP_RUN) は行の中ではまとめて書き込む
+     **/
+    template <typename Writer>
+    Error DrawQOI(Writer& writer,
+        const uint8_t* data,
+        size_t size,
+        const Image& image,
+        Point pos,
+        const Rectangle& visible) {
+        const uint8_t* p = data + kQOIHeaderBytes;
+        // 正しいファイルでは、最後の操作も終端の8バイトより前から始まる。
+        // 操作の先頭がここより前にあれば、その操作の (最大5バイトの) 読み出しはファイルに収まる
+        const uint8_t* const ops_end = data + size - kQOIEndBytes;
+        // 見える列の範囲 (画像の座標)
+        const int x0 = visible.x - pos.x, x1 = x0 + visible.width;
+
+        // 過去の色の表は r, g, b, a を下位のバイトから詰めた値で持つ
+        uint32_t index[64] = {};
+        uint8_t r = 0, g = 0, b = 0, a = 255;
+        uint32_t value = writer.Encode({r, g, b});
+        // 今の色をあと何ピクセル出すか
+        int count = 0;
+
+        // 見える最後の行より下は復号しない
+        const int rows = visible.y + visible.height - pos.y;
+        for (int image_y = 0; image_y < rows; ++image_y) {
+            const int y = pos.y + image_y;
+            uint32_t* dst = nullptr;
+            if (y >= visible.y && y < visible.y + visible.height) {
+                // dst[x - x0] が画像の列 x のピクセル
+                dst = writer.PixelAt(visible.x, y);
+            }
+
+            for (int x = 0; x < image.info.width;) {
+                if (count == 0) {
+                    if (p >= ops_end) return MAKE_ERROR(Error::kInvalidFormat);
+                    const uint8_t op = *p++;
+                    count = 1;
+                    if (op == 0xfe) {  // QOI_OP_RGB
+                        r = p[0];
+                        g = p[1];
+                        b = p[2];
+                        p += 3;
+                    } else if (op == 0xff) {  // QOI_OP_RGBA
+                        r = p[0];
+                        g = p[1];
+                        b = p[2];
+                        a = p[3];
+                        p += 4;
+                    } else {
+                        switch (op >> 6) {
+                            case 0: {  // QOI_OP_INDEX
+                                const uint32_t v = index[op];
+                                r = v;
+                                g = v >> 8;
+                                b = v >> 16;
+                                a = v >> 24;
+                                break;
+                            }
+                            case 1:  // QOI_OP_DIFF: 各色の差が -2..1
+                                r += ((op >> 4) & 3) - 2;
+                                g += ((op >> 2) & 3) - 2;
+                                b += (op & 3) - 2;
+                                break;
+                            case 2: {  // QOI_OP_LUMA: 緑の差が -32..31、赤と青は緑の差からの差が -8..7
+                                const int dg = (op & 0x3f) - 32;
+                                const uint8_t rb = *p++;
+                                r += dg - 8 + (rb >> 4);
+                                g += dg;
+                                b += dg - 8 + (rb & 0x0f);
+                                break;
+                            }
+                            case 3:  // QOI_OP_RUN: 直前の色を 1..62 ピクセル繰り返す
+                                count = (op & 0x3f) + 1;
+                                break;
+                        }
+                    }
+                    index[(r * 3 + g * 5 + b * 7 + a * 11) % 64]
+                        = r | (g << 8) | (b << 16) | (uint32_t {a} << 24);
+                    value = writer.Encode({r, g, b});
+                }
+
+                // 連続は行をまたぐことがあるので、この行に収まる分だけ出す
+                const int n = std::min(count, image.info.width - x);
+                if (dst) {
+                    const int begin = std::max(x, x0), end = std::min(x + n, x1);
+                    for (int i = begin; i < end; ++i) dst[i - x0] = value;
+                }
+                x += n;
+                count -= n;
+            }
+        }
+        return MAKE_ERROR(Error::kSuccess);
+    }
+}  // namespace
+
+WithError<ImageInfo> ReadImageInfo(const uint8_t* data, size_t size) {
+    Image image;
+    if (auto err = ParseImage(data, size, image)) return {{}, err};
+    return {image.info, MAKE_ERROR(Error::kSuccess)};
+}
+
+Error DrawImage(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    Point pos,
+    const uint8_t* data,
+    size_t size,
+    DamageTracker* tracker) {
+    Image image;
+    if (auto err = ParseImage(data, size, image)) return err;
+
+    // 見える部分 = 画像の矩形 ∩ clip ∩ 画面
+    Rectangle visible = clip;
+    if (!ClipRect(visible.x,
+            visible.y,
+            visible.width,
+            visible.height,
+            config.horizontal_resolution,
+            config.vertical_resolution))
+    {
+        return MAKE_ERROR(Error::kSuccess);
+    }
+    const long x0 = std::max<long>(visible.x, pos.x), y0 = std::max<long>(visible.y, pos.y);
+    const long x1 = std::min<long>(visible.x + visible.width, long {pos.x} + image.info.width);
+    const long y1 = std::min<long>(visible.y + visible.height, long {pos.y} + image.info.height);
+    if (x0 >= x1 || y0 >= y1) return MAKE_ERROR(Error::kSuccess);
+    visible = {static_cast<int>(x0),
+        static_cast<int>(y0),
+        static_cast<int>(x1 - x0),
+        static_cast<int>(y1 - y0)};
+
+    Error err = MAKE_ERROR(Error::kSuccess);
+    DispatchPixelFormat(config, [&](auto& writer) {
+        if (image.info.format == kImageBMP) {
+            DrawBMP(writer, image, pos, visible);
+        } else {
+            err = DrawQOI(writer, data, size, image, pos, visible);
+        }
+    });
+    if (tracker) tracker->MarkDirty(visible);
+    return err;
+}
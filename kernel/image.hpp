@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "error.hpp"
+#include "frame_buffer_config.hpp"
+#include "graphics.hpp"
+
+/**
+ * 画像 (無圧縮の BMP と QOI) をフレームバッファへ直接展開する関数
+ * 画像全体を一時的なバッファへ展開してから転送するのではなく、1行ずつ復号しながら
+ * その行を BasicPixelWriter のピクセル形式 (RGB / BGR) に変換して書き込む。
+ * 入力は初期 RAM ディスクのファイルなど、メモリ上にある画像ファイルの内容をそのまま渡す。
+ *
+ * 対応する形式
+ *   BMP: 1 / 4 / 8 ビット (パレット)、24 ビット、32 ビット (BI_RGB と、BGRX の並びの BI_BITFIELDS)
+ *        下から上 (高さが正) と上から下 (高さが負) のどちらの行の順序も扱う
+ *   QOI: 3 チャンネルと 4 チャンネル
+ * フレームバッファは不透明度を持たないので、アルファチャンネルは読み飛ばす。
+ **/
+
+// 幅と高さの上限。これより大きな画像は kNotSupported とする
+const int kMaxImageSide = 16384;
+
+enum ImageFormat {
+    kImageBMP,
+    kImageQOI,
+};
+
+struct ImageInfo {
+    ImageFormat format;
+    int width, height;
+};
+
+// data から size バイトの画像ファイルのヘッダを読み、形式と大きさを返す
+WithError<ImageInfo> ReadImageInfo(const uint8_t* data, size_t size);
+
+/**
+ * data から size バイトの画像ファイルを、左上が pos になるように描く
+ * clip (と画面) の外にはみ出す部分は書き込まない。BMP は見える行と列だけを読み、
+ * QOI は前のピクセルに依存して復号するため全体を復号しながら見える部分だけを書き込む。
+ * 描いた領域は、描画の最後に1回だけ tracker へ通知する。
+ * 形式が正しくなければ kInvalidFormat を返す。途中で壊れている QOI では、そこまでの行は描かれる
+ **/
+Error DrawImage(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    Point pos,
+    const uint8_t* data,
+    size_t size,
+    DamageTracker* tracker = nullptr);
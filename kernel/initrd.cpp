@@ -0,0 +1,191 @@
+#include "initrd.hpp"
+
+#include <cstring>
+#include <new>
+#include "heap.hpp"
+
+namespace {
+    alignas(Initrd) char initrd_buf[sizeof(Initrd)];
+
+    // ustar のヘッダ (512 バイト) の中で使うフィールドの位置と大きさ
+    const size_t kBlockBytes = 512;
+    const size_t kNameOffset = 0, kNameBytes = 100;
+    const size_t kSizeOffset = 124, kSizeBytes = 12;
+    const size_t kChecksumOffset = 148, kChecksumBytes = 8;
+    const size_t kTypeOffset = 156;
+    const size_t kMagicOffset = 257;
+    const size_t kPrefixOffset = 345, kPrefixBytes = 155;
+
+    // 数値のフィールドは8進数の文字列で、空白か NUL で終わる
+    bool ParseOctal(const uint8_t* field, size_t bytes, uint64_t& value) {
+        value = 0;
+        size_t i = 0;
+        while (i < bytes && field[i] == ' ') ++i;
+        if (i == bytes || field[i] < '0' || field[i] > '7') return false;
+        for (; i < bytes && field[i] >= '0' && field[i] <= '7'; ++i) {
+            value = (value << 3) | (field[i] - '0');
+        }
+        return true;
+    }
+
+    // チェックサムはヘッダの全バイトの和。チェックサムのフィールド自身は空白として数える
+    bool ValidChecksum(const uint8_t* header) {
+        uint64_t expected;
+        if (!ParseOctal(header + kChecksumOffset, kChecksumBytes, expected)) return false;
+        uint64_t sum = 0;
+        for (size_t i = 0; i < kBlockBytes; ++i) {
+            const bool in_field = i >= kChecksumOffset && i < kChecksumOffset + kChecksumBytes;
+            sum += in_field ? ' ' : header[i];
+        }
+        return sum == expected;
+    }
+
+    size_t FieldLength(const uint8_t* field, size_t bytes) {
+        size_t n = 0;
+        while (n < bytes && field[n] != '\0') ++n;
+        return n;
+    }
+
+    // tar -C dir . で作ると付く先頭の "./" や "/" を取り除く
+    void StripLeadingDots(const char*& s, size_t& n) {
+        while (true) {
+            if (n >= 2 && s[0] == '.' && s[1] == '/') {
+                s += 2;
+                n -= 2;
+            } else if (n >= 1 && s[0] == '/') {
+                ++s;
+                --n;
+            } else {
+                return;
+            }
+        }
+    }
+
+    // 32ビットの FNV-1a
+    uint32_t HashPath(const char* path, size_t n) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < n; ++i) {
+            hash ^= static_cast<uint8_t>(path[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+}  // namespace
+
+Initrd* initrd;
+
+Initrd::Initrd(const uint8_t* base, size_t size) :
+    base_ {base}, size_ {size}, files_ {nullptr}, num_files_ {0}, slots_ {nullptr}, slot_mask_ {0} {}
+
+Error Initrd::Scan(InitrdFile* files, size_t& num_files) {
+    num_files = 0;
+    for (size_t offset = 0; offset + kBlockBytes <= size_;) {
+        const uint8_t* header = base_ + offset;
+        // アーカイブの終わりは全て 0 のブロックで示される
+        if (header[kNameOffset] == '\0') break;
+        if (memcmp(header + kMagicOffset, "ustar", 5) != 0 || !ValidChecksum(header)) {
+            return MAKE_ERROR(Error::kInvalidFormat);
+        }
+
+        uint64_t size;
+        if (!ParseOctal(header + kSizeOffset, kSizeBytes, size)) {
+            return MAKE_ERROR(Error::kInvalidFormat);
+        }
+        const size_t data_offset = offset + kBlockBytes;
+        if (size > size_ - data_offset) {
+            return MAKE_ERROR(Error::kInvalidFormat);
+        }
+        offset = data_offset + (size + kBlockBytes - 1) / kBlockBytes * kBlockBytes;
+
+        // 通常のファイルだけを索引に載せる (ディレクトリやリンクは読み飛ばす)
+        const uint8_t type = header[kTypeOffset];
+        if (type != '0' && type != '\0') continue;
+
+        // 長いパスは prefix と name に分かれている。先頭の "./" は前にある方から取り除く
+        const char* name = reinterpret_cast<const char*>(header + kNameOffset);
+        size_t name_length = FieldLength(header + kNameOffset, kNameBytes);
+        const char* prefix = reinterpret_cast<const char*>(header + kPrefixOffset);
+        size_t prefix_length = FieldLength(header + kPrefixOffset, kPrefixBytes);
+        StripLeadingDots(prefix, prefix_length);
+        if (prefix_length == 0) StripLeadingDots(name, name_length);
+        if (name_length == 0) continue;
+
+        if (files) {
+            InitrdFile& file = files[num_files];
+            file.path = name;
+            file.path_length = name_length;
+            if (prefix_length > 0) {
+                // 1つの文字列につなげておく
+                auto path = static_cast<char*>(
+                    kernel_heap->AllocateBoot(prefix_length + 1 + name_length, 1));
+                if (!path) return MAKE_ERROR(Error::kNoEnoughMemory);
+                memcpy(path, prefix, prefix_length);
+                path[prefix_length] = '/';
+                memcpy(path + prefix_length + 1, name, name_length);
+                file.path = path;
+                file.path_length = prefix_length + 1 + name_length;
+            }
+            file.data = base_ + data_offset;
+            file.size = size;
+        }
+        ++num_files;
+    }
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+Error Initrd::BuildIndex() {
+    size_t count;
+    if (auto err = Scan(nullptr, count)) return err;
+    if (count == 0) return MAKE_ERROR(Error::kSuccess);
+
+    // 索引は半分以上が空きになる大きさにして、探索が短く終わるようにする
+    size_t num_slots = 16;
+    while (num_slots < 2 * count) num_slots *= 2;
+    files_ = static_cast<InitrdFile*>(
+        kernel_heap->AllocateBoot(sizeof(InitrdFile) * count, alignof(InitrdFile)));
+    slots_ = static_cast<Slot*>(kernel_heap->AllocateBoot(sizeof(Slot) * num_slots, alignof(Slot)));
+    if (!files_ || !slots_) return MAKE_ERROR(Error::kNoEnoughMemory);
+    if (auto err = Scan(files_, num_files_)) return err;
+
+    slot_mask_ = num_slots - 1;
+    memset(slots_, 0, sizeof(Slot) * num_slots);
+    for (size_t i = 0; i < num_files_; ++i) {
+        const uint32_t hash = HashPath(files_[i].path, files_[i].path_length);
+        size_t slot = hash & slot_mask_;
+        while (slots_[slot].index != 0) {
+            // 同じパスが複数あれば、tar の慣習に従って後のものを使う
+            const InitrdFile& other = files_[slots_[slot].index - 1];
+            if (slots_[slot].hash == hash && other.path_length == files_[i].path_length
+                && memcmp(other.path, files_[i].path, other.path_length) == 0)
+            {
+                break;
+            }
+            slot = (slot + 1) & slot_mask_;
+        }
+        slots_[slot] = {hash, static_cast<uint32_t>(i + 1)};
+    }
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+const InitrdFile* Initrd::Find(const char* path) const {
+    if (!slots_) return nullptr;
+    while (*path == '/') ++path;
+    const size_t length = strlen(path);
+    const uint32_t hash = HashPath(path, length);
+    for (size_t slot = hash & slot_mask_; slots_[slot].index != 0; slot = (slot + 1) & slot_mask_) {
+        if (slots_[slot].hash != hash) continue;
+        const InitrdFile& file = files_[slots_[slot].index - 1];
+        if (file.path_length == length && memcmp(file.path, path, length) == 0) {
+            return &file;
+        }
+    }
+    return nullptr;
+}
+
+Error InitializeInitrd(const void* base, size_t size) {
+    if (!base) return MAKE_ERROR(Error::kSuccess);
+    auto rd = new (initrd_buf) Initrd {static_cast<const uint8_t*>(base), size};
+    if (auto err = rd->BuildIndex()) return err;
+    initrd = rd;
+    return MAKE_ERROR(Error::kSuccess);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "error.hpp"
+
+/**
+ * 初期 RAM ディスクの中の1つのファイル
+ * path と data はアーカイブ (ローダが読み込んだ領域) の中を直接指し、読み出し専用。
+ **/
+struct InitrdFile {
+    // アーカイブ内のパス (例: "images/logo.bmp")。先頭の "./" は取り除いてあり、NUL 終端されていない
+    const char* path;
+    size_t path_length;
+    const uint8_t* data;
+    size_t size;
+};
+
+/**
+ * 初期 RAM ディスク (ローダが \initrd から読み込んだ ustar 形式の tar アーカイブ)
+ * ファイルの内容はコピーせず、アーカイブの中を指すポインタとして渡す。
+ * 起動時に1回だけアーカイブを走査し、パスの FNV-1a ハッシュを使うオープンアドレス法の表を作るので、
+ * Find はファイルの数によらずほぼ一定の時間で終わる。索引はヒープの AllocateBoot で確保する。
+ **/
+class Initrd {
+public:
+    Initrd(const uint8_t* base, size_t size);
+
+    // アーカイブを走査して索引を作る。形式が正しくなければ kInvalidFormat を返す
+    Error BuildIndex();
+
+    // path のファイルを返す。先頭の "/" は無視する。無ければ nullptr
+    const InitrdFile* Find(const char* path) const;
+
+    const InitrdFile* begin() const {
+        return files_;
+    }
+    const InitrdFile* end() const {
+        return files_ + num_files_;
+    }
+    size_t Count() const {
+        return num_files_;
+    }
+    // アーカイブ全体のバイト数
+    size_t Bytes() const {
+        return size_;
+    }
+
+private:
+    // 索引の1要素。index は files_ の添字 + 1 で、0 なら空き
+    struct Slot {
+        uint32_t hash;
+        uint32_t index;
+    };
+
+    // アーカイブを先頭から走査する。files が nullptr でなければ、通常のファイルを順に書き込む
+    Error Scan(InitrdFile* files, size_t& num_files);
+
+    const uint8_t* base_;
+    size_t size_;
+    InitrdFile* files_;
+    size_t num_files_;
+    Slot* slots_;
+    // 索引の要素数 - 1 (要素数は2のべき乗)
+    size_t slot_mask_;
+};
+
+// ローダが初期 RAM ディスクを渡さなかったときは nullptr
+extern Initrd* initrd;
+
+/**
+ * base から size バイトのアーカイブで initrd を初期化する
+ * ヒープを使うので InitializeHeap の後に呼ぶこと。base が nullptr なら何もしない
+ **/
+Error InitializeInitrd(const void* base, size_t size);
@@ -0,0 +1,37 @@
+#include "interrupt.hpp"
+
+#include "asmfunc.h"
+#include "segment.hpp"
+
+std::array<InterruptDescriptor, 256> idt;
+
+void SetIDTEntry(InterruptDescriptor& desc,
+    InterruptDescriptorAttribute attr,
+    uint64_t offset,
+    uint16_t segment_selector) {
+    desc.attr = attr;
+    desc.offset_low = offset & 0xffffu;
+    desc.offset_middle = (offset >> 16) & 0xffffu;
+    desc.offset_high = offset >> 32;
+    desc.segment_selector = segment_selector;
+}
+
+void InitializeInterrupt() {
+    // 8259 PIC のマスタとスレーブの全ての IRQ をマスクする
+    IoOut8(0x21, 0xff);
+    IoOut8(0xa1, 0xff);
+
+    SetIDTEntry(idt[InterruptVector::kLocalAPICTimer],
+        MakeIDTAttr(DescriptorType::kInterruptGate, 0),
+        reinterpret_cast<uint64_t>(IntHandlerLAPICTimer),
+        kKernelCS);
+    SetIDTEntry(idt[InterruptVector::kWakeup],
+        MakeIDTAttr(DescriptorType::kInterruptGate, 0),
+        reinterpret_cast<uint64_t>(IntHandlerWakeup),
+        kKernelCS);
+    SetIDTEntry(idt[InterruptVector::kSpurious],
+        MakeIDTAttr(DescriptorType::kInterruptGate, 0),
+        reinterpret_cast<uint64_t>(IntHandlerSpurious),
+        kKernelCS);
+    LoadIDT(sizeof(idt) - 1, reinterpret_cast<uintptr_t>(&idt[0]));
+}
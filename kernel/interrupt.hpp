@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "x86_descriptor.hpp"
+
+union InterruptDescriptorAttribute {
+    uint16_t data;
+    struct {
+        uint16_t interrupt_stack_table : 3;
+        uint16_t : 5;
+        DescriptorType type : 4;
+        uint16_t : 1;
+        uint16_t descriptor_privilege_level : 2;
+        uint16_t present : 1;
+    } __attribute__((packed)) bits;
+} __attribute__((packed));
+
+// 割り込みディスクリプタ。IDT の1要素
+struct InterruptDescriptor {
+    uint16_t offset_low;
+    uint16_t segment_selector;
+    InterruptDescriptorAttribute attr;
+    uint16_t offset_middle;
+    uint32_t offset_high;
+    uint32_t reserved;
+} __attribute__((packed));
+
+extern std::array<InterruptDescriptor, 256> idt;
+
+constexpr InterruptDescriptorAttribute MakeIDTAttr(DescriptorType type,
+    uint8_t descriptor_privilege_level,
+    bool present = true,
+    uint8_t interrupt_stack_table = 0) {
+    InterruptDescriptorAttribute attr {};
+    attr.bits.interrupt_stack_table = interrupt_stack_table;
+    attr.bits.type = type;
+    attr.bits.descriptor_privilege_level = descriptor_privilege_level;
+    attr.bits.present = present;
+    return attr;
+}
+
+void SetIDTEntry(InterruptDescriptor& desc,
+    InterruptDescriptorAttribute attr,
+    uint64_t offset,
+    uint16_t segment_selector);
+
+// 割り込みベクタ番号
+class InterruptVector {
+public:
+    enum Number
+    {
+        kLocalAPICTimer = 0x41,
+        kWakeup = 0x42,
+        kSpurious = 0xff,
+    };
+};
+
+/**
+ * IDT を設定して読み込む
+ * レガシーな 8259 PIC は全ての割り込みをマスクし、割り込みは Local APIC からだけ受け付ける
+ * 割り込みを許可 (sti) するのは呼び出し側の役目
+ **/
+void InitializeInterrupt();
+
+/**
+ * 生成されてから破棄されるまで、この CPU の割り込みを禁止する
+ * 破棄するときは生成前の IF の状態に戻すので、入れ子にしても良い
+ **/
+class InterruptGuard {
+public:
+    InterruptGuard() {
+        __asm__ volatile("pushfq\n\tpopq %0\n\tcli" : "=r"(rflags_) : : "memory");
+    }
+    ~InterruptGuard() {
+        if (rflags_ & (1u << 9)) __asm__ volatile("sti" : : : "memory");
+    }
+
+    InterruptGuard(const InterruptGuard&) = delete;
+    InterruptGuard& operator=(const InterruptGuard&) = delete;
+
+private:
+    uint64_t rflags_;
+};
@@ -0,0 +1,267 @@
+#include "layer.hpp"
+
+#include <algorithm>
+#include <new>
+#include "simd.hpp"
+
+namespace {
+    bool Overlaps(const Rectangle& a, const Rectangle& b) {
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height
+            && b.y < a.y + a.height;
+    }
+
+    // 値を並べ替えて重複を取り除き、残った個数を返す
+    int SortUnique(int* values, int n) {
+        std::sort(values, values + n);
+        return std::unique(values, values + n) - values;
+    }
+
+    uint32_t EncodeFor(PixelFormat format, const PixelColor& c) {
+        switch (format) {
+            case kPixelRGBResv8BitPerColor:
+                return PixelTraits<kPixelRGBResv8BitPerColor>::Encode(c);
+            case kPixelBGRResv8BitPerColor:
+                return PixelTraits<kPixelBGRResv8BitPerColor>::Encode(c);
+            case kPixelBitMask:
+                // レイヤーは影のバッファ (BGR) に合成するので、この形式の画面には重ねない
+                break;
+        }
+        return 0;
+    }
+}  // namespace
+
+Layer::Layer(
+    unsigned int id, int width, int height, PixelFormat format, Blend blend, uint32_t* buffer) :
+    id_ {id},
+    blend_ {blend},
+    alpha_ {256},
+    x_ {0},
+    y_ {0},
+    shown_ {false},
+    buffer_ {buffer},
+    config_ {reinterpret_cast<uint8_t*>(buffer),
+        static_cast<uint32_t>(width),
+        static_cast<uint32_t>(width),
+        static_cast<uint32_t>(height),
+        format,
+        uint64_t {4} * width * height} {}
+
+void Layer::FillRect(Rectangle area, const PixelColor& c) {
+    const int width = config_.horizontal_resolution, height = config_.vertical_resolution;
+    if (!ClipRect(area.x, area.y, area.width, area.height, width, height)) return;
+
+    uint32_t value = EncodeFor(config_.pixel_format, c);
+    if (blend_ == Blend::kPerPixelAlpha) {
+        value |= static_cast<uint32_t>(c.a) << 24;
+    }
+    uint32_t* row = buffer_ + config_.pixels_per_scan_line * area.y + area.x;
+    for (int dy = 0; dy < area.height; ++dy) {
+        for (int dx = 0; dx < area.width; ++dx) {
+            row[dx] = value;
+        }
+        row += config_.pixels_per_scan_line;
+    }
+}
+
+LayerManager::LayerManager(
+    const FrameBufferConfig& screen, DamageTracker* tracker, const PixelColor& background) :
+    screen_ {screen},
+    tracker_ {tracker},
+    background_ {EncodeFor(screen.pixel_format, background)},
+    num_layers_ {0},
+    next_id_ {1},
+    damage_ {},
+    stats_ {} {}
+
+Layer* LayerManager::NewLayer(int width, int height, Layer::Blend blend) {
+    if (num_layers_ == kMaxLayers || width <= 0 || height <= 0) return nullptr;
+
+    auto buffer = new (std::nothrow) uint32_t[static_cast<size_t>(width) * height];
+    if (buffer == nullptr) return nullptr;
+    auto layer = new (std::nothrow) Layer {next_id_, width, height, screen_.pixel_format, blend, buffer};
+    if (layer == nullptr) {
+        delete[] buffer;
+        return nullptr;
+    }
+    ++next_id_;
+    layer->FillRect({0, 0, width, height}, {0, 0, 0, 0});
+    layers_[num_layers_++] = layer;
+    return layer;
+}
+
+void LayerManager::Move(Layer& layer, int x, int y) {
+    if (layer.shown_) MarkDamaged(layer.Area());
+    layer.x_ = x;
+    layer.y_ = y;
+    layer.shown_ = true;
+    MarkDamaged(layer.Area());
+}
+
+void LayerManager::SetAlpha(Layer& layer, unsigned int alpha) {
+    layer.alpha_ = std::min(alpha, 256u);
+    if (layer.shown_) MarkDamaged(layer.Area());
+}
+
+void LayerManager::RaiseToTop(Layer& layer) {
+    auto end = layers_ + num_layers_;
+    auto it = std::find(layers_, end, &layer);
+    if (it == end) return;
+    std::rotate(it, it + 1, end);
+    if (layer.shown_) MarkDamaged(layer.Area());
+}
+
+void LayerManager::Invalidate(const Layer& layer, Rectangle area) {
+    if (!layer.shown_) return;
+    const Rectangle bounds = layer.Area();
+    if (!ClipRect(area.x, area.y, area.width, area.height, bounds.width, bounds.height)) return;
+    MarkDamaged({bounds.x + area.x, bounds.y + area.y, area.width, area.height});
+}
+
+void LayerManager::InvalidateAll() {
+    MarkDamaged({0,
+        0,
+        static_cast<int>(screen_.horizontal_resolution),
+        static_cast<int>(screen_.vertical_resolution)});
+}
+
+void LayerManager::MarkDamaged(const Rectangle& area) {
+    Rectangle r = area;
+    if (!ClipRect(r.x,
+            r.y,
+            r.width,
+            r.height,
+            screen_.horizontal_resolution,
+            screen_.vertical_resolution))
+    {
+        return;
+    }
+    damage_.Add(r);
+}
+
+void LayerManager::Compose() {
+    for (const Rectangle& r : damage_) {
+        // 作業領域に収まる幅ごとに合成する
+        for (int x = r.x; x < r.x + r.width; x += kMaxLineWidth) {
+            const int width = std::min(kMaxLineWidth, r.x + r.width - x);
+            ComposeRect({x, r.y, width, r.height});
+        }
+        if (tracker_) tracker_->MarkDirty(r);
+    }
+    damage_.Clear();
+}
+
+LayerManager::Stats LayerManager::TakeStats() {
+    const Stats stats = stats_;
+    stats_ = {};
+    return stats;
+}
+
+void LayerManager::ComposeRect(const Rectangle& area) {
+    // 矩形に掛かるレイヤー (下から順)
+    Layer* overlapping[kMaxLayers];
+    int num_overlapping = 0;
+    for (int i = 0; i < num_layers_; ++i) {
+        if (layers_[i]->shown_ && Overlaps(layers_[i]->Area(), area)) {
+            overlapping[num_overlapping++] = layers_[i];
+        }
+    }
+
+    // レイヤーの上下の端で、矩形を横長の帯に分ける
+    int ys[2 * kMaxLayers + 2];
+    int num_ys = 0;
+    ys[num_ys++] = area.y;
+    ys[num_ys++] = area.y + area.height;
+    for (int i = 0; i < num_overlapping; ++i) {
+        const Rectangle r = overlapping[i]->Area();
+        ys[num_ys++] = std::clamp(r.y, area.y, area.y + area.height);
+        ys[num_ys++] = std::clamp(r.y + r.height, area.y, area.y + area.height);
+    }
+    num_ys = SortUnique(ys, num_ys);
+
+    const size_t screen_stride = screen_.pixels_per_scan_line;
+    uint32_t* const screen = reinterpret_cast<uint32_t*>(screen_.frame_buffer);
+    for (int iy = 0; iy + 1 < num_ys; ++iy) {
+        const int y0 = ys[iy], y1 = ys[iy + 1];
+
+        // この帯に掛かるレイヤーは、帯の高さ全体を覆っている
+        Layer* band[kMaxLayers];
+        int num_band = 0;
+        for (int i = 0; i < num_overlapping; ++i) {
+            const Rectangle r = overlapping[i]->Area();
+            if (r.y <= y0 && y1 <= r.y + r.height) band[num_band++] = overlapping[i];
+        }
+
+        // レイヤーの左右の端で帯を区間に分け、区間ごとに覆っているレイヤーを求める
+        int xs[2 * kMaxLayers + 2];
+        int num_xs = 0;
+        xs[num_xs++] = area.x;
+        xs[num_xs++] = area.x + area.width;
+        for (int i = 0; i < num_band; ++i) {
+            const Rectangle r = band[i]->Area();
+            xs[num_xs++] = std::clamp(r.x, area.x, area.x + area.width);
+            xs[num_xs++] = std::clamp(r.x + r.width, area.x, area.x + area.width);
+        }
+        num_xs = SortUnique(xs, num_xs);
+
+        uint64_t cover[2 * kMaxLayers + 1];
+        for (int ix = 0; ix + 1 < num_xs; ++ix) {
+            cover[ix] = 0;
+            for (int i = 0; i < num_band; ++i) {
+                const Rectangle r = band[i]->Area();
+                if (r.x <= xs[ix] && xs[ix + 1] <= r.x + r.width) cover[ix] |= uint64_t {1} << i;
+            }
+        }
+
+        for (int y = y0; y < y1; ++y) {
+            for (int ix = 0; ix + 1 < num_xs; ++ix) {
+                ComposeSegment(line_ + (xs[ix] - area.x), y, xs[ix], xs[ix + 1], band, cover[ix]);
+            }
+            CopyPixels32(screen + screen_stride * y + area.x, line_, area.width);
+        }
+        stats_.pixels_composed += static_cast<uint64_t>(area.width) * (y1 - y0);
+    }
+}
+
+void LayerManager::ComposeSegment(
+    uint32_t* line, int y, int x0, int x1, Layer* const* band, uint64_t cover) {
+    const int width = x1 - x0;
+
+    // 上から見て最初に区間を覆う不透明なレイヤーを探す。それより下のレイヤーは見えない
+    int base = -1;
+    for (uint64_t mask = cover; mask != 0; mask &= ~(uint64_t {1} << (63 - __builtin_clzll(mask)))) {
+        const int i = 63 - __builtin_clzll(mask);
+        const Layer& layer = *band[i];
+        if (layer.blend_ == Layer::Blend::kOpaque
+            || (layer.blend_ == Layer::Blend::kConstantAlpha && layer.alpha_ >= 256))
+        {
+            base = i;
+            break;
+        }
+    }
+
+    auto src = [&](const Layer& layer) {
+        return layer.Row(y - layer.y_) + (x0 - layer.x_);
+    };
+    if (base >= 0) {
+        const uint64_t below = cover & ((uint64_t {1} << base) - 1);
+        stats_.pixels_culled += static_cast<uint64_t>(width) * __builtin_popcountll(below);
+        std::copy_n(src(*band[base]), width, line);
+        stats_.pixels_copied += width;
+    } else {
+        std::fill_n(line, width, background_);
+    }
+
+    // 不透明なレイヤーより上にあるのは半透明のレイヤーだけ
+    const uint64_t above = base >= 0 ? cover & ~(~uint64_t {0} >> (63 - base)) : cover;
+    for (uint64_t mask = above; mask != 0; mask &= mask - 1) {
+        const Layer& layer = *band[__builtin_ctzll(mask)];
+        if (layer.blend_ == Layer::Blend::kPerPixelAlpha) {
+            BlendAlphaPixels32(line, src(layer), width);
+        } else if (layer.alpha_ > 0) {
+            BlendPixels32(line, src(layer), width, layer.alpha_);
+        } else {
+            continue;
+        }
+        stats_.pixels_blended += width;
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "frame_buffer_config.hpp"
+#include "graphics.hpp"
+#include "shadow_buffer.hpp"
+
+/**
+ * 画面に重ねて表示する長方形の画像 (ウィンドウなど)
+ * 画面と同じピクセル形式の32ビットの画像を自分で持ち、位置と重ね方を指定して合成される。
+ *
+ * - kOpaque: 不透明。下にあるレイヤーを完全に隠す
+ * - kConstantAlpha: レイヤー全体を同じ不透明度 (Alpha, 0-256) で重ねる
+ * - kPerPixelAlpha: 各ピクセルのバイト3を不透明度 (0-255) として重ねる
+ **/
+class Layer {
+public:
+    enum class Blend
+    {
+        kOpaque,
+        kConstantAlpha,
+        kPerPixelAlpha,
+    };
+
+    Layer(unsigned int id, int width, int height, PixelFormat format, Blend blend, uint32_t* buffer);
+
+    unsigned int ID() const {
+        return id_;
+    }
+    Blend BlendMode() const {
+        return blend_;
+    }
+    unsigned int Alpha() const {
+        return alpha_;
+    }
+    // 画面上の位置と大きさ
+    Rectangle Area() const {
+        return {x_,
+            y_,
+            static_cast<int>(config_.horizontal_resolution),
+            static_cast<int>(config_.vertical_resolution)};
+    }
+    bool Shown() const {
+        return shown_;
+    }
+
+    /**
+     * レイヤーの画像を描画先とする FrameBufferConfig
+     * DispatchPixelFormat などに渡して描画できる。描画した後は LayerManager::Invalidate を呼ぶこと
+     **/
+    const FrameBufferConfig& Config() const {
+        return config_;
+    }
+    const uint32_t* Row(int y) const {
+        return buffer_ + config_.pixels_per_scan_line * y;
+    }
+
+    // レイヤーの座標で矩形を塗る。kPerPixelAlpha のレイヤーでは c.a を不透明度として書き込む
+    void FillRect(Rectangle area, const PixelColor& c);
+
+private:
+    friend class LayerManager;
+
+    const unsigned int id_;
+    const Blend blend_;
+    unsigned int alpha_;
+    int x_, y_;
+    bool shown_;
+    uint32_t* const buffer_;
+    FrameBufferConfig config_;
+};
+
+/**
+ * レイヤーを重ね合わせて画面 (影のバッファ) に描く
+ * レイヤーの移動や再描画で変化した画面の領域 (ダメージ) だけを Compose で描き直す。
+ *
+ * 描き直す矩形は、レイヤーの上下の端で横長の帯に分け、帯の中をさらにレイヤーの左右の端で区間に分ける。
+ * 1つの区間は各レイヤーに完全に覆われているか、全く覆われていないかのどちらかになるので、
+ * 区間ごとに上から見て最初に区間を覆う不透明なレイヤーより下のレイヤーは描かない (隠面の除去)。
+ * 合成はキャッシュに載る1行分の作業領域で行い、出来上がった行だけを画面へ書き込む。
+ **/
+class LayerManager {
+public:
+    // 区間を覆うレイヤーを uint64_t のビットマスクで表すので、64 を超えてはいけない
+    static const int kMaxLayers = 64;
+    // 作業領域の大きさ。これより幅の広い画面では、行を分けて合成する
+    static const int kMaxLineWidth = 4096;
+
+    struct Stats {
+        // 画面へ書き込んだピクセル数
+        uint64_t pixels_composed;
+        // レイヤーからコピーしたピクセル数と、重ね合わせたピクセル数
+        uint64_t pixels_copied, pixels_blended;
+        // 不透明なレイヤーに隠れていたため読まなかったレイヤーのピクセル数
+        uint64_t pixels_culled;
+    };
+
+    /**
+     * screen に合成した結果を描き、tracker (影のバッファ) に描いた領域を通知する
+     * どのレイヤーにも覆われていない場所は background で塗る
+     **/
+    LayerManager(const FrameBufferConfig& screen, DamageTracker* tracker, const PixelColor& background);
+
+    /**
+     * width x height のレイヤーを生成し、一番上に置く
+     * 画像の領域はヒープから確保する。確保できなければ nullptr を返す
+     * 生成したレイヤーは非表示で、Move で位置を決めると表示される
+     **/
+    Layer* NewLayer(int width, int height, Layer::Blend blend);
+
+    void Move(Layer& layer, int x, int y);
+    void SetAlpha(Layer& layer, unsigned int alpha);
+    void RaiseToTop(Layer& layer);
+    // レイヤーの座標で area を描き直したことを通知する
+    void Invalidate(const Layer& layer, Rectangle area);
+    // 画面全体を描き直す
+    void InvalidateAll();
+
+    // ダメージのある領域を合成して画面に描く
+    void Compose();
+
+    Stats TakeStats();
+
+private:
+    void MarkDamaged(const Rectangle& area);
+    void ComposeRect(const Rectangle& area);
+    /**
+     * 行 y の [x0, x1) を作業領域 line に合成する
+     * band は帯に掛かるレイヤー (下から順) で、cover はそのうち区間を覆うレイヤーのビットマスク
+     **/
+    void ComposeSegment(
+        uint32_t* line, int y, int x0, int x1, Layer* const* band, uint64_t cover);
+
+    const FrameBufferConfig& screen_;
+    DamageTracker* const tracker_;
+    uint32_t background_;
+
+    Layer* layers_[kMaxLayers];  // 下から順
+    int num_layers_;
+    unsigned int next_id_;
+
+    DirtyRegion damage_;
+    Stats stats_;
+    alignas(32) uint32_t line_[kMaxLineWidth];
+};
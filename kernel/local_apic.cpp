@@ -0,0 +1,21 @@
+#include "local_apic.hpp"
+
+#include "interrupt.hpp"
+
+namespace {
+    uintptr_t lapic_base = 0xfee00000;
+}
+
+void SetLocalAPICBase(uintptr_t base) {
+    lapic_base = base;
+}
+
+volatile uint32_t& LocalAPICRegister(uint32_t offset) {
+    return *reinterpret_cast<volatile uint32_t*>(lapic_base + offset);
+}
+
+void EnableLocalAPIC() {
+    // bit 8: APIC Software Enable
+    auto& svr = LocalAPICRegister(kLAPICRegisterSVR);
+    svr = (svr & ~0xffu) | 0x100 | InterruptVector::kSpurious;
+}
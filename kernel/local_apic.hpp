@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Local APIC のレジスタ (xAPIC モードのメモリマップト I/O)
+ * ベースアドレスは MADT から得るが、設定されるまでは既定値 0xfee00000 を使う
+ **/
+const uint32_t kLAPICRegisterID = 0x20;
+const uint32_t kLAPICRegisterEOI = 0xb0;
+const uint32_t kLAPICRegisterSVR = 0xf0;
+const uint32_t kLAPICRegisterICRLow = 0x300;
+const uint32_t kLAPICRegisterICRHigh = 0x310;
+const uint32_t kLAPICRegisterLVTTimer = 0x320;
+const uint32_t kLAPICRegisterInitialCount = 0x380;
+const uint32_t kLAPICRegisterCurrentCount = 0x390;
+const uint32_t kLAPICRegisterDivideConfig = 0x3e0;
+
+void SetLocalAPICBase(uintptr_t base);
+volatile uint32_t& LocalAPICRegister(uint32_t offset);
+
+// SVR でこの CPU の Local APIC を有効にし、スプリアス割り込みのベクタを設定する
+void EnableLocalAPIC();
+
+// 割り込みの処理が終わったことを Local APIC に通知する
+inline void NotifyEndOfInterrupt() {
+    LocalAPICRegister(kLAPICRegisterEOI) = 0;
+}
@@ -1,101 +1,720 @@
+#include <cstdarg>
 #include <cstddef>
 #include <cstdint>
+#include <new>
+#include "acpi.hpp"
+#include "asmfunc.h"
+#include "boot_trace.hpp"
+#include "console.hpp"
+#include "cpu.hpp"
+#include "format.hpp"
 #include "frame_buffer_config.hpp"
+#include "graphics.hpp"
+#include "heap.hpp"
+#include "image.hpp"
+#include "initrd.hpp"
+#include "interrupt.hpp"
+#include "memory_manager.hpp"
+#include "memory_map.hpp"
+#include "paging.hpp"
+#include "parallel.hpp"
+#include "parallel_graphics.hpp"
+#include "pci.hpp"
+#include "pixel_bitmask.hpp"
+#include "presenter.hpp"
+#include "rasterizer.hpp"
+#include "segment.hpp"
+#include "serial.hpp"
+#include "shadow_buffer.hpp"
+#include "snapshot.hpp"
+#include "simd.hpp"
+#include "smp.hpp"
+#include "task.hpp"
+#include "timer.hpp"
+#include "trace.hpp"
 
-struct PixelColor {
-    uint8_t r, g, b;
-};
+/**
+ * グローバルな new / delete はカーネルのヒープを使う
+ * 例外は使わないので、通常の new は確保に失敗するとカーネルを停止する (nullptr は返さない)。
+ * 失敗し得る確保は new (std::nothrow) で行い、nullptr を確かめること
+ **/
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return kernel_heap ? kernel_heap->Allocate(size) : nullptr;
+}
 
-class PixelWriter {
-public:
-    PixelWriter(const FrameBufferConfig& config) : config_ {config} {}
-    virtual ~PixelWriter() = default;
-    /**
-     * ピクセルを描画する関数
-     * =0 は純粋仮想関数でインターフェースを表現している
-     **/
-    virtual void Write(int x, int y, const PixelColor& c) = 0;
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return kernel_heap ? kernel_heap->Allocate(size) : nullptr;
+}
+
+[[noreturn]] void HaltOnBadAlloc() {
+    SerialWrite("operator new: out of kernel heap memory\n");
+    SerialFlush();
+    while (1)
+        __asm__("hlt");
+}
+
+void* operator new(size_t size) {
+    void* p = operator new(size, std::nothrow);
+    if (p == nullptr) HaltOnBadAlloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    void* p = operator new[](size, std::nothrow);
+    if (p == nullptr) HaltOnBadAlloc();
+    return p;
+}
+
+void operator delete(void* obj) noexcept {
+    if (kernel_heap) kernel_heap->Free(obj);
+}
+
+void operator delete[](void* obj) noexcept {
+    if (kernel_heap) kernel_heap->Free(obj);
+}
 
-protected:
-    uint8_t* PixelAt(int x, int y) {
-        return config_.frame_buffer + 4 * (config_.pixels_per_scan_line * y + x);
+void operator delete(void* obj, size_t) noexcept {
+    if (kernel_heap) kernel_heap->Free(obj);
+}
+
+void operator delete[](void* obj, size_t) noexcept {
+    if (kernel_heap) kernel_heap->Free(obj);
+}
+
+char pixel_writer_buf[sizeof(RGBResv8BitPerColorPixelWriter)];
+PixelWriter* pixel_writer;
+
+char shadow_buffer_buf[sizeof(ShadowBuffer)];
+ShadowBuffer* shadow_buffer;
+
+char presenter_buf[sizeof(FramePresenter)];
+FramePresenter* presenter;
+
+char console_buf[sizeof(Console)];
+Console* console;
+
+char snapshotter_buf[sizeof(Snapshotter)];
+Snapshotter* snapshotter;
+
+void FlushShadowBuffer() {
+    if (shadow_buffer) {
+        ScopedTrace trace {"ShadowFlush"};
+        shadow_buffer->Flush();
     }
+}
 
-private:
-    const FrameBufferConfig& config_;
-};
+/**
+ * コンソールとシリアルポートへ書式付きの文字列を出力する
+ * 影のバッファを使っている場合は、出力のたびに変更された領域を VRAM へ転送する
+ * フレーム単位の表示 (presenter) を始めた後は転送せず、次のフレームでまとめて表示する
+ **/
+int printk(const char* format, ...) {
+    va_list ap;
+    char s[1024];
 
-class RGBResv8BitPerColorPixelWriter : public PixelWriter {
-public:
-    // 親クラスのコンストラクタを利用する
-    using PixelWriter::PixelWriter;
-    virtual void Write(int x, int y, const PixelColor& c) override {
-        auto p = PixelAt(x, y);
-        p[0] = c.r;
-        p[1] = c.g;
-        p[2] = c.b;
+    va_start(ap, format);
+    const int result = VSNPrintf(s, sizeof(s), format, ap);
+    va_end(ap);
+
+    SerialWrite(s);
+    if (console) {
+        {
+            ScopedTrace trace {"printk"};
+            console->PutString(s);
+        }
+        if (!presenter) FlushShadowBuffer();
     }
+    return result;
+}
+
+/**
+ * 画面の更新を kFrameRate に合わせて行う
+ * フレームの期限ごとにタイマーから呼ばれ、画面下端の四角を動かしてフレームを表示 (Present) する。
+ * 1秒ごとにタイマー割り込みの遅延 (期限から割り込みハンドラに入るまで) と
+ * フレーム時間・表示にかかった時間をシリアルポートへ出力する:
+ *   timer,<frames>,<dropped>,<min_ns>,<avg_ns>,<max_ns>,<jitter_ns>
+ *   present,<frames>,<full_frames>,<min_us>,<avg_us>,<max_us>,<avg_cost_us>,<max_cost_us>,<bytes>
+ *   shadow,<bytes_drawn>,<bytes_flushed>,<flushes>  (起動からの累計)
+ * jitter_ns は最大と最小の差、present の min/avg/max はフレーム時間
+ * 同じく1秒ごとに、画面全体のスナップショット (前回との差分) を snap,... の行で出力する
+ **/
+const int kFrameRate = 60;
+const int kFrameBoxSize = 16;
+
+struct FramePacer {
+    uint64_t period;  // 1フレームの TSC のカウント数
+    uint64_t frames, dropped;
+    int box_x;
 };
 
-class BGRResv8BitPerColorPixelWriter : public PixelWriter {
-public:
-    using PixelWriter::PixelWriter;
-    virtual void Write(int x, int y, const PixelColor& c) override {
-        auto p = PixelAt(x, y);
-        p[0] = c.b;
-        p[1] = c.g;
-        p[2] = c.r;
+void OnFrame(void* context, uint64_t deadline) {
+    auto& pacer = *static_cast<FramePacer*>(context);
+    const int y = pixel_writer->Height() - kFrameBoxSize;
+    pixel_writer->FillRect(pacer.box_x, y, kFrameBoxSize, kFrameBoxSize, {255, 255, 255});
+    pacer.box_x = (pacer.box_x + 4) % (pixel_writer->Width() - kFrameBoxSize);
+    pixel_writer->FillRect(pacer.box_x, y, kFrameBoxSize, kFrameBoxSize, {0, 0, 255});
+    if (presenter) {
+        presenter->Present();
+    } else {
+        FlushShadowBuffer();
     }
-};
+    ++pacer.frames;
+
+    if (pacer.frames % kFrameRate == 0) {
+        if (snapshotter) {
+            snapshotter->Capture({0, 0, pixel_writer->Width(), pixel_writer->Height()});
+        }
+
+        const auto stats = timer_manager->TakeLatencyStats();
+        const uint64_t tsc_per_us = timer_manager->TSCPerMicrosecond();
+        auto to_ns = [tsc_per_us](uint64_t cycles) -> unsigned long long {
+            return cycles * 1000 / tsc_per_us;
+        };
+        if (stats.count > 0) {
+            char line[128];
+            SNPrintf(line,
+                sizeof(line),
+                "timer,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                static_cast<unsigned long long>(pacer.frames),
+                static_cast<unsigned long long>(pacer.dropped),
+                to_ns(stats.min_cycles),
+                to_ns(stats.total_cycles / stats.count),
+                to_ns(stats.max_cycles),
+                to_ns(stats.max_cycles - stats.min_cycles));
+            SerialWrite(line);
+        }
+
+        const auto present = presenter ? presenter->TakeStats() : FramePresenter::Stats {};
+        if (present.intervals > 0) {
+            char line[160];
+            SNPrintf(line,
+                sizeof(line),
+                "present,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                static_cast<unsigned long long>(present.frames),
+                static_cast<unsigned long long>(present.full_frames),
+                to_ns(present.min_interval) / 1000,
+                to_ns(present.total_interval / present.intervals) / 1000,
+                to_ns(present.max_interval) / 1000,
+                to_ns(present.total_cost / present.frames) / 1000,
+                to_ns(present.max_cost) / 1000,
+                static_cast<unsigned long long>(present.bytes_presented));
+            SerialWrite(line);
+        }
+
+        if (shadow_buffer) {
+            const auto& shadow = shadow_buffer->GetStats();
+            char line[96];
+            SNPrintf(line,
+                sizeof(line),
+                "shadow,%llu,%llu,%llu\n",
+                static_cast<unsigned long long>(shadow.bytes_drawn),
+                static_cast<unsigned long long>(shadow.bytes_flushed),
+                static_cast<unsigned long long>(shadow.num_flushes));
+            SerialWrite(line);
+        }
+    }
+
+    // 描画が間に合わずに期限を過ぎたフレームは飛ばし、期限は元の間隔のまま保つ
+    uint64_t next = deadline + pacer.period;
+    const uint64_t now = ReadTSC();
+    while (next <= now) {
+        next += pacer.period;
+        ++pacer.dropped;
+    }
+    timer_manager->ScheduleAt(next, OnFrame, context);
+}
 
 /**
- * 配置 new
- * 配列でメモリ確保を行う仕組みを用いて、メモリ領域を確保し、
- * そのメモリ領域にクラスインスタンスを生成する方法。
+ * シリアルポートの送信 FIFO (16 バイト) が空くまでの時間 (115200 bps で約 1.4ms)
+ * 送るログが残っている間は、この間隔でタイマーに起こしてもらって送信を続ける
  **/
-void* operator new(size_t size, void* buf) {
-    return buf;
+const uint64_t kSerialDrainMicroseconds = 1400;
+bool serial_drain_scheduled;
+
+void OnSerialDrain(void*, uint64_t) {
+    serial_drain_scheduled = false;
 }
 
+#ifdef BOOT_BENCHMARKS
 /**
- * PixelWriterのデストラクタがdelete演算子を要求するために記述しておく
+ * タスク切り替えの性能を測るためのタスク
+ * PingTask はメインのタスクと交互に Yield し合い、stop が立ったら終了する。
+ * BandTask は画面の帯 [y_begin, y_end) を kTaskBandRows 行ずつ塗っては Yield する。
  **/
-void operator delete(void* obj) noexcept {}
+const int kTaskBandRows = 8;
+const int kMaxBandTasks = 16;
 
-char pixel_writer_buf[sizeof(RGBResv8BitPerColorPixelWriter)];
-PixelWriter* pixel_writer;
+void PingTask(uint64_t, void* data) {
+    auto& stop = *static_cast<volatile bool*>(data);
+    while (!stop) {
+        task_manager->Yield();
+    }
+}
+
+struct BandJob {
+    const FrameBufferConfig* config;
+    int y_begin, y_end;
+    PixelColor color;
+    volatile int* remaining;
+};
+
+void BandTask(uint64_t, void* data) {
+    auto& job = *static_cast<BandJob*>(data);
+    for (int y = job.y_begin; y < job.y_end; y += kTaskBandRows) {
+        const int rows = job.y_end - y < kTaskBandRows ? job.y_end - y : kTaskBandRows;
+        DispatchPixelFormat(*job.config, [&](auto& writer) {
+            writer.FillRect(0, y, writer.Width(), rows, job.color);
+        });
+        task_manager->Yield();
+    }
+    --*job.remaining;
+}
+
+// num_tasks 個のタスクで画面を帯に分けて塗り、全て終わるまでの TSC のカウント数を返す
+uint64_t RunBandTasks(const FrameBufferConfig& config, int num_tasks) {
+    BandJob jobs[kMaxBandTasks];
+    volatile int remaining = 0;
+    const int height = config.vertical_resolution;
+
+    const uint64_t start = ReadTSC();
+    for (int i = 0; i < num_tasks; ++i) {
+        jobs[i] = {&config,
+            height * i / num_tasks,
+            height * (i + 1) / num_tasks,
+            {static_cast<uint8_t>(255 * i / num_tasks), 255, 255},
+            &remaining};
+        if (task_manager->NewTask(BandTask, &jobs[i])) {
+            ++remaining;
+        }
+    }
+    while (remaining > 0) {
+        task_manager->Yield();
+    }
+    return ReadTSC() - start;
+}
+#endif
+
+// カーネルのスタック。エントリポイント KernelMain (asmfunc.asm) がこの領域に切り替える
+alignas(16) uint8_t kernel_main_stack[1024 * 1024];
+
+extern "C" void KernelMainNewStack(const FrameBufferConfig& frame_buffer_config_ref,
+    const MemoryMap& memory_map_ref,
+    const BootTrace& boot_trace_ref,
+    const acpi::RSDP* acpi_table,
+    const void* initrd_base,
+    uint64_t initrd_size) {
+    // 引数はブートローダのスタック上にあり、その領域は後で再利用されるのでコピーしておく
+    FrameBufferConfig frame_buffer_config {frame_buffer_config_ref};
+    MemoryMap memory_map {memory_map_ref};
+    const uint64_t loader_tsc_per_us = boot_trace_ref.tsc_per_us;
+    InitializeTrace(boot_trace_ref);
+    InitializeSerial();
+
+    // SIMD 命令を使う前に CPU の状態を設定し、使える命令セットのカーネルを選ぶ
+    EnableSIMDState();
+    SelectPixelKernels();
+
+    // UEFI の GDT とページテーブルを、カーネルが管理する領域のものに置き換える
+    {
+        ScopedTrace trace {"SetupSegmentsAndPaging"};
+        SetupSegments();
+        SetDSAll(kKernelDS);
+        SetCSSS(kKernelCS, kKernelSS);
+        SetupIdentityPageTable();
+    }
+
+    /**
+     * フレームバッファを Write-Combining にする
+     * BOOT_BENCHMARKS のときは効果を確かめるため、
+     * 設定の前後で VRAM 全体の塗りつぶしにかかる時間を計測する
+     * (kPixelBitMask の VRAM には直接描画しないので、塗りつぶしは行われない)
+     **/
+#ifdef BOOT_BENCHMARKS
+    auto fill_vram = [&frame_buffer_config](const char* name) {
+        const uint64_t start = ReadTSC();
+        DispatchPixelFormat(frame_buffer_config, [&](auto& writer) {
+            writer.FillRect(0,
+                0,
+                frame_buffer_config.horizontal_resolution,
+                frame_buffer_config.vertical_resolution,
+                {255, 255, 255});
+        });
+        const uint64_t end = ReadTSC();
+        RecordTrace(name, start, end);
+        return end - start;
+    };
+    const uint64_t fill_cycles_default = fill_vram("FillVRAM(default)");
+#endif
+    const size_t frame_buffer_bytes = size_t {1} * BytesPerPixel(frame_buffer_config)
+        * frame_buffer_config.pixels_per_scan_line * frame_buffer_config.vertical_resolution;
+    const auto wc_error = SetWriteCombining(
+        reinterpret_cast<uintptr_t>(frame_buffer_config.frame_buffer), frame_buffer_bytes);
+#ifdef BOOT_BENCHMARKS
+    const uint64_t fill_cycles_wc = fill_vram("FillVRAM(WC)");
+#endif
+
+    {
+        ScopedTrace trace {"InitializeMemoryManager"};
+        InitializeMemoryManager(memory_map);
+    }
+    {
+        ScopedTrace trace {"InitializeHeap"};
+        if (auto err = InitializeHeap(*memory_manager)) {
+            // ヒープが無いと new が使えないので、これ以上は進めない
+            SerialWrite("failed to initialize the kernel heap\n");
+            SerialFlush();
+            while (1)
+                __asm__("hlt");
+        }
+    }
+
+    // ローダが読み込んだ初期 RAM ディスクの索引を作る。ファイルの内容はその場所のまま参照する
+    Error initrd_error = MAKE_ERROR(Error::kSuccess);
+    uint64_t initrd_index_cycles = 0;
+    {
+        ScopedTrace trace {"InitializeInitrd"};
+        const uint64_t start = ReadTSC();
+        initrd_error = InitializeInitrd(initrd_base, initrd_size);
+        initrd_index_cycles = ReadTSC() - start;
+    }
+
+    // ACPI の MADT に記載された AP を起動する。AP のスタックはメモリ管理から確保する
+    Error smp_error = MAKE_ERROR(Error::kSuccess);
+    {
+        ScopedTrace trace {"StartAPs"};
+        smp_error = acpi::Initialize(acpi_table);
+        if (!smp_error) {
+            smp_error = StartApplicationProcessors();
+        }
+    }
+
+    // 割り込みを受け付け、Local APIC タイマーを較正する。PM タイマーを使うので ACPI の後に行う
+    Error timer_error = MAKE_ERROR(Error::kSuccess);
+    {
+        ScopedTrace trace {"InitializeTimer"};
+        InitializeInterrupt();
+        timer_error = InitializeLAPICTimer(loader_tsc_per_us);
+    }
+    __asm__ volatile("sti");
+
+    // PCI の機能を列挙して表にする。MCFG があれば ECAM を、無ければ I/O ポートを使う
+    Error pci_error = MAKE_ERROR(Error::kSuccess);
+    uint64_t pci_cycles = 0;
+    {
+        ScopedTrace trace {"EnumeratePCI"};
+        const uint64_t start = ReadTSC();
+        pci_error = pci::Initialize(acpi::mcfg);
+        pci_cycles = ReadTSC() - start;
+    }
+
+    /**
+     * RAM 上に影のフレームバッファを確保できたら、描画は影のバッファに対して行い、
+     * 変更のあった領域だけを Flush で VRAM へ転送する
+     **/
+    const FrameBufferConfig* draw_config = &frame_buffer_config;
+    DamageTracker* tracker = nullptr;
+    const size_t shadow_frames
+        = (ShadowBuffer::BytesRequired(frame_buffer_config) + kBytesPerFrame - 1) / kBytesPerFrame;
+    const auto shadow_frame = memory_manager->AllocateFrames(shadow_frames);
+    if (!shadow_frame.error) {
+        shadow_buffer = new (shadow_buffer_buf) ShadowBuffer {
+            frame_buffer_config, reinterpret_cast<uint8_t*>(shadow_frame.value.Frame())};
+        draw_config = &shadow_buffer->Config();
+        tracker = shadow_buffer;
+    } else if (frame_buffer_config.pixel_format == kPixelBitMask) {
+        // PixelBitMask の VRAM へは影のバッファを介してしか描画できない
+        SerialWrite("failed to allocate the shadow buffer for a PixelBitMask frame buffer\n");
+        SerialFlush();
+        while (1)
+            __asm__("hlt");
+    }
 
-extern "C" void KernelMain(const FrameBufferConfig& frame_buffer_config) {
     /**
      * pixel_formatに基づいて適する方のクラスのインスタンスを生成する
      * ことで、切り替える
+     * 描画先は影のバッファなので、その形式 (VRAM が PixelBitMask なら BGR) を見る
      **/
 
-    switch (frame_buffer_config.pixel_format) {
+    switch (draw_config->pixel_format) {
         case kPixelRGBResv8BitPerColor:
             pixel_writer
-                = new (pixel_writer_buf) RGBResv8BitPerColorPixelWriter {frame_buffer_config};
+                = new (pixel_writer_buf) RGBResv8BitPerColorPixelWriter {*draw_config, tracker};
             break;
         case kPixelBGRResv8BitPerColor:
             pixel_writer
-                = new (pixel_writer_buf) BGRResv8BitPerColorPixelWriter {frame_buffer_config};
+                = new (pixel_writer_buf) BGRResv8BitPerColorPixelWriter {*draw_config, tracker};
             break;
+        case kPixelBitMask: break;
     }
 
-    // 画面全体を白で塗りつぶす
-    for (int x = 0; x < frame_buffer_config.horizontal_resolution; x++) {
-        for (int y = 0; y < frame_buffer_config.vertical_resolution; y++) {
-            pixel_writer->Write(x, y, {255, 255, 255});
+    const Rectangle screen {0,
+        0,
+        static_cast<int>(frame_buffer_config.horizontal_resolution),
+        static_cast<int>(frame_buffer_config.vertical_resolution)};
+
+#ifdef BOOT_BENCHMARKS
+    /**
+     * 使う CPU の数を変えながら、画面全体の塗りつぶし (影のバッファ) と
+     * 影のバッファから VRAM への転送を走査線の帯に分けて実行し、かかった時間を比べる
+     * 結果はコンソールの準備ができてから "smp,<CPU 数>,<塗りつぶし>,<転送>" の形式で出力する
+     **/
+    uint64_t smp_fill_cycles[kMaxCPUs], smp_blit_cycles[kMaxCPUs];
+    for (int n = 1; n <= CPUCount(); ++n) {
+        SetActiveWorkers(n);
+        const uint64_t fill_start = ReadTSC();
+        ParallelFillRect(*draw_config, screen, {255, 255, 255});
+        const uint64_t fill_end = ReadTSC();
+        if (shadow_buffer) {
+            ParallelBlit(
+                frame_buffer_config, *draw_config, screen, nullptr, shadow_buffer->Converter());
         }
+        smp_fill_cycles[n - 1] = fill_end - fill_start;
+        smp_blit_cycles[n - 1] = ReadTSC() - fill_end;
     }
+    SetActiveWorkers(CPUCount());
+#endif
 
-    // 緑色の四角を描画する
-    for (int x = 0; x < 200; x++) {
-        for (int y = 0; y < 100; y++) {
-            pixel_writer->Write(x, y, {0, 255, 0});
+    InitializeTask();
+#ifdef BOOT_BENCHMARKS
+    /**
+     * タスク切り替え1回にかかる TSC のカウント数と、帯を塗るタスクの数を変えたときの全体の時間を測る
+     * 結果はコンソールの準備ができてから "task,..." の形式で出力する
+     **/
+    const int kPingRounds = 100000;
+    bool ping_stop = false;
+    uint64_t switch_cycles = 0;
+    if (task_manager->NewTask(PingTask, &ping_stop)) {
+        task_manager->Yield();
+        const uint64_t start = ReadTSC();
+        for (int i = 0; i < kPingRounds; ++i) {
+            task_manager->Yield();
         }
+        // 1回の Yield でピンのタスクへ行って戻るので、切り替えは2回
+        switch_cycles = (ReadTSC() - start) / (2 * kPingRounds);
+        ping_stop = true;
+        task_manager->Yield();
+    }
+    const int band_task_counts[] = {1, 2, 4, 8, kMaxBandTasks};
+    const size_t num_band_runs = sizeof(band_task_counts) / sizeof(band_task_counts[0]);
+    uint64_t band_cycles[num_band_runs], band_switches[num_band_runs];
+    for (size_t i = 0; i < num_band_runs; ++i) {
+        const uint64_t switches = task_manager->NumSwitches();
+        band_cycles[i] = RunBandTasks(*draw_config, band_task_counts[i]);
+        band_switches[i] = task_manager->NumSwitches() - switches;
     }
+#endif
 
-    while (1)
-        __asm__("hlt");
-}
\ No newline at end of file
+    /**
+     * 画面全体を白で塗りつぶし、緑色の四角を描画する
+     * ピクセル形式の分岐はこのまとまりの先頭で1回だけ行い、
+     * 内側のループは形式ごとに実体化された BasicPixelWriter でインライン展開される
+     **/
+    DispatchPixelFormat(
+        *draw_config,
+        [&](auto& writer) {
+            {
+                ScopedTrace trace {"ClearScreen"};
+                writer.FillRect(0,
+                    0,
+                    frame_buffer_config.horizontal_resolution,
+                    frame_buffer_config.vertical_resolution,
+                    {255, 255, 255});
+            }
+            ScopedTrace trace {"FillRect"};
+            writer.FillRect(0, 0, 200, 100, {0, 255, 0});
+        },
+        tracker);
+    {
+        // 緑色の四角の右に、線・円・星形を描く。画面からはみ出す部分はクリップされる
+        ScopedTrace trace {"Rasterize"};
+        const Point star[] = {{300, 0}, {312, 36}, {350, 36}, {319, 58}, {331, 95}, {300, 72},
+            {269, 95}, {281, 58}, {250, 36}, {288, 36}};
+        DrawLine(*draw_config, screen, {200, 100}, {250, 0}, {0, 0, 0}, tracker);
+        FillCircle(*draw_config, screen, {400, 50}, 45, {255, 0, 0}, tracker);
+        DrawCircle(*draw_config, screen, {400, 50}, 48, {0, 0, 0}, tracker);
+        FillPolygon(*draw_config, screen, star, 10, {0, 0, 255}, tracker);
+    }
+
+    /**
+     * 初期 RAM ディスクに起動画面の画像 (splash.qoi か splash.bmp) があれば、画面の右下に描く
+     * 画像はアーカイブの中から直接読み、行ごとにフレームバッファの形式へ変換しながら書き込む
+     **/
+    const InitrdFile* splash = nullptr;
+    WithError<ImageInfo> splash_info {{}, MAKE_ERROR(Error::kSuccess)};
+    Error splash_error = MAKE_ERROR(Error::kSuccess);
+    uint64_t splash_cycles = 0;
+    if (initrd) {
+        splash = initrd->Find("splash.qoi");
+        if (!splash) splash = initrd->Find("splash.bmp");
+    }
+    if (splash) {
+        ScopedTrace trace {"DrawSplash"};
+        splash_info = ReadImageInfo(splash->data, splash->size);
+        splash_error = splash_info.error;
+        if (!splash_error) {
+            const Point pos {screen.width - splash_info.value.width,
+                screen.height - splash_info.value.height};
+            const uint64_t start = ReadTSC();
+            splash_error = DrawImage(*draw_config, screen, pos, splash->data, splash->size, tracker);
+            splash_cycles = ReadTSC() - start;
+        }
+    }
+    FlushShadowBuffer();
+
+    console = new (console_buf) Console {*pixel_writer, {0, 0, 0}, {255, 255, 255}};
+    printk("Welcome to YuyuOS!\n");
+    printk("pixel kernels: %s\n", pixel_kernels.name);
+    const uint64_t frame_bytes = uint64_t {1} * BytesPerPixel(frame_buffer_config)
+        * frame_buffer_config.pixels_per_scan_line * frame_buffer_config.vertical_resolution;
+    printk("display: %ux%u, %d bytes/pixel, %llu bytes of VRAM (%llu frames)\n",
+        frame_buffer_config.horizontal_resolution,
+        frame_buffer_config.vertical_resolution,
+        BytesPerPixel(frame_buffer_config),
+        static_cast<unsigned long long>(frame_buffer_config.frame_buffer_size),
+        static_cast<unsigned long long>(frame_buffer_config.frame_buffer_size / frame_bytes));
+
+    const auto mem_stats = memory_manager->GetStats();
+    printk("memory: %zu / %zu frames allocated, largest free run %zu frames\n",
+        mem_stats.allocated_frames,
+        mem_stats.total_frames,
+        mem_stats.largest_free_run);
+    const auto heap_stats = kernel_heap->GetStats();
+    printk("heap: %zu bytes in use, %zu bytes reserved\n",
+        heap_stats.bytes_in_use,
+        heap_stats.bytes_reserved);
+
+    if (initrd_error) {
+        printk("initrd: %s at %s:%d\n", initrd_error.Name(), initrd_error.File(), initrd_error.Line());
+    } else if (initrd) {
+        printk("initrd: %zu files, %zu bytes, indexed in %llu cycles\n",
+            initrd->Count(),
+            initrd->Bytes(),
+            static_cast<unsigned long long>(initrd_index_cycles));
+    }
+
+    if (splash_error) {
+        printk("splash: %s at %s:%d\n", splash_error.Name(), splash_error.File(), splash_error.Line());
+    } else if (splash) {
+        printk("splash: %dx%d, %zu bytes decoded in %llu cycles\n",
+            splash_info.value.width,
+            splash_info.value.height,
+            splash->size,
+            static_cast<unsigned long long>(splash_cycles));
+    }
+
+    if (pci_error) {
+        printk("pci: %s at %s:%d\n", pci_error.Name(), pci_error.File(), pci_error.Line());
+    }
+    const auto pci_stats = pci::GetStats();
+    printk("pci: %zu functions on %d buses via %s, %zu config reads in %llu cycles\n",
+        pci::Devices().Count(),
+        pci_stats.buses_scanned,
+        pci_stats.access == pci::kAccessECAM ? "ECAM" : "port I/O",
+        pci_stats.config_reads,
+        static_cast<unsigned long long>(pci_cycles));
+    for (const auto& dev : pci::Devices()) {
+        printk("pci: %02x:%02x.%d %04x:%04x class %06x\n",
+            dev.bus,
+            dev.device,
+            dev.function,
+            dev.vendor_id,
+            dev.device_id,
+            dev.class_code);
+    }
+
+    if (wc_error) {
+        printk("write-combining: %s at %s:%d\n", wc_error.Name(), wc_error.File(), wc_error.Line());
+    }
+#ifdef BOOT_BENCHMARKS
+    printk("VRAM fill: %llu cycles before WC, %llu cycles after\n",
+        static_cast<unsigned long long>(fill_cycles_default),
+        static_cast<unsigned long long>(fill_cycles_wc));
+#endif
+
+    if (smp_error) {
+        printk("smp: %s at %s:%d\n", smp_error.Name(), smp_error.File(), smp_error.Line());
+    }
+    printk("smp: %d CPUs\n", CPUCount());
+
+#ifdef BOOT_BENCHMARKS
+    for (int n = 1; n <= CPUCount(); ++n) {
+        printk("smp,%d,%llu,%llu\n",
+            n,
+            static_cast<unsigned long long>(smp_fill_cycles[n - 1]),
+            static_cast<unsigned long long>(smp_blit_cycles[n - 1]));
+    }
+
+    printk("task,switch,%llu\n", static_cast<unsigned long long>(switch_cycles));
+    for (size_t i = 0; i < num_band_runs; ++i) {
+        printk("task,bands,%d,%llu,%llu\n",
+            band_task_counts[i],
+            static_cast<unsigned long long>(band_cycles[i]),
+            static_cast<unsigned long long>(band_switches[i]));
+    }
+#endif
+
+    if (timer_error) {
+        printk("timer: %s at %s:%d\n", timer_error.Name(), timer_error.File(), timer_error.Line());
+    } else {
+        printk("timer: %llu MHz TSC, %s mode\n",
+            static_cast<unsigned long long>(timer_manager->TSCPerMicrosecond()),
+            timer_manager->UsesTSCDeadline() ? "tsc-deadline" : "one-shot");
+    }
+
+    PrintTrace();
+
+    if (timer_error) {
+        // タイマーが使えなければ、停止する前にリングバッファに溜まったログをポーリングで送り切る
+        SerialFlush();
+        while (1)
+            __asm__("hlt");
+    }
+
+    if (shadow_buffer) {
+        presenter = new (presenter_buf) FramePresenter {*shadow_buffer, frame_buffer_config};
+    }
+
+#ifdef SERIAL_SNAPSHOTS
+    /**
+     * 起動時の画面をキーフレームとしてシリアルポートへ書き出す
+     * 以降は OnFrame が1秒ごとに差分を書き出す。tools/snapshot2png.py でログから PNG に戻せる
+     * キーフレームは 1080p で 200KiB を超え、115200 bps では送り終えるのに20秒ほどかかるので、
+     * make CPPFLAGS=-DSERIAL_SNAPSHOTS でビルドしたときだけ行う
+     **/
+    const size_t snapshot_frames
+        = (Snapshotter::BytesRequired(*draw_config) + kBytesPerFrame - 1) / kBytesPerFrame;
+    const auto snapshot_frame = memory_manager->AllocateFrames(snapshot_frames);
+    if (!snapshot_frame.error) {
+        snapshotter = new (snapshotter_buf) Snapshotter {
+            *draw_config, reinterpret_cast<uint8_t*>(snapshot_frame.value.Frame()), SerialWrite};
+        snapshotter->Capture({0, 0, pixel_writer->Width(), pixel_writer->Height()});
+    }
+#endif
+
+    FramePacer pacer {timer_manager->TSCPerMicrosecond() * 1000000 / kFrameRate, 0, 0, 0};
+    timer_manager->ScheduleAt(ReadTSC() + pacer.period, OnFrame, &pacer);
+
+    /**
+     * 周期的な割り込みは使わず、次のタイマーの期限まで hlt で眠る
+     * cli の後に期限切れを確認し、sti と hlt を続けて実行することで、
+     * 確認してから眠るまでの間に届いた割り込みで起きられなくなることを防ぐ
+     **/
+    while (true) {
+        timer_manager->RunExpired();
+
+        if (!serial_port->Empty()) {
+            serial_port->Drain();
+            if (!serial_port->Empty() && !serial_drain_scheduled) {
+                serial_drain_scheduled
+                    = timer_manager->ScheduleAfter(kSerialDrainMicroseconds, OnSerialDrain, nullptr);
+            }
+        }
+
+        __asm__ volatile("cli");
+        if (timer_manager->HasExpired()) {
+            __asm__ volatile("sti");
+            continue;
+        }
+        __asm__ volatile("sti\n\thlt");
+    }
+}
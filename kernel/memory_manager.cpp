@@ -0,0 +1,194 @@
+#include "memory_manager.hpp"
+
+#include <new>
+
+namespace {
+    alignas(BitmapMemoryManager) char memory_manager_buf[sizeof(BitmapMemoryManager)];
+}  // namespace
+
+BitmapMemoryManager* memory_manager;
+
+BitmapMemoryManager::BitmapMemoryManager() :
+    alloc_map_ {}, range_begin_ {FrameID {0}}, range_end_ {FrameID {kFrameCount}}, next_search_ {0} {}
+
+WithError<FrameID> BitmapMemoryManager::AllocateFrames(size_t num_frames) {
+    if (num_frames == 0) {
+        return {kNullFrame, MAKE_ERROR(Error::kInvalidParameter)};
+    }
+
+    // 前回確保した位置から探し、見つからなければ範囲の先頭から探し直す
+    size_t start = FindFreeRange(next_search_, range_end_.ID(), num_frames);
+    if (start == range_end_.ID()) {
+        const size_t wrap_end = next_search_ + num_frames - 1 < range_end_.ID()
+            ? next_search_ + num_frames - 1
+            : range_end_.ID();
+        start = FindFreeRange(range_begin_.ID(), wrap_end, num_frames);
+        if (start == wrap_end) {
+            return {kNullFrame, MAKE_ERROR(Error::kNoEnoughMemory)};
+        }
+    }
+
+    MarkAllocated(FrameID {start}, num_frames);
+    next_search_ = start + num_frames;
+    return {FrameID {start}, MAKE_ERROR(Error::kSuccess)};
+}
+
+WithError<FrameID> BitmapMemoryManager::AllocateFramesBelow(size_t num_frames, FrameID limit) {
+    if (num_frames == 0) {
+        return {kNullFrame, MAKE_ERROR(Error::kInvalidParameter)};
+    }
+
+    const size_t end = limit.ID() < range_end_.ID() ? limit.ID() : range_end_.ID();
+    const size_t start = FindFreeRange(range_begin_.ID(), end, num_frames);
+    if (start >= end) {
+        return {kNullFrame, MAKE_ERROR(Error::kNoEnoughMemory)};
+    }
+    MarkAllocated(FrameID {start}, num_frames);
+    return {FrameID {start}, MAKE_ERROR(Error::kSuccess)};
+}
+
+Error BitmapMemoryManager::FreeFrames(FrameID start_frame, size_t num_frames) {
+    if (start_frame.ID() < range_begin_.ID()
+        || start_frame.ID() + num_frames > range_end_.ID())
+    {
+        return MAKE_ERROR(Error::kIndexOutOfRange);
+    }
+    SetBits(start_frame.ID(), num_frames, false);
+    // 解放した領域が次の探索の開始位置より前にあれば、そこから再利用する
+    if (start_frame.ID() < next_search_) {
+        next_search_ = start_frame.ID();
+    }
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+void BitmapMemoryManager::MarkAllocated(FrameID start_frame, size_t num_frames) {
+    SetBits(start_frame.ID(), num_frames, true);
+}
+
+void BitmapMemoryManager::SetMemoryRange(FrameID range_begin, FrameID range_end) {
+    range_begin_ = range_begin;
+    range_end_ = range_end;
+    next_search_ = range_begin.ID();
+}
+
+BitmapMemoryManager::Stats BitmapMemoryManager::GetStats() const {
+    Stats stats {range_end_.ID() - range_begin_.ID(), 0, 0};
+    size_t frame = range_begin_.ID();
+    while (frame < range_end_.ID()) {
+        const size_t free_begin = FindFree(frame, range_end_.ID());
+        const size_t free_end = FindAllocated(free_begin, range_end_.ID());
+        stats.allocated_frames += free_begin - frame;
+        if (free_end - free_begin > stats.largest_free_run) {
+            stats.largest_free_run = free_end - free_begin;
+        }
+        frame = free_end;
+    }
+    return stats;
+}
+
+size_t BitmapMemoryManager::FindFreeRange(size_t begin, size_t end, size_t num_frames) const {
+    size_t frame = begin;
+    while (frame + num_frames <= end) {
+        const size_t free_begin = FindFree(frame, end);
+        if (free_begin + num_frames > end) break;
+        // 必要な長さの範囲に使用中のフレームが無ければ確保できる
+        const size_t allocated = FindAllocated(free_begin, free_begin + num_frames);
+        if (allocated == free_begin + num_frames) {
+            return free_begin;
+        }
+        frame = allocated + 1;
+    }
+    return end;
+}
+
+size_t BitmapMemoryManager::FindAllocated(size_t begin, size_t end) const {
+    size_t frame = begin;
+    while (frame < end) {
+        const auto line_index = frame / kBitsPerMapLine;
+        const auto bit_index = frame % kBitsPerMapLine;
+        // frame より前のビットは捨て、残りに使用中のビットがあれば最下位の位置を求める
+        const MapLineType line = alloc_map_[line_index] >> bit_index;
+        if (line != 0) {
+            const size_t found = frame + __builtin_ctzl(line);
+            return found < end ? found : end;
+        }
+        frame = (line_index + 1) * kBitsPerMapLine;
+    }
+    return end;
+}
+
+size_t BitmapMemoryManager::FindFree(size_t begin, size_t end) const {
+    size_t frame = begin;
+    while (frame < end) {
+        const auto line_index = frame / kBitsPerMapLine;
+        const auto bit_index = frame % kBitsPerMapLine;
+        // 反転すると空きビットが1になる。全て使用中のワードは0になり、まとめて読み飛ばせる
+        const MapLineType line = ~alloc_map_[line_index] >> bit_index;
+        if (line != 0) {
+            const size_t found = frame + __builtin_ctzl(line);
+            return found < end ? found : end;
+        }
+        frame = (line_index + 1) * kBitsPerMapLine;
+    }
+    return end;
+}
+
+void BitmapMemoryManager::SetBits(size_t start, size_t num_frames, bool allocated) {
+    size_t frame = start;
+    const size_t end = start + num_frames;
+    while (frame < end) {
+        const auto line_index = frame / kBitsPerMapLine;
+        const auto bit_index = frame % kBitsPerMapLine;
+        const size_t bits = end - frame < kBitsPerMapLine - bit_index
+            ? end - frame
+            : kBitsPerMapLine - bit_index;
+        const MapLineType mask = bits == kBitsPerMapLine
+            ? ~static_cast<MapLineType>(0)
+            : ((static_cast<MapLineType>(1) << bits) - 1) << bit_index;
+        if (allocated) {
+            alloc_map_[line_index] |= mask;
+        } else {
+            alloc_map_[line_index] &= ~mask;
+        }
+        frame += bits;
+    }
+}
+
+void InitializeMemoryManager(const MemoryMap& memory_map) {
+    ::memory_manager = new (memory_manager_buf) BitmapMemoryManager;
+
+    // ビットマップで扱えるのは kMaxPhysicalMemoryBytes まで。それより上の領域は無視する
+    const uintptr_t kMaxEnd = BitmapMemoryManager::kMaxPhysicalMemoryBytes;
+    auto mark_allocated = [kMaxEnd](uintptr_t begin, uintptr_t end) {
+        if (end > kMaxEnd) end = kMaxEnd;
+        if (begin < end) {
+            memory_manager->MarkAllocated(
+                FrameID {begin / kBytesPerFrame}, (end - begin) / kBytesPerFrame);
+        }
+    };
+
+    /**
+     * メモリマップを先頭から順に調べ、使用できない領域とディスクリプタの間の隙間を
+     * 使用中として登録する
+     **/
+    const auto memory_map_base = reinterpret_cast<uintptr_t>(memory_map.buffer);
+    uintptr_t available_end = 0;
+    for (uintptr_t iter = memory_map_base; iter < memory_map_base + memory_map.map_size;
+         iter += memory_map.descriptor_size)
+    {
+        auto desc = reinterpret_cast<const MemoryDescriptor*>(iter);
+        if (available_end < desc->physical_start) {
+            mark_allocated(available_end, desc->physical_start);
+        }
+
+        const auto physical_end = desc->physical_start + desc->number_of_pages * kUEFIPageSize;
+        if (IsAvailable(static_cast<MemoryType>(desc->type))) {
+            available_end = physical_end;
+        } else {
+            mark_allocated(desc->physical_start, physical_end);
+        }
+    }
+    if (available_end > kMaxEnd) available_end = kMaxEnd;
+    // フレーム0 (物理アドレス0) は nullptr と区別できないので使わない
+    memory_manager->SetMemoryRange(FrameID {1}, FrameID {available_end / kBytesPerFrame});
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "error.hpp"
+#include "memory_map.hpp"
+
+namespace {
+    constexpr unsigned long long operator""_KiB(unsigned long long kib) {
+        return kib * 1024;
+    }
+
+    constexpr unsigned long long operator""_MiB(unsigned long long mib) {
+        return mib * 1024_KiB;
+    }
+
+    constexpr unsigned long long operator""_GiB(unsigned long long gib) {
+        return gib * 1024_MiB;
+    }
+}  // namespace
+
+// 物理メモリフレーム1つの大きさ (バイト)
+static const auto kBytesPerFrame {4_KiB};
+
+class FrameID {
+public:
+    explicit FrameID(size_t id) : id_ {id} {}
+    size_t ID() const {
+        return id_;
+    }
+    void* Frame() const {
+        return reinterpret_cast<void*>(id_ * kBytesPerFrame);
+    }
+
+private:
+    size_t id_;
+};
+
+static const FrameID kNullFrame {std::numeric_limits<size_t>::max()};
+
+/**
+ * ビットマップを用いて物理メモリフレーム単位でメモリを管理するクラス
+ * 1ビットが1フレームに対応し、0 は空き、1 は使用中を表す。
+ *
+ * 空きフレームの探索は64ビットのワード単位で行う。
+ * 全て使用中のワードはまとめて読み飛ばし、空きビットや使用中ビットの位置は
+ * tzcnt / bsf (__builtin_ctzll) で1命令で求める。
+ * 探索は前回確保した領域の直後から始める (next fit) ので、
+ * 確保済みの領域を毎回先頭から走査し直すことはない。
+ **/
+class BitmapMemoryManager {
+public:
+    // このメモリ管理クラスで扱える最大の物理メモリ量 (バイト)
+    static const auto kMaxPhysicalMemoryBytes {128_GiB};
+    // kMaxPhysicalMemoryBytes までの物理メモリを扱うために必要なフレーム数
+    static const auto kFrameCount {kMaxPhysicalMemoryBytes / kBytesPerFrame};
+
+    // ビットマップ配列の要素型
+    using MapLineType = unsigned long;
+    // ビットマップ配列の1つの要素のビット数 == フレーム数
+    static const size_t kBitsPerMapLine {8 * sizeof(MapLineType)};
+
+    struct Stats {
+        // SetMemoryRange で設定された範囲のフレーム数
+        size_t total_frames;
+        // そのうち使用中のフレーム数
+        size_t allocated_frames;
+        // 最も長い連続した空きフレームの数
+        size_t largest_free_run;
+    };
+
+    BitmapMemoryManager();
+
+    // 連続した num_frames 個のフレームを確保し、先頭のフレームを返す
+    WithError<FrameID> AllocateFrames(size_t num_frames);
+    // 連続した num_frames 個のフレームを limit より前の範囲から確保する (AP の起動コードなど)
+    WithError<FrameID> AllocateFramesBelow(size_t num_frames, FrameID limit);
+    Error FreeFrames(FrameID start_frame, size_t num_frames);
+    // 指定した範囲を使用中にする。初期化時に使用できない領域を登録するために使う
+    void MarkAllocated(FrameID start_frame, size_t num_frames);
+
+    /**
+     * このメモリマネージャで扱うメモリ範囲を設定する
+     * この呼び出し以降、Allocate によるメモリ割り当ては設定された範囲内でのみ行われる
+     *
+     * @param range_begin_ メモリ範囲の始点
+     * @param range_end_   メモリ範囲の終点。最終フレームの次のフレーム
+     **/
+    void SetMemoryRange(FrameID range_begin, FrameID range_end);
+
+    // 使用状況を調べる。最長の空き領域を求めるためにビットマップ全体を走査する
+    Stats GetStats() const;
+
+private:
+    std::array<MapLineType, kFrameCount / kBitsPerMapLine> alloc_map_;
+    // このメモリマネージャで扱うメモリ範囲の始点
+    FrameID range_begin_;
+    // このメモリマネージャで扱うメモリ範囲の終点。最終フレームの次のフレーム
+    FrameID range_end_;
+    // 次の探索を始めるフレーム
+    size_t next_search_;
+
+    // [begin, end) の中で num_frames 個連続した空きを探す。見つからなければ end を返す
+    size_t FindFreeRange(size_t begin, size_t end, size_t num_frames) const;
+    // [begin, end) の中で最初の使用中フレームを探す。見つからなければ end を返す
+    size_t FindAllocated(size_t begin, size_t end) const;
+    // [begin, end) の中で最初の空きフレームを探す。見つからなければ end を返す
+    size_t FindFree(size_t begin, size_t end) const;
+    // num_frames 個のビットをワード単位でまとめて設定する
+    void SetBits(size_t start, size_t num_frames, bool allocated);
+};
+
+extern BitmapMemoryManager* memory_manager;
+
+// UEFI のメモリマップから空き領域を調べ、memory_manager を初期化する
+void InitializeMemoryManager(const MemoryMap& memory_map);
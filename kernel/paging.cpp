@@ -0,0 +1,147 @@
+#include "paging.hpp"
+
+#include <cpuid.h>
+#include <array>
+#include "asmfunc.h"
+
+namespace {
+    const uint64_t kPageSize4K = 4096;
+    const uint64_t kPageSize2M = 512 * kPageSize4K;
+    const uint64_t kPageSize1G = 512 * kPageSize2M;
+
+    // ページテーブルのエントリのビット
+    const uint64_t kPresentWritable = 0x003;
+    const uint64_t kPageWriteThrough = 0x008;
+    const uint64_t kPageCacheDisable = 0x010;
+    const uint64_t kPageSize = 0x080;
+
+    /**
+     * PAT (IA32_PAT MSR) のエントリ1 を Write-Combining にする
+     * エントリ1は PWT=1, PCD=0, PAT=0 のページで選ばれるので、PWT ビットを立てたページが WC になる
+     * 電源投入時のエントリ1は Write-Through で、このカーネルでは使っていない
+     **/
+    const uint32_t kIA32PAT = 0x277;
+    const uint64_t kPATTypeWriteCombining = 0x01;
+    const uint64_t kWriteCombiningFlags = kPageWriteThrough;
+
+    // 1GiB ページを 2MiB ページに分割するときに使うページディレクトリの個数
+    const size_t kSplitDirectoryCount = 2;
+
+    alignas(kPageSize4K) std::array<uint64_t, 512> pml4_table;
+    alignas(kPageSize4K) std::array<uint64_t, 512> pdp_table;
+    alignas(kPageSize4K) std::array<std::array<uint64_t, 512>, kPageDirectoryCount> page_directory;
+    alignas(kPageSize4K)
+        std::array<std::array<uint64_t, 512>, kSplitDirectoryCount> split_directory;
+    size_t num_split_directories;
+
+    bool use_1g_pages;
+    bool pat_configured;
+
+    // CPUID.80000001H:EDX[26] が 1GiB ページ (Page1GB) に対応していることを示す
+    bool Supports1GPages() {
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)) return false;
+        return edx & (1u << 26);
+    }
+
+    // CPUID.01H:EDX[16] が PAT に対応していることを示す
+    bool SupportsPAT() {
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+        return edx & (1u << 16);
+    }
+
+    void ConfigurePAT() {
+        uint64_t pat = ReadMSR(kIA32PAT);
+        pat = (pat & ~(uint64_t {0xff} << 8)) | (kPATTypeWriteCombining << 8);
+        WriteMSR(kIA32PAT, pat);
+        pat_configured = true;
+    }
+
+    // 物理アドレス addr を含む 2MiB ページのエントリを返す。必要なら 1GiB ページを分割する
+    uint64_t* Entry2M(uint64_t addr) {
+        const size_t i_pdpt = addr / kPageSize1G;
+        const size_t i_pd = (addr % kPageSize1G) / kPageSize2M;
+        if (!use_1g_pages) {
+            return &page_directory[i_pdpt][i_pd];
+        }
+
+        if (pdp_table[i_pdpt] & kPageSize) {
+            if (num_split_directories == kSplitDirectoryCount) return nullptr;
+            // 分割前と同じ属性の 2MiB ページで埋めてから差し替える
+            auto& pd = split_directory[num_split_directories++];
+            const uint64_t attr = pdp_table[i_pdpt] & (kPageWriteThrough | kPageCacheDisable);
+            for (size_t i = 0; i < 512; ++i) {
+                pd[i] = (i_pdpt * kPageSize1G + i * kPageSize2M) | attr | kPageSize
+                    | kPresentWritable;
+            }
+            pdp_table[i_pdpt] = reinterpret_cast<uint64_t>(&pd[0]) | kPresentWritable;
+        }
+        auto pd = reinterpret_cast<uint64_t*>(pdp_table[i_pdpt] & ~(kPageSize4K - 1));
+        return &pd[i_pd];
+    }
+}  // namespace
+
+void SetupIdentityPageTable() {
+    use_1g_pages = Supports1GPages();
+
+    // 0x003: Present | Read/Write, 0x080: 2MiB/1GiB ページ (Page Size)
+    pml4_table[0] = reinterpret_cast<uint64_t>(&pdp_table[0]) | kPresentWritable;
+    if (use_1g_pages) {
+        // ページディレクトリを使わず、PDPT のエントリが直接 1GiB ページを指す
+        for (size_t i_pdpt = 0; i_pdpt < pdp_table.size(); ++i_pdpt) {
+            pdp_table[i_pdpt] = (i_pdpt * kPageSize1G) | kPageSize | kPresentWritable;
+        }
+    } else {
+        for (size_t i_pdpt = 0; i_pdpt < page_directory.size(); ++i_pdpt) {
+            pdp_table[i_pdpt]
+                = reinterpret_cast<uint64_t>(&page_directory[i_pdpt]) | kPresentWritable;
+            for (size_t i_pd = 0; i_pd < 512; ++i_pd) {
+                page_directory[i_pdpt][i_pd]
+                    = (i_pdpt * kPageSize1G + i_pd * kPageSize2M) | kPageSize | kPresentWritable;
+            }
+        }
+    }
+
+    SetCR3(reinterpret_cast<uint64_t>(&pml4_table[0]));
+}
+
+uint64_t IdentityMappedBytes() {
+    return (use_1g_pages ? pdp_table.size() : page_directory.size()) * kPageSize1G;
+}
+
+Error SetWriteCombining(uintptr_t addr, size_t bytes) {
+    if (!SupportsPAT()) {
+        return MAKE_ERROR(Error::kNotSupported);
+    }
+    if (bytes == 0 || addr + bytes > IdentityMappedBytes()) {
+        return MAKE_ERROR(Error::kIndexOutOfRange);
+    }
+    if (!pat_configured) {
+        ConfigurePAT();
+    }
+
+    /**
+     * 2MiB 単位で設定するので、範囲の前後の端数も WC になる
+     * フレームバッファはデバイスの BAR の中にあり、BAR は大きさに合わせて整列しているので、
+     * 端数の部分も同じデバイスのメモリになる
+     **/
+    const uint64_t begin = addr / kPageSize2M * kPageSize2M;
+    for (uint64_t page = begin; page < addr + bytes; page += kPageSize2M) {
+        uint64_t* entry = Entry2M(page);
+        if (entry == nullptr) {
+            return MAKE_ERROR(Error::kNoEnoughMemory);
+        }
+        *entry |= kWriteCombiningFlags;
+    }
+
+    // CR3 を再設定して TLB に残っている古い属性を捨てる
+    SetCR3(GetCR3());
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+void SyncPAT() {
+    if (pat_configured) {
+        ConfigurePAT();
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "error.hpp"
+
+/**
+ * 静的に確保するページディレクトリの個数
+ * この定数は SetupIdentityPageTable で使用される
+ * 1つのページディレクトリには 512 個の 2MiB ページを設定できるので、
+ * 1GiB ページが使えない CPU では kPageDirectoryCount x 1GiB の仮想アドレスがマッピングされる
+ * 1GiB ページが使える CPU では、PDPT 1つ分 (512GiB) を 1GiB ページでマッピングする
+ **/
+const size_t kPageDirectoryCount = 64;
+
+/**
+ * 仮想アドレス = 物理アドレスとなるようにページテーブルを設定する
+ * 最終的に CR3 レジスタが正しく設定されたページテーブルを指すようになる
+ * UEFI が用意したページテーブルはブートサービス用の領域にあるので、
+ * メモリ管理を始める前に置き換える
+ * CPU が対応していれば 1GiB ページを、そうでなければ 2MiB ページを使い、TLB ミスを減らす
+ **/
+void SetupIdentityPageTable();
+
+// SetupIdentityPageTable でマッピングした範囲の大きさ (バイト)
+uint64_t IdentityMappedBytes();
+
+/**
+ * [addr, addr + bytes) を Write-Combining でアクセスするように設定する
+ * PAT のエントリ1を WC に書き換え、範囲を含む 2MiB ページがそのエントリを選ぶようにする。
+ * 1GiB ページの途中にある場合は、その 1GiB ページを 2MiB ページに分割する。
+ * フレームバッファのように、連続して書き込むだけでキャッシュする必要のない領域に使う。
+ **/
+Error SetWriteCombining(uintptr_t addr, size_t bytes);
+
+/**
+ * BSP と同じ PAT の設定を、この関数を実行している CPU に反映する
+ * PAT は CPU ごとの MSR なので、AP は起動直後に呼ぶ必要がある
+ **/
+void SyncPAT();
@@ -0,0 +1,156 @@
+#include "parallel.hpp"
+
+#include "interrupt.hpp"
+#include "local_apic.hpp"
+#include "smp.hpp"
+
+namespace {
+    // 1つの CPU のキューに積める区間の数。2分割なので深さは log2(区間の数) で済む
+    const size_t kQueueCapacity = 256;
+    // 仕事が見つからないとき、hlt で眠るまでに pause で待つ回数
+    const int kSpinRounds = 1 << 14;
+
+    static_assert(kMaxCPUs <= 64, "parked_workers must have a bit for each CPU");
+
+    WorkStealingDeque<ParallelTask, kQueueCapacity> queues[kMaxCPUs];
+    int num_workers = 1;
+    std::atomic<int> active_workers {1};
+    // hlt で眠っている (眠ろうとしている) CPU のビット集合
+    std::atomic<uint64_t> parked_workers {0};
+
+    void Run(const ParallelTask& task) {
+        task.func(task.context, task.begin, task.end);
+        task.remaining->fetch_sub(1, std::memory_order_release);
+    }
+
+    // 眠っている AP のうち、仕事を分担するものを起こす
+    void WakeParkedWorkers() {
+        // キューへの Push と、AP が眠る前のビットの設定とキューの確認が入れ違わないようにする
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked_workers.load(std::memory_order_relaxed) == 0) return;
+        const int active = active_workers.load(std::memory_order_relaxed);
+        const uint64_t mask = active >= 64 ? ~uint64_t {0} : (uint64_t {1} << active) - 1;
+        uint64_t parked = parked_workers.fetch_and(~mask, std::memory_order_seq_cst) & mask;
+        while (parked) {
+            const int cpu = __builtin_ctzll(parked);
+            parked &= parked - 1;
+            WakeCPU(cpu);
+        }
+    }
+
+    // 区間を grain 以下になるまで2分割し、後ろ半分を自分のキューに積みながら前半を処理する
+    void Execute(int cpu_index, ParallelTask task) {
+        while (task.end - task.begin > task.grain) {
+            const int chunks = (task.end - task.begin + task.grain - 1) / task.grain;
+            const int mid = task.begin + chunks / 2 * task.grain;
+            ParallelTask upper = task;
+            upper.begin = mid;
+            task.remaining->fetch_add(1, std::memory_order_relaxed);
+            if (!queues[cpu_index].Push(upper)) {
+                // キューが一杯なら残りをまとめて自分で処理する
+                task.remaining->fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+            WakeParkedWorkers();
+            task.end = mid;
+        }
+        Run(task);
+    }
+
+    // 自分以外の CPU のキューから1つ盗む。隣の CPU から順に調べる
+    bool TrySteal(int cpu_index, ParallelTask& task) {
+        for (int i = 1; i < num_workers; ++i) {
+            const int victim = (cpu_index + i) % num_workers;
+            if (queues[victim].Steal(task)) return true;
+        }
+        return false;
+    }
+
+    bool HasWork() {
+        for (int i = 0; i < num_workers; ++i) {
+            if (!queues[i].Empty()) return true;
+        }
+        return false;
+    }
+
+    /**
+     * 次の IPI まで hlt で眠る
+     * ビットを立ててからキューを確かめるので、その後に積まれた仕事には必ず IPI が届く
+     * AP は割り込みを禁止したまま動くので、sti の直後の hlt の間だけ割り込みを受け付ける
+     **/
+    void Park(int cpu_index) {
+        const uint64_t bit = uint64_t {1} << cpu_index;
+        parked_workers.fetch_or(bit, std::memory_order_seq_cst);
+        if (cpu_index >= active_workers.load(std::memory_order_relaxed) || !HasWork()) {
+            __asm__ volatile("sti\n\thlt\n\tcli");
+        }
+        parked_workers.fetch_and(~bit, std::memory_order_relaxed);
+    }
+}  // namespace
+
+void InitializeParallel(int num_cpus) {
+    num_workers = num_cpus < kMaxCPUs ? num_cpus : kMaxCPUs;
+    active_workers.store(num_workers, std::memory_order_release);
+}
+
+void WorkerLoop(int cpu_index) {
+    ParallelTask task;
+    int idle = 0;
+    while (true) {
+        if (cpu_index < active_workers.load(std::memory_order_relaxed)
+            && (queues[cpu_index].Pop(task) || TrySteal(cpu_index, task)))
+        {
+            Execute(cpu_index, task);
+            idle = 0;
+        } else if (++idle < kSpinRounds) {
+            __asm__ volatile("pause");
+        } else {
+            Park(cpu_index);
+            idle = 0;
+        }
+    }
+}
+
+extern "C" void WakeupOnInterrupt() {
+    NotifyEndOfInterrupt();
+}
+
+void SetActiveWorkers(int n) {
+    if (n < 1) n = 1;
+    if (n > num_workers) n = num_workers;
+    active_workers.store(n, std::memory_order_release);
+}
+
+int ActiveWorkers() {
+    return active_workers.load(std::memory_order_acquire);
+}
+
+int NumWorkers() {
+    return num_workers;
+}
+
+void ParallelFor(int begin, int end, int grain, void (*func)(void*, int, int), void* context) {
+    if (grain < 1) grain = 1;
+    if (ActiveWorkers() == 1 || end - begin <= grain) {
+        if (begin < end) func(context, begin, end);
+        return;
+    }
+
+    // 区間全体を自分で分割し始める。積んだ後ろ半分は他の CPU が盗んでさらに分割する
+    std::atomic<int> remaining {1};
+    Execute(0, {func, context, begin, end, grain, &remaining});
+
+    // 自分のキューを後ろから処理し、空になったら他の CPU のキューを手伝い、全ての区間の完了を待つ
+    ParallelTask task;
+    while (queues[0].Pop(task)) {
+        Execute(0, task);
+    }
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (TrySteal(0, task)) {
+            Execute(0, task);
+            while (queues[0].Pop(task)) Execute(0, task);
+        } else {
+            __asm__ volatile("pause");
+        }
+    }
+}
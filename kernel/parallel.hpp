@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include "work_queue.hpp"
+
+/**
+ * 複数の CPU で処理を分担する仕組み
+ * CPU ごとに WorkStealingDeque を持つ。区間を処理する CPU は、区間が grain より長ければ
+ * 後ろ半分を自分のキューに積んで前半を処理し続ける (再帰的な2分割)。
+ * 手の空いた CPU は他の CPU のキューの先頭 (最も大きな区間) を盗み、自分のキューで同じように分割する。
+ * CPU 番号 0 は BSP、1 以降は起動した順の AP。
+ *
+ * 仕事の無い AP はしばらく pause で待った後、hlt で眠る。
+ * 区間をキューに積んだ CPU は、眠っている AP を IPI (InterruptVector::kWakeup) で起こす。
+ **/
+const int kMaxCPUs = 64;
+
+// 範囲 [begin, end) を処理する関数と、その関数に渡す文脈
+struct ParallelTask {
+    void (*func)(void* context, int begin, int end);
+    void* context;
+    int begin, end;
+    // これ以下の長さの区間は分割しない
+    int grain;
+    // 処理し終えたら減らすカウンタ
+    std::atomic<int>* remaining;
+};
+
+// 仕事を分担する CPU の数を設定する。AP を起動する前に BSP が呼ぶ
+void InitializeParallel(int num_cpus);
+
+// AP が起動後に入るループ。キューから仕事を取り出して処理し続け、戻らない
+[[noreturn]] void WorkerLoop(int cpu_index);
+
+// 眠っている AP を起こす IPI の割り込みハンドラから呼ばれる
+extern "C" void WakeupOnInterrupt();
+
+/**
+ * 仕事を盗みに行く CPU を先頭の n 個 (BSP を含む) に制限する
+ * CPU 数を変えて速度を比べるためのもので、範囲外の CPU は待機したままになる
+ **/
+void SetActiveWorkers(int n);
+int ActiveWorkers();
+int NumWorkers();
+
+/**
+ * [begin, end) を grain 個ずつの区間に分けて func(context, 区間の始点, 終点) を並列に呼び出し、
+ * 全ての区間が終わるまで待つ。呼び出した CPU も区間を処理する。
+ * BSP (CPU 番号 0) から、InitializeInterrupt の後に呼ぶこと。func は他の CPU から同時に呼ばれる。
+ **/
+void ParallelFor(int begin, int end, int grain, void (*func)(void*, int, int), void* context);
+
+// ラムダ式を受け取る版。例: ParallelFor(0, height, 16, [&](int y0, int y1) { ... });
+template <typename Func>
+void ParallelFor(int begin, int end, int grain, Func&& func) {
+    ParallelFor(
+        begin,
+        end,
+        grain,
+        [](void* context, int b, int e) { (*static_cast<Func*>(context))(b, e); },
+        &func);
+}
@@ -0,0 +1,65 @@
+#include "parallel_graphics.hpp"
+
+#include "parallel.hpp"
+#include "simd.hpp"
+
+void ParallelFillRect(
+    const FrameBufferConfig& config, Rectangle rect, const PixelColor& c, DamageTracker* tracker) {
+    if (!ClipRect(rect.x,
+            rect.y,
+            rect.width,
+            rect.height,
+            config.horizontal_resolution,
+            config.vertical_resolution))
+    {
+        return;
+    }
+
+    DispatchPixelFormat(config, [&](auto& writer) {
+        ParallelFor(rect.y, rect.y + rect.height, kParallelBandHeight, [&](int y0, int y1) {
+            writer.FillRect(rect.x, y0, rect.width, y1 - y0, c);
+        });
+    });
+    if (tracker) tracker->MarkDirty(rect);
+}
+
+void ParallelBlit(const FrameBufferConfig& dst,
+    const FrameBufferConfig& src,
+    Rectangle rect,
+    DamageTracker* tracker,
+    const BitMaskConverter* converter) {
+    if (!ClipRect(rect.x,
+            rect.y,
+            rect.width,
+            rect.height,
+            dst.horizontal_resolution,
+            dst.vertical_resolution))
+    {
+        return;
+    }
+
+    const auto src_base = reinterpret_cast<const uint32_t*>(src.frame_buffer);
+    const size_t src_stride = src.pixels_per_scan_line;
+    if (converter) {
+        const size_t bytes_per_pixel = converter->BytesPerPixel();
+        const size_t dst_pitch = bytes_per_pixel * dst.pixels_per_scan_line;
+        ParallelFor(rect.y, rect.y + rect.height, kParallelBandHeight, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                converter->Convert(dst.frame_buffer + dst_pitch * y + bytes_per_pixel * rect.x,
+                    src_base + src_stride * y + rect.x,
+                    rect.width);
+            }
+        });
+    } else {
+        const auto dst_base = reinterpret_cast<uint32_t*>(dst.frame_buffer);
+        const size_t dst_stride = dst.pixels_per_scan_line;
+        ParallelFor(rect.y, rect.y + rect.height, kParallelBandHeight, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                CopyPixels32(dst_base + dst_stride * y + rect.x,
+                    src_base + src_stride * y + rect.x,
+                    rect.width);
+            }
+        });
+    }
+    if (tracker) tracker->MarkDirty(rect);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "frame_buffer_config.hpp"
+#include "graphics.hpp"
+#include "pixel_bitmask.hpp"
+
+/**
+ * 描画処理を走査線の帯に分けて複数の CPU で実行する関数
+ * 帯ごとのタスクは DamageTracker を使わず、描画した領域は呼び出した CPU が最後に1回だけ通知する。
+ * DamageTracker (影のバッファなど) はスレッドセーフではないため。
+ **/
+
+// 1つのタスクが担当する走査線の数。これより低い矩形は呼び出した CPU だけで描画する
+const int kParallelBandHeight = 32;
+
+// (rect.x, rect.y) を左上とする矩形を塗りつぶす
+void ParallelFillRect(const FrameBufferConfig& config,
+    Rectangle rect,
+    const PixelColor& c,
+    DamageTracker* tracker = nullptr);
+
+/**
+ * src の矩形 rect を dst の同じ位置へ転送する
+ * 影のバッファから VRAM への転送などに使い、2つのバッファは解像度が同じであること
+ * converter を指定すると、src の32ビット値を変換して kPixelBitMask 形式の dst へ書き込む。
+ * 指定しなければ、2つのバッファのピクセル形式は同じであること
+ **/
+void ParallelBlit(const FrameBufferConfig& dst,
+    const FrameBufferConfig& src,
+    Rectangle rect,
+    DamageTracker* tracker = nullptr,
+    const BitMaskConverter* converter = nullptr);
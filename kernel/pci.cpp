@@ -0,0 +1,264 @@
+#include "pci.hpp"
+
+#include <algorithm>
+#include "asmfunc.h"
+#include "paging.hpp"
+
+namespace {
+    const uint16_t kConfigAddress = 0x0cf8;
+    const uint16_t kConfigData = 0x0cfc;
+
+    // 設定空間のレジスタ
+    const uint16_t kRegisterID = 0x00;
+    const uint16_t kRegisterClass = 0x08;
+    const uint16_t kRegisterHeaderType = 0x0c;
+    const uint16_t kRegisterBusNumbers = 0x18;
+
+    // PCI-to-PCI ブリッジのクラス (ベースクラス 0x06、サブクラス 0x04)
+    const uint8_t kClassBridge = 0x06;
+    const uint8_t kSubClassPCIBridge = 0x04;
+
+    // 機能が存在しないときに読める値
+    const uint16_t kInvalidVendorID = 0xffff;
+
+    const int kNumDevicesPerBus = 32;
+    const int kNumFunctionsPerDevice = 8;
+
+    /**
+     * ECAM の領域。バス n の設定空間は ecam_base + (n << 20) から 1MiB を占める
+     * (start_bus より前のバスの分は存在しない)。恒等マッピングはライトバックのページだが、
+     * この領域はファームウェアが MTRR でキャッシュ不可にしているので、そのまま読み書きできる
+     **/
+    uintptr_t ecam_base;
+    uint8_t ecam_start_bus, ecam_end_bus;
+
+    // 設定空間を読む関数。Initialize で ECAM 用とポート I/O 用のどちらかを選ぶ
+    uint32_t (*read_config)(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg);
+    void (*write_config)(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg, uint32_t value);
+
+    pci::Device by_class[pci::kMaxDevices];
+    pci::Device by_vendor[pci::kMaxDevices];
+    size_t num_devices;
+    pci::Stats stats;
+    // 走査済みのバス。ブリッジの設定が循環していても同じバスを2回走査しない
+    bool bus_scanned[256];
+
+    volatile uint32_t* ECAMRegister(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg) {
+        const uintptr_t offset = uintptr_t {bus} << 20 | device << 15 | function << 12 | (reg & 0xffc);
+        return reinterpret_cast<volatile uint32_t*>(ecam_base + offset);
+    }
+
+    bool InECAMRange(uint8_t bus) {
+        return bus >= ecam_start_bus && bus <= ecam_end_bus;
+    }
+
+    uint32_t ReadConfigECAM(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg) {
+        if (!InECAMRange(bus)) return 0xffffffffu;
+        return *ECAMRegister(bus, device, function, reg);
+    }
+
+    void WriteConfigECAM(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg, uint32_t value) {
+        if (!InECAMRange(bus)) return;
+        *ECAMRegister(bus, device, function, reg) = value;
+    }
+
+    // CONFIG_ADDRESS: bit 31 が有効ビット。ポート I/O では先頭の 256 バイトしか読み書きできない
+    uint32_t MakeAddress(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg) {
+        return 1u << 31 | bus << 16 | device << 11 | function << 8 | (reg & 0xfc);
+    }
+
+    uint32_t ReadConfigPortIO(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg) {
+        if (reg >= 0x100) return 0xffffffffu;
+        IoOut32(kConfigAddress, MakeAddress(bus, device, function, reg));
+        return IoIn32(kConfigData);
+    }
+
+    void WriteConfigPortIO(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg, uint32_t value) {
+        if (reg >= 0x100) return;
+        IoOut32(kConfigAddress, MakeAddress(bus, device, function, reg));
+        IoOut32(kConfigData, value);
+    }
+
+    uint16_t ReadVendorID(uint8_t bus, uint8_t device, uint8_t function) {
+        return pci::ReadConfig32(bus, device, function, kRegisterID) & 0xffffu;
+    }
+
+    uint8_t ReadHeaderType(uint8_t bus, uint8_t device, uint8_t function) {
+        return (pci::ReadConfig32(bus, device, function, kRegisterHeaderType) >> 16) & 0xffu;
+    }
+
+    // ヘッダタイプの bit 7 が立っていれば、機能 1..7 も存在しうる
+    bool IsMultiFunction(uint8_t header_type) {
+        return header_type & 0x80u;
+    }
+
+    Error ScanBus(uint8_t bus);
+
+    // 存在が分かっている機能を表に加え、PCI-to-PCI ブリッジなら2次側のバスを走査する
+    Error ScanFunction(
+        uint8_t bus, uint8_t device, uint8_t function, uint32_t id, uint8_t header_type) {
+        if (num_devices == pci::kMaxDevices) return MAKE_ERROR(Error::kFull);
+        const uint32_t class_code = pci::ReadConfig32(bus, device, function, kRegisterClass) >> 8;
+        by_class[num_devices++] = {bus,
+            device,
+            function,
+            header_type,
+            static_cast<uint16_t>(id & 0xffffu),
+            static_cast<uint16_t>(id >> 16),
+            class_code};
+
+        if (class_code >> 16 == kClassBridge && ((class_code >> 8) & 0xffu) == kSubClassPCIBridge) {
+            const uint8_t secondary_bus
+                = (pci::ReadConfig32(bus, device, function, kRegisterBusNumbers) >> 8) & 0xffu;
+            // 2次側のバスが 0 ならブリッジはまだ設定されていない
+            if (secondary_bus != 0) return ScanBus(secondary_bus);
+        }
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    /**
+     * バスの 32 個のデバイスを調べる
+     * 機能 0 が無いデバイスは他の機能も無いので、ベンダー ID を1回読んだだけで次へ進む。
+     * 機能 0 のヘッダタイプがマルチファンクションでなければ、機能 1..7 は読まない
+     **/
+    Error ScanBus(uint8_t bus) {
+        if (bus_scanned[bus]) return MAKE_ERROR(Error::kSuccess);
+        bus_scanned[bus] = true;
+        ++stats.buses_scanned;
+
+        for (uint8_t device = 0; device < kNumDevicesPerBus; ++device) {
+            const uint32_t id = pci::ReadConfig32(bus, device, 0, kRegisterID);
+            if ((id & 0xffffu) == kInvalidVendorID) continue;
+            const uint8_t header_type = ReadHeaderType(bus, device, 0);
+            if (auto err = ScanFunction(bus, device, 0, id, header_type)) return err;
+            if (!IsMultiFunction(header_type)) continue;
+
+            for (uint8_t function = 1; function < kNumFunctionsPerDevice; ++function) {
+                const uint32_t id = pci::ReadConfig32(bus, device, function, kRegisterID);
+                if ((id & 0xffffu) == kInvalidVendorID) continue;
+                const uint8_t header_type = ReadHeaderType(bus, device, function);
+                if (auto err = ScanFunction(bus, device, function, id, header_type)) return err;
+            }
+        }
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    /**
+     * ホストブリッジ (バス 0 のデバイス 0) から全てのバスを走査する
+     * ホストブリッジがマルチファンクションなら、機能 n がバス n のホストブリッジになる
+     **/
+    Error ScanAllBuses() {
+        const uint8_t header_type = ReadHeaderType(0, 0, 0);
+        if (!IsMultiFunction(header_type)) return ScanBus(0);
+
+        for (uint8_t function = 0; function < kNumFunctionsPerDevice; ++function) {
+            if (ReadVendorID(0, 0, function) == kInvalidVendorID) continue;
+            if (auto err = ScanBus(function)) return err;
+        }
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    uint32_t BusDeviceFunction(const pci::Device& d) {
+        return d.bus << 16 | d.device << 8 | d.function;
+    }
+
+    // ベンダー順の表の並びのキー。ベンダー ID << 16 | デバイス ID
+    uint32_t VendorKey(const pci::Device& d) {
+        return uint32_t {d.vendor_id} << 16 | d.device_id;
+    }
+
+    /**
+     * 表 table のうち key(d) が [low, high) に入る範囲を二分探索で求める
+     * 表は key の順 (同じ key の中はバス番号などの順) に並んでいること
+     **/
+    template <typename Key>
+    pci::DeviceRange FindRange(const pci::Device* table, Key key, uint32_t low, uint32_t high) {
+        const pci::Device* end = table + num_devices;
+        auto first = std::lower_bound(
+            table, end, low, [&](const pci::Device& d, uint32_t v) { return key(d) < v; });
+        auto last = std::lower_bound(
+            first, end, high, [&](const pci::Device& d, uint32_t v) { return key(d) < v; });
+        return {first, last};
+    }
+
+    uint32_t ClassKey(const pci::Device& d) {
+        return d.class_code;
+    }
+}  // namespace
+
+namespace pci {
+    Error Initialize(const acpi::MCFG* mcfg) {
+        read_config = ReadConfigPortIO;
+        write_config = WriteConfigPortIO;
+        stats = {kAccessPortIO, 0, 0};
+        if (mcfg) {
+            for (size_t i = 0; i < mcfg->Count(); ++i) {
+                const acpi::MCFGEntry& entry = (*mcfg)[i];
+                if (entry.segment_group != 0 || entry.start_bus > entry.end_bus) continue;
+                // ECAM は恒等マッピングの範囲にある必要がある。範囲外ならポート I/O のままにする
+                const uint64_t end = entry.base_address + ((uint64_t {entry.end_bus} + 1) << 20);
+                if (end > IdentityMappedBytes()) continue;
+                ecam_base = entry.base_address;
+                ecam_start_bus = entry.start_bus;
+                ecam_end_bus = entry.end_bus;
+                read_config = ReadConfigECAM;
+                write_config = WriteConfigECAM;
+                stats.access = kAccessECAM;
+                break;
+            }
+        }
+
+        num_devices = 0;
+        std::fill_n(bus_scanned, 256, false);
+        const Error err = ScanAllBuses();
+
+        // 列挙した順 (バス番号などの順) を保ったまま、キーの順に並べる
+        auto by_key = [](auto key) {
+            return [key](const Device& a, const Device& b) {
+                if (key(a) != key(b)) return key(a) < key(b);
+                return BusDeviceFunction(a) < BusDeviceFunction(b);
+            };
+        };
+        std::copy_n(by_class, num_devices, by_vendor);
+        std::sort(by_class, by_class + num_devices, by_key(ClassKey));
+        std::sort(by_vendor, by_vendor + num_devices, by_key(VendorKey));
+        return err;
+    }
+
+    uint32_t ReadConfig32(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg) {
+        ++stats.config_reads;
+        return read_config(bus, device, function, reg);
+    }
+
+    void WriteConfig32(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg, uint32_t value) {
+        write_config(bus, device, function, reg, value);
+    }
+
+    DeviceRange Devices() {
+        return {by_class, by_class + num_devices};
+    }
+
+    DeviceRange FindByClass(uint8_t base, uint8_t sub) {
+        const uint32_t key = uint32_t {base} << 16 | sub << 8;
+        return FindRange(by_class, ClassKey, key, key + 0x100);
+    }
+
+    DeviceRange FindByClass(uint8_t base, uint8_t sub, uint8_t interface) {
+        const uint32_t key = uint32_t {base} << 16 | sub << 8 | interface;
+        return FindRange(by_class, ClassKey, key, key + 1);
+    }
+
+    DeviceRange FindByVendor(uint16_t vendor_id) {
+        const uint32_t key = uint32_t {vendor_id} << 16;
+        return FindRange(by_vendor, VendorKey, key, key + 0x10000);
+    }
+
+    DeviceRange FindByVendor(uint16_t vendor_id, uint16_t device_id) {
+        const uint32_t key = uint32_t {vendor_id} << 16 | device_id;
+        return FindRange(by_vendor, VendorKey, key, key + 1);
+    }
+
+    Stats GetStats() {
+        return stats;
+    }
+}  // namespace pci
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "acpi.hpp"
+#include "error.hpp"
+
+/**
+ * PCI / PCI Express のデバイスの列挙
+ * 設定空間には、ACPI の MCFG に ECAM (メモリマップされた設定空間) があればそれを使い、
+ * 無ければ I/O ポート 0xCF8 / 0xCFC を使う。
+ * 列挙は起動時に1回だけ行い、見つかった機能をクラス順とベンダー順に並べた2つの表に保存する。
+ * 検索はどちらかの表の二分探索で行うので、バスを走査し直すことはない。
+ **/
+namespace pci {
+    // 表に載せる機能の数の上限
+    const size_t kMaxDevices = 256;
+
+    // PCI の1つの機能 (ファンクション)
+    struct Device {
+        uint8_t bus, device, function;
+        uint8_t header_type;
+        uint16_t vendor_id, device_id;
+        // ベースクラス << 16 | サブクラス << 8 | インターフェース
+        uint32_t class_code;
+
+        uint8_t BaseClass() const {
+            return class_code >> 16;
+        }
+        uint8_t SubClass() const {
+            return class_code >> 8;
+        }
+        uint8_t Interface() const {
+            return class_code;
+        }
+    };
+
+    // 表の中で条件に合う連続した範囲。range-based for で使える
+    struct DeviceRange {
+        const Device* first;
+        const Device* last;
+
+        const Device* begin() const {
+            return first;
+        }
+        const Device* end() const {
+            return last;
+        }
+        size_t Count() const {
+            return last - first;
+        }
+        bool Empty() const {
+            return first == last;
+        }
+    };
+
+    enum ConfigAccess {
+        kAccessECAM,
+        kAccessPortIO,
+    };
+
+    struct Stats {
+        ConfigAccess access;
+        // 走査したバスの数と、設定空間を読んだ回数
+        int buses_scanned;
+        size_t config_reads;
+    };
+
+    /**
+     * 設定空間の読み書きの方法を決め、バス 0 からブリッジをたどって全ての機能を列挙する
+     * MCFG が渡され、セグメント 0 の ECAM 領域が恒等マッピングの範囲内にあれば ECAM を使う
+     * 機能の数が kMaxDevices を超えると kFull を返す (それまでに見つけた機能は表に残る)
+     **/
+    Error Initialize(const acpi::MCFG* mcfg);
+
+    // 設定空間の reg (4 バイト境界) から32ビットを読み書きする
+    uint32_t ReadConfig32(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg);
+    void WriteConfig32(uint8_t bus, uint8_t device, uint8_t function, uint16_t reg, uint32_t value);
+
+    // 見つかった全ての機能 (クラス順)
+    DeviceRange Devices();
+    // ベースクラスとサブクラスが一致する機能 (クラスが同じものはバス番号の順)
+    DeviceRange FindByClass(uint8_t base, uint8_t sub);
+    DeviceRange FindByClass(uint8_t base, uint8_t sub, uint8_t interface);
+    // ベンダー ID が一致する機能と、ベンダー ID とデバイス ID の両方が一致する機能
+    DeviceRange FindByVendor(uint16_t vendor_id);
+    DeviceRange FindByVendor(uint16_t vendor_id, uint16_t device_id);
+
+    Stats GetStats();
+}  // namespace pci
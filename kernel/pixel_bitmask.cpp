@@ -0,0 +1,129 @@
+#include "pixel_bitmask.hpp"
+
+#include <emmintrin.h>
+#include <cstring>
+
+namespace {
+    int HighestBit(uint32_t v) {
+        return v ? 31 - __builtin_clz(v) : -1;
+    }
+
+    /**
+     * 8 ビットの色 c を bits ビットへ変換する
+     * 8 ビット以下なら上位のビットを取り、それより多ければ上位のビットを繰り返して下位を埋める
+     * (10 ビットなら 0xff が 0x3ff になる)
+     **/
+    uint32_t ScaleChannel(uint32_t c, int bits) {
+        if (bits <= 8) return c >> (8 - bits);
+        uint64_t v = 0;
+        int filled = 0;
+        while (filled < bits) {
+            v = (v << 8) | c;
+            filled += 8;
+        }
+        return v >> (filled - bits);
+    }
+}  // namespace
+
+int BytesPerPixel(const FrameBufferConfig& config) {
+    if (config.pixel_format != kPixelBitMask) return 4;
+    const PixelBitMask& m = config.pixel_bitmask;
+    return HighestBit(m.red_mask | m.green_mask | m.blue_mask | m.reserved_mask) / 8 + 1;
+}
+
+BitMaskConverter::BitMaskConverter(const PixelBitMask& mask) {
+    const uint32_t masks[3] = {mask.blue_mask, mask.green_mask, mask.red_mask};
+    bytes_per_pixel_ = HighestBit(masks[0] | masks[1] | masks[2] | mask.reserved_mask) / 8 + 1;
+
+    bool narrow = true;
+    for (int i = 0; i < 3; ++i) {
+        // マスクは連続したビットの並びであることを前提とする
+        const int bits = __builtin_popcount(masks[i]);
+        const int shift = masks[i] ? __builtin_ctz(masks[i]) : 0;
+        for (uint32_t c = 0; c < 256; ++c) {
+            table_[i][c] = bits ? (ScaleChannel(c, bits) << shift) & masks[i] : 0;
+        }
+        if (bits > 8) {
+            narrow = false;
+            continue;
+        }
+        channels_[i] = {static_cast<uint32_t>(8 * i + 8 - bits),
+            bits ? (uint32_t {1} << bits) - 1 : 0,
+            static_cast<uint32_t>(shift)};
+    }
+
+    if (narrow && bytes_per_pixel_ == 2) {
+        convert_ = Convert16SSE2;
+    } else if (narrow && bytes_per_pixel_ == 4) {
+        convert_ = Convert32SSE2;
+    } else if (bytes_per_pixel_ == 1) {
+        convert_ = ConvertTable<1>;
+    } else if (bytes_per_pixel_ == 2) {
+        convert_ = ConvertTable<2>;
+    } else if (bytes_per_pixel_ == 3) {
+        convert_ = ConvertTable<3>;
+    } else {
+        convert_ = ConvertTable<4>;
+    }
+}
+
+template <int N>
+void BitMaskConverter::ConvertTable(
+    const BitMaskConverter& c, uint8_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t v = c.ConvertOne(src[i]);
+        // リトルエンディアンなので、下位の N バイトがそのままピクセルになる
+        memcpy(dst + N * i, &v, N);
+    }
+}
+
+namespace {
+    // SSE2 版で使う各色のシフト量とマスク。シフト量は全要素に同じ量を使う命令のため下位64ビットに置く
+    struct SSE2Channel {
+        __m128i src_shift, mask, dst_shift;
+    };
+
+    template <typename Channel>
+    SSE2Channel LoadChannel(const Channel& c) {
+        return {_mm_cvtsi32_si128(c.src_shift), _mm_set1_epi32(c.mask), _mm_cvtsi32_si128(c.dst_shift)};
+    }
+
+    __m128i PackChannel(__m128i p, const SSE2Channel& k) {
+        return _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(p, k.src_shift), k.mask), k.dst_shift);
+    }
+
+    // 4ピクセル分の32ビット値から各色を切り出し、PixelBitMask の位置へ並べ直す
+    __m128i PackChannels(__m128i p, const SSE2Channel& b, const SSE2Channel& g, const SSE2Channel& r) {
+        return _mm_or_si128(_mm_or_si128(PackChannel(p, b), PackChannel(p, g)), PackChannel(p, r));
+    }
+}  // namespace
+
+void BitMaskConverter::Convert16SSE2(
+    const BitMaskConverter& c, uint8_t* dst, const uint32_t* src, size_t n) {
+    const SSE2Channel b = LoadChannel(c.channels_[0]), g = LoadChannel(c.channels_[1]),
+                      r = LoadChannel(c.channels_[2]);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo
+            = PackChannels(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), b, g, r);
+        __m128i hi
+            = PackChannels(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4)), b, g, r);
+        // 値は 16 ビットに収まっているので、符号拡張してから飽和させずに 16 ビットへパックできる
+        lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+        hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_packs_epi32(lo, hi));
+    }
+    ConvertTable<2>(c, dst + 2 * i, src + i, n - i);
+}
+
+void BitMaskConverter::Convert32SSE2(
+    const BitMaskConverter& c, uint8_t* dst, const uint32_t* src, size_t n) {
+    const SSE2Channel b = LoadChannel(c.channels_[0]), g = LoadChannel(c.channels_[1]),
+                      r = LoadChannel(c.channels_[2]);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), PackChannels(p, b, g, r));
+    }
+    ConvertTable<4>(c, dst + 4 * i, src + i, n - i);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "frame_buffer_config.hpp"
+
+/**
+ * フレームバッファの1ピクセルのバイト数
+ * kPixelBitMask の形式では、マスクの最上位のビットを含むバイトまでが1ピクセルになる
+ **/
+int BytesPerPixel(const FrameBufferConfig& config);
+
+/**
+ * 描画に使う32ビット値 (kPixelBGRResv8BitPerColor) を kPixelBitMask の形式へ変換する
+ * PixelBitMask のフレームバッファへは直接描画せず、影のバッファに32ビット値で描いておき、
+ * VRAM へ転送するときに行単位でまとめて変換する。
+ * 各色のシフト量とマスクはコンストラクタで1回だけ求め、変換関数も形式に合わせて選んでおくので、
+ * 行の変換中にピクセルごとの分岐は無い。
+ * - 全ての色が 8 ビット以下で1ピクセルが2か4バイト (RGB565, XRGB1555 など):
+ *   SSE2 のシフトと AND で4ピクセルずつ詰め直し、2バイトなら16ビットにパックする
+ * - それ以外 (10ビット色や3バイトのピクセル): 色ごとの 256 要素の表を引いて OR する
+ **/
+class BitMaskConverter {
+public:
+    explicit BitMaskConverter(const PixelBitMask& mask);
+
+    int BytesPerPixel() const {
+        return bytes_per_pixel_;
+    }
+
+    // src の n ピクセルを変換し、dst (VRAM の行の途中でも良い) から BytesPerPixel() バイトずつ書き込む
+    void Convert(uint8_t* dst, const uint32_t* src, size_t n) const {
+        convert_(*this, dst, src, n);
+    }
+
+    // 1ピクセル分を表で変換する
+    uint32_t ConvertOne(uint32_t src) const {
+        return table_[0][src & 0xff] | table_[1][(src >> 8) & 0xff] | table_[2][(src >> 16) & 0xff];
+    }
+
+private:
+    // 32ビット値の 8 ビットの色を (v >> src_shift) & mask で切り出し、dst_shift だけ左へずらす
+    struct Channel {
+        uint32_t src_shift, mask, dst_shift;
+    };
+
+    template <int N>
+    static void ConvertTable(const BitMaskConverter& c, uint8_t* dst, const uint32_t* src, size_t n);
+    static void Convert16SSE2(const BitMaskConverter& c, uint8_t* dst, const uint32_t* src, size_t n);
+    static void Convert32SSE2(const BitMaskConverter& c, uint8_t* dst, const uint32_t* src, size_t n);
+
+    int bytes_per_pixel_;
+    // 添字は 0: 青, 1: 緑, 2: 赤 (32ビット値の下位のバイトから順)
+    Channel channels_[3];
+    uint32_t table_[3][256];
+    void (*convert_)(const BitMaskConverter& c, uint8_t* dst, const uint32_t* src, size_t n);
+};
@@ -0,0 +1,54 @@
+#include "presenter.hpp"
+
+#include <algorithm>
+#include "parallel_graphics.hpp"
+#include "trace.hpp"
+
+namespace {
+    const FramePresenter::Stats kEmptyStats {0, 0, UINT64_MAX, 0, 0, 0, UINT64_MAX, 0, 0, 0};
+}
+
+FramePresenter::FramePresenter(ShadowBuffer& back_buffer, const FrameBufferConfig& vram) :
+    back_buffer_ {back_buffer}, vram_ {vram}, last_present_ {0}, stats_ {kEmptyStats} {}
+
+void FramePresenter::Present() {
+    const uint64_t start = ReadTSC();
+    const uint64_t width = vram_.horizontal_resolution, height = vram_.vertical_resolution;
+    const uint64_t dirty = back_buffer_.DirtyPixels();
+
+    if (dirty * kFullFrameDivisor >= width * height) {
+        ParallelBlit(vram_,
+            back_buffer_.Config(),
+            {0, 0, static_cast<int>(width), static_cast<int>(height)},
+            nullptr,
+            back_buffer_.Converter());
+        back_buffer_.ClearDirty();
+        back_buffer_.RecordFlush(BytesPerPixel(vram_) * width * height);
+        ++stats_.full_frames;
+        stats_.bytes_presented += BytesPerPixel(vram_) * width * height;
+    } else {
+        back_buffer_.Flush();
+        stats_.bytes_presented += BytesPerPixel(vram_) * dirty;
+    }
+
+    const uint64_t end = ReadTSC();
+    const uint64_t cost = end - start;
+    stats_.min_cost = std::min(stats_.min_cost, cost);
+    stats_.max_cost = std::max(stats_.max_cost, cost);
+    stats_.total_cost += cost;
+    if (last_present_ != 0) {
+        const uint64_t interval = start - last_present_;
+        stats_.min_interval = std::min(stats_.min_interval, interval);
+        stats_.max_interval = std::max(stats_.max_interval, interval);
+        stats_.total_interval += interval;
+        ++stats_.intervals;
+    }
+    last_present_ = start;
+    ++stats_.frames;
+}
+
+FramePresenter::Stats FramePresenter::TakeStats() {
+    const Stats stats = stats_;
+    stats_ = kEmptyStats;
+    return stats;
+}
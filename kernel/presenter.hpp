@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include "frame_buffer_config.hpp"
+#include "shadow_buffer.hpp"
+
+/**
+ * 影のバッファ (後ろのバッファ) に描いたフレームを VRAM (表示中のバッファ) へまとめて表示する
+ * 描画の途中の状態が見えないように、描画した側は VRAM へ直接転送せず、
+ * 一定の間隔 (タイマー) で Present を呼んでフレーム単位で転送する。
+ *
+ * GOP には表示するバッファの位置を切り替える機能が無いので、ページフリップではなくコピーで表示する。
+ * 変更のあった面積が画面の 1 / kFullFrameDivisor 以上なら画面全体を ParallelBlit で
+ * 複数の CPU に分けて転送し、それ未満なら変更のあった矩形だけを転送する。
+ **/
+class FramePresenter {
+public:
+    static const int kFullFrameDivisor = 2;
+
+    // 時間はすべて TSC のカウント数
+    struct Stats {
+        uint64_t frames;
+        // 画面全体を転送したフレームの数
+        uint64_t full_frames;
+        // 前回の Present からの間隔 (フレーム時間) と、その計測回数
+        uint64_t min_interval, max_interval, total_interval, intervals;
+        // Present にかかった時間
+        uint64_t min_cost, max_cost, total_cost;
+        uint64_t bytes_presented;
+    };
+
+    FramePresenter(ShadowBuffer& back_buffer, const FrameBufferConfig& vram);
+
+    void Present();
+    // 統計を返し、集計をやり直す
+    Stats TakeStats();
+
+private:
+    ShadowBuffer& back_buffer_;
+    const FrameBufferConfig& vram_;
+    uint64_t last_present_;
+    Stats stats_;
+};
@@ -0,0 +1,416 @@
+#include "rasterizer.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+    // クリップ矩形を画面の範囲に収めたもの。[x0, x1) x [y0, y1)
+    struct ClipBox {
+        long x0, y0, x1, y1;
+    };
+
+    bool MakeClipBox(const FrameBufferConfig& config, Rectangle clip, ClipBox& box) {
+        if (!ClipRect(clip.x,
+                clip.y,
+                clip.width,
+                clip.height,
+                config.horizontal_resolution,
+                config.vertical_resolution))
+        {
+            return false;
+        }
+        box = {clip.x, clip.y, clip.x + clip.width, clip.y + clip.height};
+        return true;
+    }
+
+    /**
+     * 図形の外接矩形 [x0, x1) x [y0, y1) を box に収める
+     * 描くべき部分が残らなければ false を返し、図形の走査そのものを省く
+     **/
+    bool ClipBounds(const ClipBox& box, long x0, long y0, long x1, long y1, ClipBox& bounds) {
+        bounds = {std::max(x0, box.x0),
+            std::max(y0, box.y0),
+            std::min(x1, box.x1),
+            std::min(y1, box.y1)};
+        return bounds.x0 < bounds.x1 && bounds.y0 < bounds.y1;
+    }
+
+    long FloorDiv(long a, long b) {
+        return a / b - (a % b != 0 && (a < 0) != (b < 0));
+    }
+
+    struct QuotRem {
+        long quot, rem;
+    };
+
+    /**
+     * (a * b + c) / d の商と余りを、a * b が long に収まらなくても正しく求める
+     * 0 <= a, 0 <= b, 0 <= c < d, d < 2^62 で、商が long に収まること。
+     * 画面から遠く離れた座標では積が 64 ビットを超える。__int128 の割り算は
+     * ライブラリ関数 (__divti3) の呼び出しになり、カーネルにはリンクされないので、
+     * そのときだけ b を上位ビットから1ビットずつ処理する筆算で求める
+     **/
+    QuotRem MulAddDiv(long a, long b, long c, long d) {
+        long ab;
+        if (!__builtin_mul_overflow(a, b, &ab) && !__builtin_add_overflow(ab, c, &ab)) {
+            return {ab / d, ab % d};
+        }
+        // a = aq * d + ar とすると、(a * b + c) / d = aq * b + (ar * b + c) / d
+        const long ar = a % d;
+        long quot = 0, rem = 0;
+        auto add = [&](long x) {
+            rem += x;
+            if (rem >= d) {
+                rem -= d;
+                ++quot;
+            }
+        };
+        for (int bit = 63 - __builtin_clzl(b); bit >= 0; --bit) {
+            quot *= 2;
+            add(rem);
+            if ((b >> bit) & 1) add(ar);
+        }
+        add(c);
+        return {a / d * b + quot, rem};
+    }
+
+    /**
+     * 図形を描く共通の手順
+     * ピクセル形式の分岐と色の変換は図形ごとに1回だけ行い、rasterize が emit(x, y, width) で出す
+     * クリップ済みのスパンを通常のストアで書き込む。スパンは短いことが多いので、
+     * 非テンポラルストアの FillPixels32 (呼び出しごとに sfence が入る) は使わない。
+     * 通知は外接矩形について1回だけ行う
+     **/
+    template <typename Rasterize>
+    void Draw(const FrameBufferConfig& config,
+        const ClipBox& bounds,
+        const PixelColor& c,
+        DamageTracker* tracker,
+        Rasterize&& rasterize) {
+        DispatchPixelFormat(config, [&](auto& writer) {
+            const uint32_t value = writer.Encode(c);
+            rasterize([&](long x, long y, long width) {
+                std::fill_n(writer.PixelAt(x, y), width, value);
+            });
+        });
+        if (tracker) {
+            tracker->MarkDirty({static_cast<int>(bounds.x0),
+                static_cast<int>(bounds.y0),
+                static_cast<int>(bounds.x1 - bounds.x0),
+                static_cast<int>(bounds.y1 - bounds.y0)});
+        }
+    }
+
+    // 行 y の [x0, x1] (両端を含む) を box に収めてから出す
+    template <typename Emit>
+    void EmitClipped(const ClipBox& box, long x0, long x1, long y, Emit& emit) {
+        if (y < box.y0 || y >= box.y1) return;
+        x0 = std::max(x0, box.x0);
+        x1 = std::min(x1, box.x1 - 1);
+        if (x0 <= x1) emit(x0, y, x1 - x0 + 1);
+    }
+
+    /**
+     * Bresenham のアルゴリズムで線分を走査する
+     * 変化の大きい方の軸を主軸 u、もう一方を副軸 v とすると、u0 から k 番目のピクセルの v は
+     *   v0 + sv * q(k), q(k) = floor((2 * dv * k + du) / (2 * du))
+     * で、誤差項 r = (2 * dv * k + du) mod (2 * du) を 2 * dv ずつ増やして求められる。
+     * q(k) は k について単調なので、v がクリップ範囲に入る k の範囲を先に割り算で求め、
+     * その範囲の先頭の誤差項から走査を始める。範囲外のピクセルは1つも訪れない。
+     **/
+    template <typename Emit>
+    void RasterizeLine(const ClipBox& box, Point p0, Point p1, Emit& emit) {
+        const bool steep = std::abs(long {p1.y} - p0.y) > std::abs(long {p1.x} - p0.x);
+        long u0 = steep ? p0.y : p0.x, v0 = steep ? p0.x : p0.y;
+        long u1 = steep ? p1.y : p1.x, v1 = steep ? p1.x : p1.y;
+        if (u0 > u1) {
+            std::swap(u0, u1);
+            std::swap(v0, v1);
+        }
+        const long umin = steep ? box.y0 : box.x0, umax = (steep ? box.y1 : box.x1) - 1;
+        const long vmin = steep ? box.x0 : box.y0, vmax = (steep ? box.x1 : box.y1) - 1;
+        const long du = u1 - u0, dv = std::abs(v1 - v0);
+        const long sv = v1 >= v0 ? 1 : -1;
+
+        if (du == 0) {
+            // 始点と終点が同じ
+            EmitClipped(box, p0.x, p0.x, p0.y, emit);
+            return;
+        }
+
+        // v がクリップ範囲に入る q の範囲 [qlo, qhi] から、u の範囲 [ustart, uend] を求める
+        long qlo = sv > 0 ? vmin - v0 : v0 - vmax;
+        long qhi = sv > 0 ? vmax - v0 : v0 - vmin;
+        qlo = std::max(qlo, 0L);
+        qhi = std::min(qhi, dv);
+        if (qlo > qhi) return;
+        long ustart = std::max(u0, umin), uend = std::min(u1, umax);
+        if (dv > 0) {
+            // q(k) >= qlo となる最初の k は ceil(du * (2 * qlo - 1) / (2 * dv))。qlo = 0 なら 0
+            if (qlo > 0) {
+                ustart = std::max(ustart, u0 + MulAddDiv(du, 2 * qlo - 1, 2 * dv - 1, 2 * dv).quot);
+            }
+            // q(k) <= qhi となる最後の k は floor((du * (2 * qhi + 1) - 1) / (2 * dv))
+            const auto last = MulAddDiv(du, 2 * qhi + 1, 0, 2 * dv);
+            uend = std::min(uend, u0 + last.quot - (last.rem == 0));
+        }
+        if (ustart > uend) return;
+
+        const auto start = MulAddDiv(2 * dv, ustart - u0, du, 2 * du);
+        long v = v0 + sv * start.quot;
+        long r = start.rem;
+        if (steep) {
+            // 各行に1ピクセルずつ
+            for (long u = ustart; u <= uend; ++u) {
+                emit(v, u, 1);
+                r += 2 * dv;
+                if (r >= 2 * du) {
+                    r -= 2 * du;
+                    v += sv;
+                }
+            }
+            return;
+        }
+        // 同じ行に続くピクセルは1つのスパンにまとめる
+        long run_start = ustart;
+        for (long u = ustart; u <= uend; ++u) {
+            r += 2 * dv;
+            if (r >= 2 * du) {
+                emit(run_start, v, u - run_start + 1);
+                r -= 2 * du;
+                v += sv;
+                run_start = u + 1;
+            }
+        }
+        if (run_start <= uend) emit(run_start, v, uend - run_start + 1);
+    }
+
+    /**
+     * 中点アルゴリズムで、円の 1/8 (x >= y) を y = 0 から x = y まで走査する
+     * on_step(x, y) は各ステップで、on_run(x, y_begin, y_end) は x が変わる直前に、
+     * その x で走査した y の範囲を渡して呼ぶ
+     **/
+    template <typename OnStep, typename OnRun>
+    void WalkCircleOctant(long radius, OnStep&& on_step, OnRun&& on_run) {
+        long x = radius, y = 0, d = 1 - radius;
+        long run_start = 0;
+        while (x >= y) {
+            on_step(x, y);
+            const long next_y = y + 1;
+            long next_x = x;
+            if (d < 0) {
+                d += 2 * next_y + 1;
+            } else {
+                --next_x;
+                d += 2 * (next_y - next_x) + 1;
+            }
+            if (next_x != x || next_x < next_y) {
+                on_run(x, run_start, y);
+                run_start = next_y;
+            }
+            x = next_x;
+            y = next_y;
+        }
+    }
+
+    template <typename Emit>
+    void RasterizeCircle(const ClipBox& box, Point center, long radius, bool fill, Emit& emit) {
+        const long cx = center.x, cy = center.y;
+        // 中心から上下に dy だけ離れた2行に、中心から左右対称な区間を出す
+        auto rows = [&](long dy, long x0, long x1) {
+            EmitClipped(box, x0, x1, cy + dy, emit);
+            if (dy != 0) EmitClipped(box, x0, x1, cy - dy, emit);
+        };
+        if (fill) {
+            WalkCircleOctant(
+                radius,
+                [&](long x, long y) { rows(y, cx - x, cx + x); },
+                [&](long x, long, long y_end) { rows(x, cx - y_end, cx + y_end); });
+            return;
+        }
+        WalkCircleOctant(
+            radius,
+            [&](long x, long y) {
+                rows(y, cx - x, cx - x);
+                rows(y, cx + x, cx + x);
+            },
+            [&](long x, long y_begin, long y_end) {
+                if (y_begin == 0) {
+                    rows(x, cx - y_end, cx + y_end);
+                } else {
+                    rows(x, cx - y_end, cx - y_begin);
+                    rows(x, cx + y_begin, cx + y_end);
+                }
+            });
+    }
+
+    /**
+     * 多角形の辺。行 [y_begin, y_end) と交わり、x は現在の行の中心 (y + 0.5) での交点
+     * x と dx は 16.16 の固定小数点数
+     **/
+    struct PolygonEdge {
+        long y_begin, y_end;
+        long x, dx;
+    };
+
+    const long kFixedOne = 1L << 16;
+
+    // 固定小数点数の x について、中心が x 以上にある最初のピクセル (ceil(x - 0.5))
+    long FirstPixelAtOrAfter(long x) {
+        return FloorDiv(x + kFixedOne / 2 - 1, kFixedOne);
+    }
+
+    /**
+     * 辺の表 (Edge Table) を y_begin の順に並べ、上の行から順に、その行と交わる辺の表
+     * (Active Edge Table) を更新しながら塗る。辺の表は最初にクリップ範囲の行に切り詰めておく
+     **/
+    template <typename Emit>
+    void RasterizePolygon(
+        const ClipBox& box, const ClipBox& bounds, const Point* points, int n, Emit& emit) {
+        PolygonEdge edges[kMaxPolygonVertices];
+        int num_edges = 0;
+        for (int i = 0; i < n; ++i) {
+            Point a = points[i], b = points[(i + 1) % n];
+            // 水平な辺はどの行の中心とも交わらない
+            if (a.y == b.y) continue;
+            if (a.y > b.y) std::swap(a, b);
+            const long y_begin = std::max<long>(a.y, bounds.y0);
+            const long y_end = std::min<long>(b.y, bounds.y1);
+            if (y_begin >= y_end) continue;
+
+            const long ex = long {b.x} - a.x, ey = long {b.y} - a.y;
+            // 行 y_begin の中心での交点: a.x + (y_begin + 0.5 - a.y) * ex / ey
+            // 頂点が画面から遠いと積が long に収まらないので、MulAddDiv で切り捨てる
+            const auto offset
+                = MulAddDiv(2 * (y_begin - a.y) + 1, std::abs(ex) * kFixedOne, 0, 2 * ey);
+            const long x = a.x * kFixedOne
+                + (ex >= 0 ? offset.quot : -offset.quot - (offset.rem != 0));
+            edges[num_edges++] = {y_begin, y_end, x, FloorDiv(ex * kFixedOne, ey)};
+        }
+        std::sort(edges, edges + num_edges, [](const PolygonEdge& a, const PolygonEdge& b) {
+            return a.y_begin < b.y_begin;
+        });
+
+        PolygonEdge* active[kMaxPolygonVertices];
+        int num_active = 0, next_edge = 0;
+        for (long y = bounds.y0; y < bounds.y1; ++y) {
+            // この行から交わる辺を加え、もう交わらない辺を除く
+            while (next_edge < num_edges && edges[next_edge].y_begin == y) {
+                active[num_active++] = &edges[next_edge++];
+            }
+            int kept = 0;
+            for (int i = 0; i < num_active; ++i) {
+                if (active[i]->y_end > y) active[kept++] = active[i];
+            }
+            num_active = kept;
+            if (num_active == 0 && next_edge == num_edges) break;
+
+            // 交点は前の行とほとんど同じ順に並んでいるので、挿入ソートで並べ直す
+            for (int i = 1; i < num_active; ++i) {
+                PolygonEdge* e = active[i];
+                int j = i;
+                for (; j > 0 && active[j - 1]->x > e->x; --j) active[j] = active[j - 1];
+                active[j] = e;
+            }
+
+            // 偶奇規則: 左から2つずつ組にした交点の間が内部
+            for (int i = 0; i + 1 < num_active; i += 2) {
+                EmitClipped(box,
+                    FirstPixelAtOrAfter(active[i]->x),
+                    FirstPixelAtOrAfter(active[i + 1]->x) - 1,
+                    y,
+                    emit);
+            }
+            for (int i = 0; i < num_active; ++i) active[i]->x += active[i]->dx;
+        }
+    }
+}  // namespace
+
+void DrawLine(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    Point p0,
+    Point p1,
+    const PixelColor& c,
+    DamageTracker* tracker) {
+    ClipBox box, bounds;
+    if (!MakeClipBox(config, clip, box)
+        || !ClipBounds(box,
+            std::min(p0.x, p1.x),
+            std::min(p0.y, p1.y),
+            std::max(p0.x, p1.x) + 1L,
+            std::max(p0.y, p1.y) + 1L,
+            bounds))
+    {
+        return;
+    }
+    Draw(config, bounds, c, tracker, [&](auto&& emit) { RasterizeLine(box, p0, p1, emit); });
+}
+
+void DrawCircle(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    Point center,
+    int radius,
+    const PixelColor& c,
+    DamageTracker* tracker) {
+    ClipBox box, bounds;
+    if (radius < 0 || !MakeClipBox(config, clip, box)
+        || !ClipBounds(box,
+            center.x - long {radius},
+            center.y - long {radius},
+            center.x + long {radius} + 1,
+            center.y + long {radius} + 1,
+            bounds))
+    {
+        return;
+    }
+    Draw(config, bounds, c, tracker, [&](auto&& emit) {
+        RasterizeCircle(box, center, radius, false, emit);
+    });
+}
+
+void FillCircle(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    Point center,
+    int radius,
+    const PixelColor& c,
+    DamageTracker* tracker) {
+    ClipBox box, bounds;
+    if (radius < 0 || !MakeClipBox(config, clip, box)
+        || !ClipBounds(box,
+            center.x - long {radius},
+            center.y - long {radius},
+            center.x + long {radius} + 1,
+            center.y + long {radius} + 1,
+            bounds))
+    {
+        return;
+    }
+    Draw(config, bounds, c, tracker, [&](auto&& emit) {
+        RasterizeCircle(box, center, radius, true, emit);
+    });
+}
+
+bool FillPolygon(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    const Point* points,
+    int n,
+    const PixelColor& c,
+    DamageTracker* tracker) {
+    if (n < 3 || n > kMaxPolygonVertices) return false;
+
+    long x0 = points[0].x, y0 = points[0].y, x1 = x0, y1 = y0;
+    for (int i = 1; i < n; ++i) {
+        x0 = std::min<long>(x0, points[i].x);
+        y0 = std::min<long>(y0, points[i].y);
+        x1 = std::max<long>(x1, points[i].x);
+        y1 = std::max<long>(y1, points[i].y);
+    }
+    ClipBox box, bounds;
+    if (!MakeClipBox(config, clip, box) || !ClipBounds(box, x0, y0, x1, y1, bounds)) {
+        return true;
+    }
+    Draw(config, bounds, c, tracker, [&](auto&& emit) {
+        RasterizePolygon(box, bounds, points, n, emit);
+    });
+    return true;
+}
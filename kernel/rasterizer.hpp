@@ -0,0 +1,55 @@
+#pragma once
+
+#include "frame_buffer_config.hpp"
+#include "graphics.hpp"
+
+/**
+ * 線・円・多角形を描く関数
+ * どの図形も、まず図形の範囲をクリップ矩形 (画面との共通部分) と比べて描くべき行と列を決め、
+ * 水平な区間 (スパン) に分解してから FillSpan で1行ずつ連続して書き込む。
+ * クリップ矩形の外にはみ出した部分は計算の段階で除くので、フレームバッファの外へは書き込まない。
+ * 描画した領域は、図形ごとに外接矩形 (クリップ後) を1回だけ tracker へ通知する。
+ *
+ * 座標はピクセル単位で、ピクセル (x, y) は [x, x + 1) x [y, y + 1) の正方形を占める。
+ * 頂点は画面から遠く離れていてもよく、int の範囲のどこにあっても計算は桁あふれしない。
+ **/
+
+// 多角形の頂点数の上限。辺の表をスタック上に置くため
+const int kMaxPolygonVertices = 128;
+
+// (x0, y0) から (x1, y1) まで (両端を含む) の線分を Bresenham のアルゴリズムで描く
+void DrawLine(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    Point p0,
+    Point p1,
+    const PixelColor& c,
+    DamageTracker* tracker = nullptr);
+
+// 中心 center、半径 radius の円周を中点アルゴリズムで描く
+void DrawCircle(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    Point center,
+    int radius,
+    const PixelColor& c,
+    DamageTracker* tracker = nullptr);
+
+// 中心 center、半径 radius の円の内部 (円周を含む) を塗る
+void FillCircle(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    Point center,
+    int radius,
+    const PixelColor& c,
+    DamageTracker* tracker = nullptr);
+
+/**
+ * points の n 個の頂点を順に結んだ多角形の内部を、辺の表を使う走査線アルゴリズムで塗る
+ * 凹多角形や自己交差する多角形も扱え、内部は偶奇規則で決める。
+ * 各行ではピクセルの中心 (x + 0.5, y + 0.5) が内部にあるピクセルを塗る。
+ * 頂点が 3 個未満か kMaxPolygonVertices 個より多ければ、何もせずに false を返す
+ **/
+bool FillPolygon(const FrameBufferConfig& config,
+    const Rectangle& clip,
+    const Point* points,
+    int n,
+    const PixelColor& c,
+    DamageTracker* tracker = nullptr);
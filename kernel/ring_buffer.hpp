@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+/**
+ * 書き込み側と読み出し側がそれぞれ1つだけのロックフリーなリングバッファ
+ * 書き込み側は head_ だけを、読み出し側は tail_ だけを更新するので、
+ * 割り込みハンドラと通常の処理のように並行して動く2者の間でロック無しに受け渡しができる。
+ * 容量 N は2の累乗で、位置は N で割った余りをマスクで求める。
+ **/
+template <size_t N>
+class RingBuffer {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    RingBuffer() : head_ {0}, tail_ {0} {}
+
+    static constexpr size_t Capacity() {
+        return N;
+    }
+
+    // 書き込み側: data から最大 n バイトを追加し、追加できたバイト数を返す
+    size_t Write(const char* data, size_t n) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        const size_t space = N - (head - tail);
+        if (n > space) n = space;
+
+        const size_t pos = head & (N - 1);
+        const size_t first = n < N - pos ? n : N - pos;
+        memcpy(buf_ + pos, data, first);
+        memcpy(buf_, data + first, n - first);
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // 読み出し側: 最大 n バイトを取り出して out に書き込み、取り出したバイト数を返す
+    size_t Read(char* out, size_t n) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t available = head - tail;
+        if (n > available) n = available;
+
+        const size_t pos = tail & (N - 1);
+        const size_t first = n < N - pos ? n : N - pos;
+        memcpy(out, buf_ + pos, first);
+        memcpy(out + first, buf_, n - first);
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // 取り出せるバイト数。どちらの側から呼んでも良いが、値はすぐに古くなり得る
+    size_t Size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    bool Empty() const {
+        return Size() == 0;
+    }
+
+private:
+    // 位置は N で割らずに増やし続け、差を取ることで満杯と空を区別する
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+    char buf_[N];
+};
@@ -0,0 +1,23 @@
+#include "serial.hpp"
+
+#include <cstring>
+#include <new>
+
+namespace {
+    alignas(KernelSerialPort) char serial_port_buf[sizeof(KernelSerialPort)];
+}
+
+KernelSerialPort* serial_port;
+
+void InitializeSerial() {
+    serial_port = new (serial_port_buf) KernelSerialPort {kCOM1};
+    serial_port->Initialize();
+}
+
+void SerialWrite(const char* s) {
+    if (serial_port) serial_port->Write(s, strlen(s));
+}
+
+void SerialFlush() {
+    if (serial_port) serial_port->Flush();
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "asmfunc.h"
+#include "ring_buffer.hpp"
+
+namespace serial_detail {
+    // 16550 UART のレジスタ (ベースの I/O ポートからのオフセット)
+    const uint16_t kData = 0;             // 送受信データ (DLAB=1 のときは分周比の下位)
+    const uint16_t kInterruptEnable = 1;  // 割り込み許可 (DLAB=1 のときは分周比の上位)
+    const uint16_t kFIFOControl = 2;      // 書き込み時は FIFO 制御
+    const uint16_t kLineControl = 3;
+    const uint16_t kModemControl = 4;
+    const uint16_t kLineStatus = 5;
+
+    // 送信 FIFO が空であることを示す LSR のビット
+    const uint8_t kTransmitEmpty = 0x20;
+    // 送信 FIFO の大きさ。空になるたびにこのバイト数までまとめて書き込める
+    const size_t kFIFOBytes = 16;
+}  // namespace serial_detail
+
+/**
+ * 16550 UART のシリアルポート
+ * 書き込みはリングバッファへのコピーだけで終わり、UART への送信は Drain でまとめて行う。
+ * Drain は送信 FIFO が空いているときに最大 kFIFOBytes バイトを書き込み、FIFO が空くのは待たない。
+ * 送信はポーリングで行う。呼び出し側が適当な時点 (タイマーなど) で Drain または Flush を呼ぶ。
+ * (UART の割り込みを IOAPIC から受け取る仕組みはまだ無い)
+ *
+ * リングバッファの書き込み側は1つだけ (ロギングを行う処理)、読み出し側も1つだけ
+ * (Drain の呼び出し元) とすること。
+ * リングバッファが一杯になったときは、ログを失わないよう書き込み側が自分で送信して空ける。
+ **/
+template <size_t kRingBytes>
+class SerialPort {
+public:
+    struct Stats {
+        // Write で受け取ったバイト数と、UART へ送ったバイト数
+        uint64_t bytes_written;
+        uint64_t bytes_sent;
+        // リングバッファが一杯で書き込み側が待った回数
+        uint64_t producer_stalls;
+    };
+
+    explicit SerialPort(uint16_t base) :
+        base_ {base}, stats_ {} {}
+
+    // 115200 bps、8 ビット、パリティなし、ストップビット 1、FIFO 有効で初期化する
+    void Initialize() {
+        using namespace serial_detail;
+        IoOut8(base_ + kInterruptEnable, 0x00);
+        IoOut8(base_ + kLineControl, 0x80);  // DLAB=1 にして分周比を設定する
+        IoOut8(base_ + kData, 0x01);         // 115200 / 1 = 115200 bps
+        IoOut8(base_ + kInterruptEnable, 0x00);
+        IoOut8(base_ + kLineControl, 0x03);
+        IoOut8(base_ + kFIFOControl, 0xc7);   // FIFO を有効にしてクリアする
+        IoOut8(base_ + kModemControl, 0x03);  // DTR, RTS (割り込みは使わない)
+    }
+
+    void Write(const char* s, size_t n) {
+        stats_.bytes_written += n;
+        while (n > 0) {
+            const size_t written = ring_.Write(s, n);
+            s += written;
+            n -= written;
+            if (n == 0) break;
+
+            // 一杯なら自分で送信して空ける
+            ++stats_.producer_stalls;
+            Drain();
+        }
+    }
+
+    // 送信 FIFO が空いていれば、最大 kFIFOBytes バイトを送る。送ったバイト数を返す
+    size_t Drain() {
+        using namespace serial_detail;
+        if ((IoIn8(base_ + kLineStatus) & kTransmitEmpty) == 0) return 0;
+
+        char batch[kFIFOBytes];
+        const size_t n = ring_.Read(batch, kFIFOBytes);
+        for (size_t i = 0; i < n; ++i) {
+            IoOut8(base_ + kData, batch[i]);
+        }
+        stats_.bytes_sent += n;
+        return n;
+    }
+
+    // リングバッファが空になるまで送信する
+    void Flush() {
+        while (!ring_.Empty()) {
+            if (Drain() == 0) __asm__ volatile("pause");
+        }
+    }
+
+    bool Empty() const {
+        return ring_.Empty();
+    }
+
+    Stats GetStats() const {
+        return stats_;
+    }
+
+private:
+    const uint16_t base_;
+    Stats stats_;
+    RingBuffer<kRingBytes> ring_;
+};
+
+// カーネルのログに使う COM1 のシリアルポート
+const uint16_t kCOM1 = 0x3f8;
+const size_t kSerialRingBytes = 64 * 1024;
+using KernelSerialPort = SerialPort<kSerialRingBytes>;
+
+extern KernelSerialPort* serial_port;
+
+void InitializeSerial();
+// 文字列をリングバッファへコピーする。初期化前の呼び出しは無視する
+void SerialWrite(const char* s);
+// 溜まっているログを全て送信する。停止する前などに呼ぶ
+void SerialFlush();
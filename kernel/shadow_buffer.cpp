@@ -0,0 +1,120 @@
+#include "shadow_buffer.hpp"
+
+#include "simd.hpp"
+
+namespace {
+    /**
+     * 重なるか、辺で接していれば統合する
+     * 角だけで接する矩形は、統合すると塗っていない領域が増えるので統合しない
+     **/
+    bool ShouldMerge(const Rectangle& a, const Rectangle& b) {
+        const bool x_overlaps = a.x < b.x + b.width && b.x < a.x + a.width;
+        const bool y_overlaps = a.y < b.y + b.height && b.y < a.y + a.height;
+        const bool x_touches = a.x <= b.x + b.width && b.x <= a.x + a.width;
+        const bool y_touches = a.y <= b.y + b.height && b.y <= a.y + a.height;
+        return (x_overlaps && y_touches) || (x_touches && y_overlaps);
+    }
+
+    Rectangle Union(const Rectangle& a, const Rectangle& b) {
+        const int x0 = a.x < b.x ? a.x : b.x;
+        const int y0 = a.y < b.y ? a.y : b.y;
+        const int x1 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+        const int y1 = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+        return {x0, y0, x1 - x0, y1 - y0};
+    }
+
+    long Area(const Rectangle& r) {
+        return static_cast<long>(r.width) * r.height;
+    }
+}  // namespace
+
+void DirtyRegion::Add(Rectangle area) {
+    if (area.width <= 0 || area.height <= 0) return;
+
+    Absorb(area);
+    if (num_rects_ == kMaxRects) {
+        int best = 0;
+        long best_growth = Area(Union(rects_[0], area)) - Area(rects_[0]);
+        for (int i = 1; i < num_rects_; ++i) {
+            const long growth = Area(Union(rects_[i], area)) - Area(rects_[i]);
+            if (growth < best_growth) {
+                best = i;
+                best_growth = growth;
+            }
+        }
+        area = Union(rects_[best], area);
+        Remove(best);
+        // 広がった area が他の矩形と重なるようになることがある
+        Absorb(area);
+    }
+    rects_[num_rects_++] = area;
+}
+
+void DirtyRegion::Absorb(Rectangle& area) {
+    // 統合した結果が別の矩形と重なるようになることがあるので、統合できなくなるまで繰り返す
+    for (int i = 0; i < num_rects_;) {
+        if (ShouldMerge(rects_[i], area)) {
+            area = Union(rects_[i], area);
+            Remove(i);
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+}
+
+void DirtyRegion::Remove(int index) {
+    rects_[index] = rects_[num_rects_ - 1];
+    --num_rects_;
+}
+
+size_t ShadowBuffer::BytesRequired(const FrameBufferConfig& vram) {
+    return 4 * static_cast<size_t>(vram.horizontal_resolution) * vram.vertical_resolution;
+}
+
+ShadowBuffer::ShadowBuffer(const FrameBufferConfig& vram, uint8_t* buffer) :
+    vram_ {vram}, config_ {vram}, converter_ {vram.pixel_bitmask}, dirty_ {}, stats_ {} {
+    // 影のバッファには余白を持たせず、1行を水平解像度ぴったりにする
+    config_.frame_buffer = buffer;
+    if (vram.pixel_format == kPixelBitMask) {
+        config_.pixel_format = kPixelBGRResv8BitPerColor;
+    }
+    config_.pixels_per_scan_line = vram.horizontal_resolution;
+    config_.frame_buffer_size = BytesRequired(vram);
+}
+
+void ShadowBuffer::MarkDirty(const Rectangle& area) {
+    stats_.bytes_drawn += 4 * Area(area);
+    dirty_.Add(area);
+}
+
+uint64_t ShadowBuffer::DirtyPixels() const {
+    uint64_t pixels = 0;
+    for (const Rectangle& r : dirty_) {
+        pixels += Area(r);
+    }
+    return pixels;
+}
+
+void ShadowBuffer::Flush() {
+    auto src_base = reinterpret_cast<const uint32_t*>(config_.frame_buffer);
+    const BitMaskConverter* converter = Converter();
+    const size_t bytes_per_pixel = converter ? converter->BytesPerPixel() : 4;
+    const size_t dst_pitch = bytes_per_pixel * vram_.pixels_per_scan_line;
+    for (const Rectangle& r : dirty_) {
+        const uint32_t* src = src_base + config_.pixels_per_scan_line * r.y + r.x;
+        uint8_t* dst = vram_.frame_buffer + dst_pitch * r.y + bytes_per_pixel * r.x;
+        for (int dy = 0; dy < r.height; ++dy) {
+            if (converter) {
+                converter->Convert(dst, src, r.width);
+            } else {
+                CopyPixels32(reinterpret_cast<uint32_t*>(dst), src, r.width);
+            }
+            src += config_.pixels_per_scan_line;
+            dst += dst_pitch;
+        }
+        stats_.bytes_flushed += bytes_per_pixel * Area(r);
+    }
+    ++stats_.num_flushes;
+    dirty_.Clear();
+}
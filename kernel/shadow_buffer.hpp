@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "frame_buffer_config.hpp"
+#include "graphics.hpp"
+#include "pixel_bitmask.hpp"
+
+/**
+ * 再描画が必要な矩形の集合
+ * 重なり合う矩形と、辺で接する矩形 (横に並んだ文字など) は1つに統合する。
+ * 矩形の数が上限に達したら、統合しても面積の増加が最も少ない矩形と統合する。
+ * どの場合も、集合の中の矩形どうしは重ならない。
+ **/
+class DirtyRegion {
+public:
+    static const int kMaxRects = 32;
+
+    void Add(Rectangle area);
+    void Clear() {
+        num_rects_ = 0;
+    }
+
+    const Rectangle* begin() const {
+        return rects_;
+    }
+    const Rectangle* end() const {
+        return rects_ + num_rects_;
+    }
+    int Count() const {
+        return num_rects_;
+    }
+
+private:
+    void Remove(int index);
+    // area と重なるか辺で接する矩形を集合から取り除き、area に統合する
+    void Absorb(Rectangle& area);
+
+    Rectangle rects_[kMaxRects];
+    int num_rects_ = 0;
+};
+
+/**
+ * 通常の RAM 上に置く影のフレームバッファ
+ * フレームバッファ (VRAM) はキャッシュ不可または Write-Combining の領域なので、
+ * 読み出しや同じ場所への重ね描きが非常に遅い。
+ * 描画は影のバッファに対して行い、Flush で変更のあった矩形だけを VRAM へ転送する。
+ * VRAM が kPixelBitMask の形式なら、影のバッファは kPixelBGRResv8BitPerColor の32ビット値で持ち、
+ * 転送するときに BitMaskConverter で VRAM の形式へ変換する。
+ **/
+class ShadowBuffer : public DamageTracker {
+public:
+    struct Stats {
+        // 描画関数が影のバッファへ書き込んだバイト数 (重ね描きを含む)
+        uint64_t bytes_drawn;
+        // Flush で VRAM へ転送したバイト数 (VRAM 側のピクセル形式でのバイト数)
+        uint64_t bytes_flushed;
+        uint64_t num_flushes;
+    };
+
+    // vram と同じ解像度の影のバッファに必要なバイト数
+    static size_t BytesRequired(const FrameBufferConfig& vram);
+
+    /**
+     * buffer は BytesRequired(vram) バイト以上の RAM 上の領域
+     * 描画先として Config() を PixelWriter に渡し、このオブジェクトを DamageTracker として登録する
+     **/
+    ShadowBuffer(const FrameBufferConfig& vram, uint8_t* buffer);
+
+    const FrameBufferConfig& Config() const {
+        return config_;
+    }
+
+    virtual void MarkDirty(const Rectangle& area) override;
+    // 変更のあった矩形を VRAM へ転送し、変更の記録を消去する
+    void Flush();
+    // 変更のあった矩形の面積の合計 (ピクセル数)。重なりは統合済みなので二重には数えない
+    uint64_t DirtyPixels() const;
+    // 呼び出し側が画面全体を転送した後などに、変更の記録だけを消去する
+    void ClearDirty() {
+        dirty_.Clear();
+    }
+    // 呼び出し側が Flush を使わずに VRAM へ転送したバイト数を統計に加える
+    void RecordFlush(uint64_t bytes) {
+        stats_.bytes_flushed += bytes;
+        ++stats_.num_flushes;
+    }
+
+    const Stats& GetStats() const {
+        return stats_;
+    }
+
+    // VRAM への転送で形式の変換が必要なら、その変換器を返す。不要なら nullptr
+    const BitMaskConverter* Converter() const {
+        return vram_.pixel_format == kPixelBitMask ? &converter_ : nullptr;
+    }
+
+private:
+    const FrameBufferConfig& vram_;
+    FrameBufferConfig config_;
+    BitMaskConverter converter_;
+    DirtyRegion dirty_;
+    Stats stats_;
+};
@@ -0,0 +1,291 @@
+#include "simd.hpp"
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+namespace {
+    /**
+     * dst を align バイト境界に揃えるために、先に1ピクセルずつ処理するピクセル数
+     * 非テンポラルストアはストア先が整列している必要がある
+     **/
+    size_t HeadPixels(const uint32_t* dst, size_t align, size_t n) {
+        const size_t misalign = reinterpret_cast<uintptr_t>(dst) & (align - 1);
+        const size_t head = misalign ? (align - misalign) / sizeof(uint32_t) : 0;
+        return head < n ? head : n;
+    }
+
+    uint32_t BlendOne(uint32_t d, uint32_t s, unsigned int alpha) {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            const uint32_t sc = (s >> shift) & 0xff, dc = (d >> shift) & 0xff;
+            result |= ((sc * alpha + dc * (256 - alpha)) >> 8) << shift;
+        }
+        return result;
+    }
+
+    uint32_t BlendAlphaOne(uint32_t d, uint32_t s) {
+        const unsigned int a = s >> 24;
+        return BlendOne(d, s, a + (a >> 7));
+    }
+
+    uint32_t SwizzleOne(uint32_t v) {
+        return (v & 0xff00ff00u) | ((v >> 16) & 0xffu) | ((v & 0xffu) << 16);
+    }
+
+    // SSE2 版: x86-64 では常に利用できるので、これを既定値とする
+
+    void FillSSE2(uint32_t* dst, size_t n, uint32_t value) {
+        const size_t head = HeadPixels(dst, 16, n);
+        for (size_t i = 0; i < head; ++i) dst[i] = value;
+        dst += head;
+        n -= head;
+
+        const __m128i v = _mm_set1_epi32(value);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), v);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + 4), v);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + 8), v);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + 12), v);
+        }
+        for (; i + 4 <= n; i += 4) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        for (; i < n; ++i) dst[i] = value;
+        _mm_sfence();
+    }
+
+    void CopySSE2(uint32_t* dst, const uint32_t* src, size_t n) {
+        const size_t head = HeadPixels(dst, 16, n);
+        for (size_t i = 0; i < head; ++i) dst[i] = src[i];
+        dst += head;
+        src += head;
+        n -= head;
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), a);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + 4), b);
+        }
+        for (; i < n; ++i) dst[i] = src[i];
+        _mm_sfence();
+    }
+
+    void BlendSSE2(uint32_t* dst, const uint32_t* src, size_t n, unsigned int alpha) {
+        const size_t head = HeadPixels(dst, 16, n);
+        for (size_t i = 0; i < head; ++i) dst[i] = BlendOne(dst[i], src[i], alpha);
+        dst += head;
+        src += head;
+        n -= head;
+
+        // 各色を16ビットに広げて掛け算する。255 * 256 は16ビットに収まる
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i a = _mm_set1_epi16(alpha);
+        const __m128i ia = _mm_set1_epi16(256 - alpha);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i d = _mm_load_si128(reinterpret_cast<const __m128i*>(dst + i));
+            const __m128i lo = _mm_srli_epi16(
+                _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), a),
+                    _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia)),
+                8);
+            const __m128i hi = _mm_srli_epi16(
+                _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), a),
+                    _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia)),
+                8);
+            _mm_store_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+        for (; i < n; ++i) dst[i] = BlendOne(dst[i], src[i], alpha);
+    }
+
+    void SwizzleSSE2(uint32_t* dst, const uint32_t* src, size_t n) {
+        const size_t head = HeadPixels(dst, 16, n);
+        for (size_t i = 0; i < head; ++i) dst[i] = SwizzleOne(src[i]);
+        dst += head;
+        src += head;
+        n -= head;
+
+        // SSE2 には pshufb が無いので、マスクとシフトでバイト0とバイト2を入れ替える
+        const __m128i keep = _mm_set1_epi32(0xff00ff00);
+        const __m128i low = _mm_set1_epi32(0x000000ff);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i v = _mm_or_si128(_mm_and_si128(s, keep),
+                _mm_or_si128(_mm_and_si128(_mm_srli_epi32(s, 16), low),
+                    _mm_slli_epi32(_mm_and_si128(s, low), 16)));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+        for (; i < n; ++i) dst[i] = SwizzleOne(src[i]);
+        _mm_sfence();
+    }
+
+    // 16ビットに広げた2ピクセル分の src と dst を、src の不透明度で合成する
+    __m128i BlendAlpha16SSE2(__m128i s, __m128i d) {
+        // 各ピクセルの不透明度 (レーン3) を、そのピクセルの4つのレーンに複製する
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+        a = _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+        const __m128i ia = _mm_sub_epi16(_mm_set1_epi16(256), a);
+        return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia)), 8);
+    }
+
+    void BlendAlphaSSE2(uint32_t* dst, const uint32_t* src, size_t n) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            const __m128i lo
+                = BlendAlpha16SSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            const __m128i hi
+                = BlendAlpha16SSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+        for (; i < n; ++i) dst[i] = BlendAlphaOne(dst[i], src[i]);
+    }
+
+    // AVX2 版: 32バイト単位で処理する
+
+    __attribute__((target("avx2"))) void FillAVX2(uint32_t* dst, size_t n, uint32_t value) {
+        const size_t head = HeadPixels(dst, 32, n);
+        for (size_t i = 0; i < head; ++i) dst[i] = value;
+        dst += head;
+        n -= head;
+
+        const __m256i v = _mm256_set1_epi32(value);
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), v);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i + 8), v);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i + 16), v);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i + 24), v);
+        }
+        for (; i + 8 <= n; i += 8) {
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        }
+        for (; i < n; ++i) dst[i] = value;
+        _mm_sfence();
+    }
+
+    __attribute__((target("avx2"))) void CopyAVX2(uint32_t* dst, const uint32_t* src, size_t n) {
+        const size_t head = HeadPixels(dst, 32, n);
+        for (size_t i = 0; i < head; ++i) dst[i] = src[i];
+        dst += head;
+        src += head;
+        n -= head;
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), a);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i + 8), b);
+        }
+        for (; i < n; ++i) dst[i] = src[i];
+        _mm_sfence();
+    }
+
+    __attribute__((target("avx2"))) void BlendAVX2(
+        uint32_t* dst, const uint32_t* src, size_t n, unsigned int alpha) {
+        const size_t head = HeadPixels(dst, 32, n);
+        for (size_t i = 0; i < head; ++i) dst[i] = BlendOne(dst[i], src[i], alpha);
+        dst += head;
+        src += head;
+        n -= head;
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i a = _mm256_set1_epi16(alpha);
+        const __m256i ia = _mm256_set1_epi16(256 - alpha);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            // unpack / pack は128ビットレーン単位で対になるので、並び順は保たれる
+            const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i d = _mm256_load_si256(reinterpret_cast<const __m256i*>(dst + i));
+            const __m256i lo = _mm256_srli_epi16(
+                _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), a),
+                    _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia)),
+                8);
+            const __m256i hi = _mm256_srli_epi16(
+                _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), a),
+                    _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia)),
+                8);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+        }
+        for (; i < n; ++i) dst[i] = BlendOne(dst[i], src[i], alpha);
+    }
+
+    __attribute__((target("avx2"))) void SwizzleAVX2(
+        uint32_t* dst, const uint32_t* src, size_t n) {
+        const size_t head = HeadPixels(dst, 32, n);
+        for (size_t i = 0; i < head; ++i) dst[i] = SwizzleOne(src[i]);
+        dst += head;
+        src += head;
+        n -= head;
+
+        const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12,
+            15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_stream_si256(
+                reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(s, shuffle));
+        }
+        for (; i < n; ++i) dst[i] = SwizzleOne(src[i]);
+        _mm_sfence();
+    }
+
+    __attribute__((target("avx2"))) __m256i BlendAlpha16AVX2(__m256i s, __m256i d) {
+        __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+        a = _mm256_add_epi16(a, _mm256_srli_epi16(a, 7));
+        const __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(256), a);
+        return _mm256_srli_epi16(
+            _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, ia)), 8);
+    }
+
+    __attribute__((target("avx2"))) void BlendAlphaAVX2(
+        uint32_t* dst, const uint32_t* src, size_t n) {
+        const __m256i zero = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            const __m256i lo
+                = BlendAlpha16AVX2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+            const __m256i hi
+                = BlendAlpha16AVX2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+        }
+        for (; i < n; ++i) dst[i] = BlendAlphaOne(dst[i], src[i]);
+    }
+
+    uint64_t ReadXCR0() {
+        uint32_t lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+
+    bool AVX2Usable() {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+        const bool osxsave = ecx & (1u << 27);
+        const bool avx = ecx & (1u << 28);
+        if (!osxsave || !avx) return false;
+        // XCR0 の SSE 状態 (bit 1) と AVX 状態 (bit 2) が両方有効になっている必要がある
+        if ((ReadXCR0() & 0x6) != 0x6) return false;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+        return ebx & (1u << 5);
+    }
+}  // namespace
+
+PixelKernels pixel_kernels = {"sse2", FillSSE2, CopySSE2, BlendSSE2, SwizzleSSE2, BlendAlphaSSE2};
+
+void SelectPixelKernels() {
+    if (AVX2Usable()) {
+        pixel_kernels = {"avx2", FillAVX2, CopyAVX2, BlendAVX2, SwizzleAVX2, BlendAlphaAVX2};
+    } else {
+        pixel_kernels = {"sse2", FillSSE2, CopySSE2, BlendSSE2, SwizzleSSE2, BlendAlphaSSE2};
+    }
+}
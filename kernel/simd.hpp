@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * 32ビットピクセル列を処理する SIMD カーネル
+ * フレームバッファは Write-Combining / キャッシュ不可の領域なので、
+ * fill / copy / swizzle の書き込みは非テンポラルストア (movntdq / vmovntdq) で行い、最後に sfence で完了させる。
+ * 実装は起動時に SelectPixelKernels が CPUID を見て SSE2 版と AVX2 版から選ぶ。
+ **/
+struct PixelKernels {
+    // 識別用の名前 ("sse2", "avx2")
+    const char* name;
+    // dst から n ピクセルを value で塗りつぶす
+    void (*fill)(uint32_t* dst, size_t n, uint32_t value);
+    // src から dst へ n ピクセルをコピーする。領域は重なっていてはいけない
+    void (*copy)(uint32_t* dst, const uint32_t* src, size_t n);
+    /**
+     * dst = (src * alpha + dst * (256 - alpha)) / 256 を各色について計算する
+     * dst を読み出すので、VRAM ではなく RAM 上のバッファに使う。そのため通常のストアで書き込む
+     **/
+    void (*blend)(uint32_t* dst, const uint32_t* src, size_t n, unsigned int alpha);
+    // バイト0とバイト2を入れ替えながらコピーする (RGB <-> BGR 変換)
+    void (*swizzle)(uint32_t* dst, const uint32_t* src, size_t n);
+    /**
+     * src のバイト3をピクセルごとの不透明度 a (0-255) として dst に重ねる
+     * dst = (src * a' + dst * (256 - a')) / 256, a' = a + a / 128 (255 を 256 として扱う)
+     * blend と同じく RAM 上のバッファに使い、通常のストアで書き込む
+     **/
+    void (*blend_alpha)(uint32_t* dst, const uint32_t* src, size_t n);
+};
+
+extern PixelKernels pixel_kernels;
+
+/**
+ * CPUID と XCR0 を調べ、利用できる最も広い命令セットのカーネルを pixel_kernels に設定する
+ * AVX2 を使うには OS が XCR0 で AVX 状態を有効にしている必要があるため、
+ * カーネルでは EnableSIMDState を呼んだ後に呼び出すこと
+ **/
+void SelectPixelKernels();
+
+inline void FillPixels32(uint32_t* dst, size_t n, uint32_t value) {
+    pixel_kernels.fill(dst, n, value);
+}
+
+inline void CopyPixels32(uint32_t* dst, const uint32_t* src, size_t n) {
+    pixel_kernels.copy(dst, src, n);
+}
+
+inline void BlendPixels32(uint32_t* dst, const uint32_t* src, size_t n, unsigned int alpha) {
+    pixel_kernels.blend(dst, src, n, alpha);
+}
+
+inline void SwizzlePixels32(uint32_t* dst, const uint32_t* src, size_t n) {
+    pixel_kernels.swizzle(dst, src, n);
+}
+
+inline void BlendAlphaPixels32(uint32_t* dst, const uint32_t* src, size_t n) {
+    pixel_kernels.blend_alpha(dst, src, n);
+}
@@ -0,0 +1,189 @@
+#include "smp.hpp"
+
+#include <atomic>
+#include <cstring>
+#include "acpi.hpp"
+#include "asmfunc.h"
+#include "cpu.hpp"
+#include "interrupt.hpp"
+#include "local_apic.hpp"
+#include "memory_manager.hpp"
+#include "paging.hpp"
+#include "parallel.hpp"
+#include "segment.hpp"
+
+// ap_trampoline.asm のラベル。コピー元の範囲と、書き換える位置を求めるために使う
+extern "C" char ap_trampoline[], ap_protected_mode[], ap_long_mode[], ap_gdt[], ap_gdtr[],
+    ap_trampoline_params[], ap_trampoline_end[];
+
+namespace {
+    // ap_trampoline.asm の ap_params と同じ配置の起動パラメータ
+    struct APTrampolineParams {
+        uint32_t pm_jump_offset;
+        uint16_t pm_jump_selector, pad0;
+        uint32_t lm_jump_offset;
+        uint16_t lm_jump_selector, pad1;
+        uint64_t cr3;
+        uint16_t kernel_gdtr_limit;
+        uint64_t kernel_gdtr_base;
+        uint8_t pad2[6];
+        uint64_t stack_top;
+        uint64_t entry;
+        uint32_t cpu_index;
+        uint16_t kernel_cs, kernel_ss;
+    } __attribute__((packed));
+    static_assert(sizeof(APTrampolineParams) == 64, "must match ap_trampoline.asm");
+
+    // ICR: delivery mode INIT / Start-up、level assert、送信待ち (delivery status) のビット
+    const uint32_t kICRInit = 0x4500;
+    const uint32_t kICRStartup = 0x4600;
+    // delivery mode Fixed、level assert。下位8ビットにベクタ番号を入れる
+    const uint32_t kICRFixed = 0x4000;
+    const uint32_t kICRDeliveryPending = 1u << 12;
+
+    // AP 1つあたりのスタックのフレーム数 (64KiB)
+    const size_t kAPStackFrames = 16;
+
+    uint8_t apic_ids[kMaxCPUs];
+    int num_cpus = 1;
+    std::atomic<bool> ap_started[kMaxCPUs];
+
+    void SendIPI(uint8_t apic_id, uint32_t command) {
+        LocalAPICRegister(kLAPICRegisterICRHigh) = static_cast<uint32_t>(apic_id) << 24;
+        LocalAPICRegister(kLAPICRegisterICRLow) = command;
+        while (LocalAPICRegister(kLAPICRegisterICRLow) & kICRDeliveryPending) {
+            __asm__ volatile("pause");
+        }
+    }
+
+    // 1つの AP が起動するのを timeout_us マイクロ秒まで待つ
+    bool WaitStarted(int cpu_index, unsigned long timeout_us) {
+        for (unsigned long waited = 0; waited < timeout_us; waited += 100) {
+            if (ap_started[cpu_index].load(std::memory_order_acquire)) return true;
+            acpi::WaitMicroseconds(100);
+        }
+        return ap_started[cpu_index].load(std::memory_order_acquire);
+    }
+
+    // MADT の有効な Local APIC を列挙する。BSP を CPU 番号 0 にする
+    void CollectLocalAPICs() {
+        const uint8_t bsp_id = LocalAPICRegister(kLAPICRegisterID) >> 24;
+        apic_ids[0] = bsp_id;
+        num_cpus = 1;
+
+        auto p = reinterpret_cast<const uint8_t*>(acpi::madt) + sizeof(acpi::MADT);
+        const auto end = reinterpret_cast<const uint8_t*>(acpi::madt) + acpi::madt->header.length;
+        while (p + sizeof(acpi::MADTEntry) <= end) {
+            const auto& entry = *reinterpret_cast<const acpi::MADTEntry*>(p);
+            if (entry.length == 0) break;
+            if (entry.type == acpi::kMADTTypeLocalAPIC) {
+                const auto& lapic = reinterpret_cast<const acpi::MADTLocalAPIC&>(entry);
+                if ((lapic.flags & 1) && lapic.apic_id != bsp_id && num_cpus < kMaxCPUs) {
+                    apic_ids[num_cpus++] = lapic.apic_id;
+                }
+            }
+            p += entry.length;
+        }
+    }
+}  // namespace
+
+// AP がロングモードに入った後に呼ばれる。戻らない
+extern "C" void ApMain(uint32_t cpu_index) {
+    EnableSIMDState();
+    SyncPAT();
+    EnableLocalAPIC();
+    // BSP と同じ IDT を使う。AP が受け付ける割り込みは kWakeup の IPI だけ
+    LoadIDT(sizeof(idt) - 1, reinterpret_cast<uintptr_t>(&idt[0]));
+    ap_started[cpu_index].store(true, std::memory_order_release);
+    WorkerLoop(cpu_index);
+}
+
+Error StartApplicationProcessors() {
+    if (acpi::madt == nullptr || acpi::fadt == nullptr) {
+        return MAKE_ERROR(Error::kNotSupported);
+    }
+    SetLocalAPICBase(acpi::madt->local_apic_address);
+    EnableLocalAPIC();
+    CollectLocalAPICs();
+    InitializeParallel(1);
+    if (num_cpus == 1) {
+        return MAKE_ERROR(Error::kSuccess);
+    }
+
+    // SIPI のベクタはページ番号なので、起動コードは 1MiB 未満の 4KiB 境界に置く
+    const size_t trampoline_size = ap_trampoline_end - ap_trampoline;
+    const auto trampoline_frame
+        = memory_manager->AllocateFramesBelow(1, FrameID {0x100000 / kBytesPerFrame});
+    if (trampoline_frame.error) {
+        return trampoline_frame.error;
+    }
+    auto page = reinterpret_cast<uint8_t*>(trampoline_frame.value.Frame());
+    const auto page_addr = reinterpret_cast<uintptr_t>(page);
+    memcpy(page, ap_trampoline, trampoline_size);
+
+    // 絶対アドレスが必要な箇所を、コピー先のアドレスで書き換える
+    const uint32_t gdt_base = page_addr + (ap_gdt - ap_trampoline);
+    memcpy(page + (ap_gdtr - ap_trampoline) + 2, &gdt_base, sizeof(gdt_base));
+
+    auto& params
+        = *reinterpret_cast<APTrampolineParams*>(page + (ap_trampoline_params - ap_trampoline));
+    params.pm_jump_offset = page_addr + (ap_protected_mode - ap_trampoline);
+    params.lm_jump_offset = page_addr + (ap_long_mode - ap_trampoline);
+    params.cr3 = GetCR3();
+    struct {
+        uint16_t limit;
+        uint64_t base;
+    } __attribute__((packed)) gdtr;
+    __asm__ volatile("sgdt %0" : "=m"(gdtr));
+    params.kernel_gdtr_limit = gdtr.limit;
+    params.kernel_gdtr_base = gdtr.base;
+    params.entry = reinterpret_cast<uint64_t>(ApMain);
+    params.kernel_cs = kKernelCS;
+    params.kernel_ss = kKernelSS;
+
+    // 起動コードとパラメータは全ての AP で共有するので、1つずつ順に起動する
+    int started = 1;
+    for (int i = 1; i < num_cpus; ++i) {
+        const auto stack = memory_manager->AllocateFrames(kAPStackFrames);
+        if (stack.error) {
+            break;
+        }
+        params.stack_top = reinterpret_cast<uint64_t>(stack.value.Frame())
+            + kAPStackFrames * kBytesPerFrame;
+        params.cpu_index = started;
+        apic_ids[started] = apic_ids[i];
+
+        SendIPI(apic_ids[started], kICRInit);
+        acpi::WaitMilliseconds(10);
+        SendIPI(apic_ids[started], kICRStartup | (page_addr >> 12));
+        if (!WaitStarted(started, 200)) {
+            // 1回目の SIPI を取りこぼすことがあるので、もう1回だけ送る
+            SendIPI(apic_ids[started], kICRStartup | (page_addr >> 12));
+            if (!WaitStarted(started, 100000)) {
+                memory_manager->FreeFrames(stack.value, kAPStackFrames);
+                continue;
+            }
+        }
+        ++started;
+    }
+    // 応答しなかった AP が後から起動コードを実行するかもしれないので、その場合はページを解放しない
+    if (started == num_cpus) {
+        memory_manager->FreeFrames(trampoline_frame.value, 1);
+    }
+    num_cpus = started;
+
+    InitializeParallel(num_cpus);
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+int CPUCount() {
+    return num_cpus;
+}
+
+uint8_t LocalAPICID(int cpu_index) {
+    return apic_ids[cpu_index];
+}
+
+void WakeCPU(int cpu_index) {
+    SendIPI(apic_ids[cpu_index], kICRFixed | InterruptVector::kWakeup);
+}
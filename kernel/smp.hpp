@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include "error.hpp"
+
+/**
+ * MADT に記載されたアプリケーションプロセッサ (AP) を INIT-SIPI-SIPI で起動する
+ * 各 AP は専用のスタックを持ち、カーネルと同じ GDT・ページテーブル・PAT の設定で
+ * WorkerLoop に入り、ParallelFor で投入された仕事を処理する。
+ * acpi::Initialize とメモリ管理・ヒープの初期化の後に BSP から呼ぶこと。
+ **/
+Error StartApplicationProcessors();
+
+// 起動済みの CPU の数 (BSP を含む)
+int CPUCount();
+
+// Local APIC の ID。MADT の順に並べた CPU 番号 (0 が BSP) から引く
+uint8_t LocalAPICID(int cpu_index);
+
+// hlt で眠っている CPU を InterruptVector::kWakeup の IPI で起こす
+void WakeCPU(int cpu_index);
@@ -0,0 +1,269 @@
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include "format.hpp"
+#include "trace.hpp"
+
+namespace {
+    // 符号化した操作の種類
+    const uint8_t kOpSkip = 0;
+    const uint8_t kOpRun = 1;
+    const uint8_t kOpCopy = 2;
+
+    // COPY の1つの操作にまとめる画素数の上限
+    const size_t kMaxCopyPixels = 1024;
+    // この個数以上同じ色が続けば RUN にする (RUN は 5 バイト、COPY は 1 画素 3 バイト)
+    const int kMinRunPixels = 3;
+    // data の行1つに入れるバイト数。3 の倍数なので、最後の行以外には base64 の '=' が付かない
+    const size_t kLineBytes = 57;
+
+    const uint32_t kColorMask = 0x00ffffff;
+
+    struct CRCTable {
+        uint32_t value[256];
+    };
+
+    // CRC-32 (zlib.crc32 と同じ多項式 0xEDB88320) の表。コンパイル時に作る
+    constexpr CRCTable MakeCRCTable() {
+        CRCTable table {};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table.value[i] = c;
+        }
+        return table;
+    }
+
+    constexpr CRCTable kCRCTable = MakeCRCTable();
+
+    const char kBase64Chars[]
+        = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    bool SameRect(const Rectangle& a, const Rectangle& b) {
+        return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+    }
+}  // namespace
+
+/**
+ * 操作の列を組み立て、バイト列を base64 の行にして書き出す
+ * 直前の操作と同じ種類 (RUN は同じ色) の操作は1つにまとめるので、
+ * 呼び出し側は行の境目を気にせずに画素の並びを渡せばよい
+ **/
+class Snapshotter::Encoder {
+public:
+    Encoder(WriteLine write_line, PixelFormat format) :
+        write_line_ {write_line}, bgr_ {format == kPixelBGRResv8BitPerColor} {}
+
+    void Skip(size_t n) {
+        if (op_ != kOpSkip || count_ == 0) Flush(kOpSkip);
+        count_ += n;
+    }
+
+    void Run(size_t n, uint32_t color) {
+        if (op_ != kOpRun || color_ != color || count_ == 0) {
+            Flush(kOpRun);
+            color_ = color;
+        }
+        count_ += n;
+    }
+
+    void Copy(uint32_t color) {
+        if (op_ != kOpCopy || count_ == kMaxCopyPixels || count_ == 0) Flush(kOpCopy);
+        ToRGB(color, copy_ + 3 * count_);
+        ++count_;
+    }
+
+    // 最後の操作と、行に満たない残りのバイト列を書き出す
+    void Finish() {
+        Flush(kOpSkip);
+        WriteDataLine();
+    }
+
+    uint64_t Bytes() const {
+        return bytes_;
+    }
+    // write_line_ の中で過ごした TSC のカウント数
+    uint64_t WriteCycles() const {
+        return write_cycles_;
+    }
+    uint32_t CRC() const {
+        return ~crc_;
+    }
+
+private:
+    // 組み立て中の操作を出力し、種類 op の空の操作を始める
+    void Flush(uint8_t op) {
+        if (count_ > 0) {
+            Put(op_);
+            for (uint64_t n = count_; ; n >>= 7) {
+                if (n < 0x80) {
+                    Put(n);
+                    break;
+                }
+                Put((n & 0x7f) | 0x80);
+            }
+            if (op_ == kOpRun) {
+                uint8_t rgb[3];
+                ToRGB(color_, rgb);
+                for (uint8_t b : rgb) Put(b);
+            } else if (op_ == kOpCopy) {
+                for (size_t i = 0; i < 3 * count_; ++i) Put(copy_[i]);
+            }
+        }
+        op_ = op;
+        count_ = 0;
+    }
+
+    void ToRGB(uint32_t color, uint8_t* rgb) const {
+        const uint8_t c0 = color, c1 = color >> 8, c2 = color >> 16;
+        rgb[0] = bgr_ ? c2 : c0;
+        rgb[1] = c1;
+        rgb[2] = bgr_ ? c0 : c2;
+    }
+
+    void Put(uint8_t b) {
+        crc_ = kCRCTable.value[(crc_ ^ b) & 0xff] ^ (crc_ >> 8);
+        line_[line_bytes_++] = b;
+        ++bytes_;
+        if (line_bytes_ == kLineBytes) WriteDataLine();
+    }
+
+    void WriteDataLine() {
+        if (line_bytes_ == 0) return;
+        char text[16 + 4 * kLineBytes / 3];
+        size_t n = 0;
+        for (const char* p = "snap,data,"; *p; ++p) text[n++] = *p;
+        for (size_t i = 0; i < line_bytes_; i += 3) {
+            const uint32_t v = line_[i] << 16 | (i + 1 < line_bytes_ ? line_[i + 1] << 8 : 0)
+                | (i + 2 < line_bytes_ ? line_[i + 2] : 0);
+            text[n++] = kBase64Chars[v >> 18];
+            text[n++] = kBase64Chars[(v >> 12) & 63];
+            text[n++] = i + 1 < line_bytes_ ? kBase64Chars[(v >> 6) & 63] : '=';
+            text[n++] = i + 2 < line_bytes_ ? kBase64Chars[v & 63] : '=';
+        }
+        text[n++] = '\n';
+        text[n] = '\0';
+        const uint64_t start = ReadTSC();
+        write_line_(text);
+        write_cycles_ += ReadTSC() - start;
+        line_bytes_ = 0;
+    }
+
+    WriteLine write_line_;
+    const bool bgr_;
+
+    uint8_t op_ = kOpSkip;
+    uint64_t count_ = 0;
+    uint32_t color_ = 0;
+    uint8_t copy_[3 * kMaxCopyPixels];
+
+    uint8_t line_[kLineBytes];
+    size_t line_bytes_ = 0;
+    uint64_t bytes_ = 0;
+    uint32_t crc_ = 0xffffffffu;
+    uint64_t write_cycles_ = 0;
+};
+
+size_t Snapshotter::BytesRequired(const FrameBufferConfig& config) {
+    return sizeof(uint32_t) * config.horizontal_resolution * config.vertical_resolution;
+}
+
+Snapshotter::Snapshotter(const FrameBufferConfig& config, uint8_t* buffer, WriteLine write_line) :
+    config_ {config},
+    previous_ {reinterpret_cast<uint32_t*>(buffer)},
+    previous_rect_ {0, 0, 0, 0},
+    has_previous_ {false},
+    sequence_ {0},
+    write_line_ {write_line} {}
+
+Snapshotter::Stats Snapshotter::Capture(const Rectangle& rect) {
+    Rectangle r = rect;
+    if (config_.pixel_format == kPixelBitMask
+        || !ClipRect(r.x,
+            r.y,
+            r.width,
+            r.height,
+            config_.horizontal_resolution,
+            config_.vertical_resolution))
+    {
+        return {0, 0, 0};
+    }
+    const bool delta = has_previous_ && SameRect(r, previous_rect_);
+
+    char line[128];
+    SNPrintf(line,
+        sizeof(line),
+        "snap,begin,%u,%d,%d,%d,%d,%d\n",
+        sequence_,
+        r.x,
+        r.y,
+        r.width,
+        r.height,
+        delta ? 0 : 1);
+    write_line_(line);
+    const uint64_t start = ReadTSC();
+
+    // 符号化の途中のバッファ (COPY の画素と出力の行) は数 KiB あるのでスタックには置かない。
+    // そのため Capture は同時に1つしか実行できない
+    alignas(Encoder) static char encoder_buf[sizeof(Encoder)];
+    Encoder& encoder = *new (encoder_buf) Encoder {write_line_, config_.pixel_format};
+    uint64_t changed = 0;
+    const int width = r.width;
+    for (int y = 0; y < r.height; ++y) {
+        const uint32_t* row = reinterpret_cast<const uint32_t*>(config_.frame_buffer)
+            + config_.pixels_per_scan_line * (r.y + y) + r.x;
+        uint32_t* prev = previous_ + size_t {1} * width * y;
+        // 変化のない行は1回の比較で読み飛ばす
+        if (delta && memcmp(row, prev, sizeof(uint32_t) * width) == 0) {
+            encoder.Skip(width);
+            continue;
+        }
+
+        for (int x = 0; x < width;) {
+            const uint32_t color = row[x] & kColorMask;
+            int end = x + 1;
+            if (delta && (prev[x] & kColorMask) == color) {
+                while (end < width && (row[end] & kColorMask) == (prev[end] & kColorMask)) ++end;
+                encoder.Skip(end - x);
+                x = end;
+                continue;
+            }
+            // 差分では、前回と同じ画素は RUN に含めずに SKIP に回す
+            while (end < width && (row[end] & kColorMask) == color
+                   && !(delta && (prev[end] & kColorMask) == color))
+            {
+                ++end;
+            }
+            changed += end - x;
+            if (end - x >= kMinRunPixels) {
+                encoder.Run(end - x, color);
+            } else {
+                for (int i = x; i < end; ++i) encoder.Copy(color);
+            }
+            x = end;
+        }
+        std::copy_n(row, width, prev);
+    }
+    encoder.Finish();
+    // data の行の書き出しはシリアルポートの速さで決まるので、符号化の時間から除く
+    const Stats stats {encoder.Bytes(), changed, ReadTSC() - start - encoder.WriteCycles()};
+
+    SNPrintf(line,
+        sizeof(line),
+        "snap,end,%u,%llu,%llu,%08x,%llu\n",
+        sequence_,
+        static_cast<unsigned long long>(stats.bytes),
+        static_cast<unsigned long long>(stats.changed_pixels),
+        encoder.CRC(),
+        static_cast<unsigned long long>(stats.cycles));
+    write_line_(line);
+
+    previous_rect_ = r;
+    has_previous_ = true;
+    ++sequence_;
+    return stats;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "frame_buffer_config.hpp"
+#include "graphics.hpp"
+
+/**
+ * 画面 (またはその一部の矩形) の内容をテキストの行として書き出す
+ * 自動テストでホストが描画結果を画像として取り出すためのもので、tools/snapshot2png.py で PNG に戻せる。
+ *
+ * 画素は矩形の左上から行の順に並べた1本の列として符号化し、次の3種類の操作の並びにする。
+ *   SKIP n      前回のスナップショットと同じ画素が n 個続く
+ *   RUN n rgb   同じ色 rgb の画素が n 個続く
+ *   COPY n ...  n 個の画素の色 (R, G, B の 3 バイトずつ) がそのまま続く
+ * 操作は種類を表す1バイト (0: SKIP, 1: RUN, 2: COPY) と、n を表す LEB128 の可変長整数で始まる。
+ * 操作は行をまたいでつながるので、変化のない画面は数バイトで表せる。
+ * 前回と同じ矩形のときだけ SKIP を使い (差分)、そうでなければ SKIP を含まない (キーフレーム)。
+ *
+ * 出力の行 (base64 は符号化したバイト列を 57 バイトずつ区切ったもの):
+ *   snap,begin,<seq>,<x>,<y>,<width>,<height>,<key>
+ *   snap,data,<base64>
+ *   snap,end,<seq>,<bytes>,<changed>,<crc32>,<cycles>
+ * bytes は符号化したバイト数、changed は前回から変化した画素の数、crc32 は符号化したバイト列の CRC-32。
+ * cycles は画面の読み出しと符号化にかかった TSC のカウント数。行の書き出し (シリアルポートの速さに
+ * 左右される) にかかった時間は含まない。
+ **/
+class Snapshotter {
+public:
+    struct Stats {
+        uint64_t bytes;
+        uint64_t changed_pixels;
+        uint64_t cycles;
+    };
+
+    // 1行を書き出す関数。行は改行で終わる NUL 終端の文字列
+    using WriteLine = void (*)(const char* line);
+
+    // config と同じ解像度の画面の前回の内容を保存するのに必要なバイト数
+    static size_t BytesRequired(const FrameBufferConfig& config);
+
+    // buffer は BytesRequired(config) バイト以上の RAM 上の領域
+    Snapshotter(const FrameBufferConfig& config, uint8_t* buffer, WriteLine write_line);
+
+    /**
+     * config の rect の部分を読み出して符号化し、書き出す
+     * rect は画面の範囲に切り詰める。config は RGB か BGR の形式であること
+     * (kPixelBitMask の VRAM では、影のバッファの Config() を渡す)
+     **/
+    Stats Capture(const Rectangle& rect);
+
+private:
+    class Encoder;
+
+    const FrameBufferConfig& config_;
+    // 前回のスナップショットの画素。矩形の幅を行の間隔として詰めて並べ、下位 24 ビットだけを比べる
+    uint32_t* previous_;
+    Rectangle previous_rect_;
+    bool has_previous_;
+    uint32_t sequence_;
+    WriteLine write_line_;
+};
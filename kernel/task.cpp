@@ -0,0 +1,143 @@
+#include "task.hpp"
+
+#include <new>
+#include "asmfunc.h"
+#include "interrupt.hpp"
+#include "memory_manager.hpp"
+
+namespace {
+    alignas(TaskManager) char task_manager_buf[sizeof(TaskManager)];
+
+    // MXCSR と x87 制御ワードの初期値 (全ての浮動小数点例外をマスクし、最近接丸め)
+    const uint32_t kInitialMXCSR = 0x1f80;
+    const uint16_t kInitialFPUControlWord = 0x037f;
+}  // namespace
+
+TaskManager* task_manager;
+
+TaskManager::TaskManager() :
+    main_task_ {0},
+    current_ {&main_task_},
+    ready_head_ {nullptr},
+    ready_tail_ {nullptr},
+    num_ready_ {0},
+    exited_ {nullptr},
+    num_tasks_ {1},
+    next_id_ {1},
+    num_switches_ {0} {}
+
+Task* TaskManager::NewTask(TaskFunc* func, void* data) {
+    if (num_tasks_ == kMaxTasks) {
+        return nullptr;
+    }
+    const auto stack = memory_manager->AllocateFrames(Task::kStackFrames);
+    if (stack.error) {
+        return nullptr;
+    }
+    Task* task = new (std::nothrow) Task {next_id_++};
+    if (task == nullptr) {
+        memory_manager->FreeFrames(stack.value, Task::kStackFrames);
+        return nullptr;
+    }
+    ++num_tasks_;
+    task->stack_ = reinterpret_cast<uintptr_t>(stack.value.Frame());
+    task->func_ = func;
+    task->data_ = data;
+
+    /**
+     * SwitchContext が復元する順にスタックを積んでおく (下位アドレスから)
+     *   MXCSR と x87 制御ワード, r15, r14, r13, r12, rbx, rbp, 戻り先 (TaskEntryPoint)
+     * r12 にタスクを入れておき、TaskEntryPoint が TaskMain の引数として渡す。
+     * 戻り先を取り出した後のスタックポインタが16バイト境界になるように置く
+     **/
+    auto top = reinterpret_cast<uint64_t*>(task->stack_ + Task::kStackFrames * kBytesPerFrame);
+    top[-1] = reinterpret_cast<uint64_t>(TaskEntryPoint);
+    top[-2] = 0;                                   // rbp
+    top[-3] = 0;                                   // rbx
+    top[-4] = reinterpret_cast<uint64_t>(task);    // r12
+    top[-5] = 0;                                   // r13
+    top[-6] = 0;                                   // r14
+    top[-7] = 0;                                   // r15
+    top[-8] = kInitialMXCSR | (uint64_t {kInitialFPUControlWord} << 32);
+    task->rsp_ = reinterpret_cast<uint64_t>(&top[-8]);
+
+    InterruptGuard guard;
+    Enqueue(task);
+    return task;
+}
+
+void TaskManager::Yield() {
+    Task* next;
+    {
+        InterruptGuard guard;
+        next = Dequeue();
+        if (next == nullptr) return;
+        Enqueue(current_);
+        SwitchTo(next);
+    }
+    ReapExited();
+}
+
+void TaskManager::Exit() {
+    __asm__ volatile("cli");
+    // 自分のスタックの上にいる間は解放できないので、終了済みリストに入れて後で解放する
+    current_->next_ = exited_;
+    exited_ = current_;
+    // メインのタスクは終了しないので、実行キューは空にならない
+    SwitchTo(Dequeue());
+    __builtin_unreachable();
+}
+
+void TaskManager::Enqueue(Task* task) {
+    task->next_ = nullptr;
+    if (ready_tail_) {
+        ready_tail_->next_ = task;
+    } else {
+        ready_head_ = task;
+    }
+    ready_tail_ = task;
+    ++num_ready_;
+}
+
+Task* TaskManager::Dequeue() {
+    Task* task = ready_head_;
+    if (task == nullptr) return nullptr;
+    ready_head_ = task->next_;
+    if (ready_head_ == nullptr) ready_tail_ = nullptr;
+    --num_ready_;
+    return task;
+}
+
+void TaskManager::ReapExited() {
+    Task* task;
+    {
+        InterruptGuard guard;
+        task = exited_;
+        exited_ = nullptr;
+    }
+    while (task) {
+        Task* next = task->next_;
+        memory_manager->FreeFrames(FrameID {task->stack_ / kBytesPerFrame}, Task::kStackFrames);
+        delete task;
+        --num_tasks_;
+        task = next;
+    }
+}
+
+void TaskManager::SwitchTo(Task* next) {
+    Task* prev = current_;
+    current_ = next;
+    ++num_switches_;
+    SwitchContext(&prev->rsp_, next->rsp_);
+}
+
+void InitializeTask() {
+    task_manager = new (task_manager_buf) TaskManager;
+}
+
+extern "C" void TaskMain(Task* task) {
+    // 切り替え直後は Yield の中で禁止した割り込みがそのままなので、ここで許可する
+    __asm__ volatile("sti");
+    task->Run();
+    task_manager->Exit();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "error.hpp"
+
+/**
+ * カーネルのタスク
+ * タスクはそれぞれ専用のスタックを持ち、SwitchContext (asmfunc.asm) で切り替える。
+ * 切り替えで保存するのは System V ABI で呼び出し先が保存すべきレジスタ
+ * (rbx, rbp, r12-r15) と MXCSR・x87 制御ワードだけで、残りは呼び出し側が保存している。
+ *
+ * 今は Yield による協調的な切り替えだけを行う。実行キューの操作は割り込みを禁止して行うので、
+ * 後でタイマー割り込みから切り替える (プリエンプション) ようにしても良い。
+ **/
+using TaskFunc = void(uint64_t task_id, void* data);
+
+class Task {
+public:
+    // タスク1つあたりのスタックのフレーム数 (64KiB)
+    static const size_t kStackFrames = 16;
+
+    explicit Task(uint64_t id) : id_ {id} {}
+
+    uint64_t ID() const {
+        return id_;
+    }
+    // タスクの関数を実行する。TaskMain から1回だけ呼ばれる
+    void Run() {
+        func_(id_, data_);
+    }
+
+private:
+    friend class TaskManager;
+
+    const uint64_t id_;
+    // 切り替えで保存したスタックポインタ
+    uint64_t rsp_ = 0;
+    // スタックの先頭フレーム。メインのタスクは UEFI から引き継いだスタックを使うので 0
+    uintptr_t stack_ = 0;
+    TaskFunc* func_ = nullptr;
+    void* data_ = nullptr;
+    // 実行キューまたは終了済みリストでの次のタスク
+    Task* next_ = nullptr;
+};
+
+class TaskManager {
+public:
+    // 同時に存在できるタスクの数の上限 (メインのタスクと、終了して解放を待つタスクを含む)
+    static const size_t kMaxTasks = 64;
+
+    // 呼び出した処理 (KernelMain) を ID 0 のタスクとして登録する
+    TaskManager();
+
+    /**
+     * func(ID, data) を実行するタスクを生成し、実行キューの末尾に加える
+     * func から戻るとタスクは終了する。
+     * タスクの数が kMaxTasks に達しているか、スタックとタスクを確保できなければ nullptr を返す
+     **/
+    Task* NewTask(TaskFunc* func, void* data);
+
+    // 実行キューの先頭のタスクへ切り替え、自分は末尾に並ぶ。他に実行できるタスクが無ければすぐ戻る
+    void Yield();
+
+    // 現在のタスクを終了する。スタックは次に他のタスクが Yield したときに解放する
+    [[noreturn]] void Exit();
+
+    Task& CurrentTask() {
+        return *current_;
+    }
+    // 現在のタスクを除いた、実行を待っているタスクの数
+    size_t NumReady() const {
+        return num_ready_;
+    }
+    // これまでに行った切り替えの回数
+    uint64_t NumSwitches() const {
+        return num_switches_;
+    }
+
+private:
+    void Enqueue(Task* task);
+    Task* Dequeue();
+    // 終了したタスクのスタックとタスク自身を解放する
+    void ReapExited();
+    void SwitchTo(Task* next);
+
+    Task main_task_;
+    Task* current_;
+    Task *ready_head_, *ready_tail_;
+    size_t num_ready_;
+    Task* exited_;
+    // 存在するタスクの数。終了したタスクは ReapExited で解放したときに減らす
+    size_t num_tasks_;
+    uint64_t next_id_;
+    uint64_t num_switches_;
+};
+
+extern TaskManager* task_manager;
+
+void InitializeTask();
+
+// 新しいタスクが最初に切り替えられたときに TaskEntryPoint (asmfunc.asm) から呼ばれる
+extern "C" [[noreturn]] void TaskMain(Task* task);
@@ -0,0 +1,63 @@
+#pragma once
+
+/**
+ * カーネルのソースをホスト上で検査するテストの共通部分
+ * CHECK は失敗した条件と場所を表示し、最後に main が返す終了コードを 1 にする
+ **/
+
+#include <sys/mman.h>
+#include <cstdint>
+#include <cstdio>
+#include "../memory_manager.hpp"
+
+namespace test {
+    inline int failures = 0;
+
+    /**
+     * フレームのアドレスはそのままポインタとして使われるので、
+     * 物理アドレスと同じ値の仮想アドレス (kArenaBase から) に実際のメモリを割り当てておく
+     **/
+    const uintptr_t kArenaBase = 0x40000000;
+    const size_t kArenaBytes = 64 * 1024 * 1024;
+    const size_t kArenaFirstFrame = kArenaBase / kBytesPerFrame;
+    const size_t kArenaEndFrame = (kArenaBase + kArenaBytes) / kBytesPerFrame;
+
+    inline bool MapArena() {
+        void* arena = mmap(reinterpret_cast<void*>(kArenaBase),
+            kArenaBytes,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+            -1,
+            0);
+        if (arena != reinterpret_cast<void*>(kArenaBase)) {
+            fprintf(stderr, "failed to map the test arena at %#lx\n", kArenaBase);
+            return false;
+        }
+        return true;
+    }
+
+    // アリーナの [first, end) のフレームだけを空きとするメモリマネージャを作る
+    inline BitmapMemoryManager* NewFrameManager(size_t first, size_t end) {
+        auto frames = new BitmapMemoryManager;
+        frames->MarkAllocated(FrameID {0}, first);
+        frames->SetMemoryRange(FrameID {1}, FrameID {end});
+        return frames;
+    }
+
+    inline int Finish(const char* name) {
+        if (failures == 0) {
+            printf("%s: ok\n", name);
+            return 0;
+        }
+        printf("%s: %d failure(s)\n", name, failures);
+        return 1;
+    }
+}  // namespace test
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++test::failures;                                                         \
+        }                                                                             \
+    } while (0)
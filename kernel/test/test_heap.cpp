@@ -0,0 +1,219 @@
+/**
+ * KernelHeap のテスト (ホスト上で実行する)
+ * 確保したオブジェクトが重ならないこと、解放した領域が再利用されること、
+ * フレームを使い切ったときに nullptr を返すこと、統計が確保と解放に追従することを確かめる。
+ *
+ * 使い方: make test (kernel/ で実行する)
+ **/
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "../heap.hpp"
+#include "test.hpp"
+
+namespace {
+    struct Object {
+        uint8_t* p;
+        size_t bytes;
+        uint8_t pattern;
+    };
+
+    void Fill(const Object& obj) {
+        memset(obj.p, obj.pattern, obj.bytes);
+    }
+
+    bool Intact(const Object& obj) {
+        for (size_t i = 0; i < obj.bytes; ++i) {
+            if (obj.p[i] != obj.pattern) return false;
+        }
+        return true;
+    }
+
+    size_t AllocatedFrames(const BitmapMemoryManager& frames) {
+        return frames.GetStats().allocated_frames;
+    }
+
+    // 全てのサイズクラスで、確保したオブジェクトが重ならず、解放すると統計が元に戻ること
+    void TestSmallObjects() {
+        auto frames = test::NewFrameManager(test::kArenaFirstFrame, test::kArenaEndFrame);
+        auto heap = new KernelHeap {*frames};
+
+        const size_t sizes[] = {1, 16, 17, 48, 100, 256, 513, KernelHeap::kMaxSlabObjectBytes};
+        std::vector<Object> objects;
+        uint8_t pattern = 1;
+        for (size_t bytes : sizes) {
+            for (int i = 0; i < 300; ++i) {
+                auto p = static_cast<uint8_t*>(heap->Allocate(bytes));
+                CHECK(p != nullptr);
+                if (p == nullptr) continue;
+                // オブジェクトはサイズクラスの大きさの境界に揃う
+                size_t class_bytes = KernelHeap::kMinObjectBytes;
+                while (class_bytes < bytes) class_bytes <<= 1;
+                CHECK(reinterpret_cast<uintptr_t>(p) % class_bytes == 0);
+                objects.push_back({p, bytes, pattern++});
+                Fill(objects.back());
+            }
+        }
+        for (const auto& obj : objects) CHECK(Intact(obj));
+
+        auto stats = heap->GetStats();
+        size_t expected = 0;
+        for (const auto& obj : objects) {
+            size_t class_bytes = KernelHeap::kMinObjectBytes;
+            while (class_bytes < obj.bytes) class_bytes <<= 1;
+            expected += class_bytes;
+        }
+        CHECK(stats.bytes_in_use == expected);
+        CHECK(stats.bytes_reserved >= stats.bytes_in_use);
+
+        for (const auto& obj : objects) heap->Free(obj.p);
+        stats = heap->GetStats();
+        CHECK(stats.bytes_in_use == 0);
+        for (const auto& cs : stats.classes) {
+            CHECK(cs.objects_in_use == 0);
+            CHECK(cs.allocations == cs.frees);
+            // 空のスラブはクラスごとに1つだけ残す
+            CHECK(cs.slabs <= 1);
+        }
+
+        delete heap;
+        delete frames;
+    }
+
+    // 解放したオブジェクトは同じサイズクラスの次の確保で再利用されること
+    void TestReuse() {
+        auto frames = test::NewFrameManager(test::kArenaFirstFrame, test::kArenaEndFrame);
+        auto heap = new KernelHeap {*frames};
+
+        void* a = heap->Allocate(40);
+        void* b = heap->Allocate(40);
+        CHECK(a != nullptr && b != nullptr && a != b);
+        heap->Free(a);
+        CHECK(heap->Allocate(33) == a);
+        heap->Free(b);
+        heap->Free(a);
+
+        const size_t before = AllocatedFrames(*frames);
+        void* large = heap->Allocate(64 * 1024);
+        CHECK(large != nullptr);
+        CHECK(reinterpret_cast<uintptr_t>(large) % kBytesPerFrame == 0);
+        CHECK(heap->GetStats().large_frames_in_use == 16);
+        memset(large, 0xab, 64 * 1024);
+        heap->Free(large);
+        CHECK(heap->GetStats().large_frames_in_use == 0);
+        CHECK(AllocatedFrames(*frames) == before);
+        CHECK(heap->Allocate(64 * 1024) == large);
+        heap->Free(large);
+
+        heap->Free(nullptr);
+
+        delete heap;
+        delete frames;
+    }
+
+    // AllocateBoot は境界を守って前詰めで確保し、Free しても何もしないこと
+    void TestBootArena() {
+        auto frames = test::NewFrameManager(test::kArenaFirstFrame, test::kArenaEndFrame);
+        auto heap = new KernelHeap {*frames};
+        CHECK(heap->GetStats().boot_arena_capacity == KernelHeap::kBootArenaBytes);
+
+        auto a = static_cast<uint8_t*>(heap->AllocateBoot(3, 1));
+        auto b = static_cast<uint8_t*>(heap->AllocateBoot(100, 64));
+        CHECK(a != nullptr && b != nullptr);
+        CHECK(reinterpret_cast<uintptr_t>(b) % 64 == 0);
+        CHECK(b >= a + 3);
+        heap->Free(b);
+        CHECK(heap->AllocateBoot(8, 8) >= b + 100);
+        CHECK(heap->GetStats().bytes_in_use == 0);
+
+        // 専用領域を超える大きさは通常のヒープから確保する
+        void* big = heap->AllocateBoot(KernelHeap::kBootArenaBytes, 16);
+        CHECK(big != nullptr);
+        CHECK(heap->GetStats().large_frames_in_use > 0);
+        heap->Free(big);
+
+        delete heap;
+        delete frames;
+    }
+
+    // フレームを使い切ると nullptr を返し、解放すれば再び確保できること
+    void TestExhaustion() {
+        const size_t arena_frames = KernelHeap::kBootArenaBytes / kBytesPerFrame;
+        auto frames = test::NewFrameManager(
+            test::kArenaFirstFrame, test::kArenaFirstFrame + arena_frames + 64);
+        auto heap = new KernelHeap {*frames};
+        const size_t baseline = AllocatedFrames(*frames);
+
+        std::vector<void*> held;
+        for (int i = 0; i < 1000; ++i) {
+            void* p = heap->Allocate(1024);
+            if (p == nullptr) break;
+            held.push_back(p);
+        }
+        // 1 フレームは管理情報の表に使い、残りの各スラブに 1024 バイトのオブジェクトが 4 個入る
+        CHECK(heap->GetStats().info_frames == 1);
+        CHECK(held.size() == 63 * 4);
+        CHECK(heap->Allocate(16) == nullptr);
+        CHECK(heap->Allocate(64 * 1024) == nullptr);
+
+        for (void* p : held) heap->Free(p);
+        CHECK(AllocatedFrames(*frames) <= baseline + 2);
+        CHECK(heap->Allocate(16) != nullptr);
+
+        delete heap;
+        delete frames;
+    }
+
+    // 乱数で作った確保と解放の列を流し、解放するまで内容が壊れないこと
+    void TestRandomTrace() {
+        auto frames = test::NewFrameManager(test::kArenaFirstFrame, test::kArenaEndFrame);
+        auto heap = new KernelHeap {*frames};
+        const size_t baseline = AllocatedFrames(*frames);
+
+        std::vector<Object> live;
+        uint32_t seed = 12345;
+        auto next = [&seed] {
+            seed = seed * 1103515245 + 12345;
+            return seed >> 8;
+        };
+        for (int i = 0; i < 20000; ++i) {
+            if (live.empty() || next() % 8 < 5) {
+                const uint32_t r = next();
+                const size_t bytes = r % 16 == 0 ? 4096 + r % 40000 : 1 + r % 700;
+                auto p = static_cast<uint8_t*>(heap->Allocate(bytes));
+                CHECK(p != nullptr);
+                if (p == nullptr) continue;
+                live.push_back({p, bytes, static_cast<uint8_t>(i)});
+                Fill(live.back());
+            } else {
+                const size_t k = next() % live.size();
+                CHECK(Intact(live[k]));
+                heap->Free(live[k].p);
+                live[k] = live.back();
+                live.pop_back();
+            }
+        }
+        for (const auto& obj : live) {
+            CHECK(Intact(obj));
+            heap->Free(obj.p);
+        }
+        const auto stats = heap->GetStats();
+        CHECK(stats.bytes_in_use == 0);
+        CHECK(AllocatedFrames(*frames)
+            <= baseline + KernelHeap::kNumSizeClasses + stats.info_frames);
+
+        delete heap;
+        delete frames;
+    }
+}  // namespace
+
+int main() {
+    if (!test::MapArena()) return 1;
+    TestSmallObjects();
+    TestReuse();
+    TestBootArena();
+    TestExhaustion();
+    TestRandomTrace();
+    return test::Finish("test_heap");
+}
@@ -0,0 +1,151 @@
+/**
+ * BitmapMemoryManager のテスト (ホスト上で実行する)
+ * 同じフレームを2回渡さないこと、解放したフレームが再利用されること、
+ * AllocateFramesBelow が上限を守ること、メモリマップの範囲を扱える上限に切り詰めることを確かめる。
+ * フレームの中身には触れないので、アリーナは割り当てない
+ *
+ * 使い方: make test (kernel/ で実行する)
+ **/
+
+#include <cstdint>
+#include <vector>
+#include "../memory_manager.hpp"
+#include "test.hpp"
+
+namespace {
+    const size_t kFirst = 256;
+    const size_t kEnd = kFirst + 8192;
+
+    BitmapMemoryManager* NewManager() {
+        return test::NewFrameManager(kFirst, kEnd);
+    }
+
+    // 確保した範囲が重ならず、範囲の外や使用できない領域を渡さないこと
+    void TestNoDoubleHandout() {
+        auto frames = NewManager();
+        // 範囲の途中に使用できない領域を作っておく
+        frames->MarkAllocated(FrameID {kFirst + 1000}, 100);
+        const size_t baseline = frames->GetStats().allocated_frames;
+
+        struct Block {
+            size_t start, num;
+        };
+        std::vector<int> owner(kEnd, -1);
+        std::vector<Block> live;
+        uint32_t seed = 7;
+        auto next = [&seed] {
+            seed = seed * 1103515245 + 12345;
+            return seed >> 8;
+        };
+        for (int i = 0; i < 20000; ++i) {
+            if (live.empty() || next() % 8 < 5) {
+                const size_t num = next() % 4 == 0 ? 1 + next() % 64 : 1;
+                const auto f = frames->AllocateFrames(num);
+                if (f.error) continue;
+                const size_t start = f.value.ID();
+                CHECK(start >= kFirst && start + num <= kEnd);
+                CHECK(start + num <= kFirst + 1000 || start >= kFirst + 1100);
+                for (size_t j = start; j < start + num && j < kEnd; ++j) {
+                    CHECK(owner[j] == -1);
+                    owner[j] = i;
+                }
+                live.push_back({start, num});
+            } else {
+                const size_t k = next() % live.size();
+                CHECK(!frames->FreeFrames(FrameID {live[k].start}, live[k].num));
+                for (size_t j = live[k].start; j < live[k].start + live[k].num; ++j) owner[j] = -1;
+                live[k] = live.back();
+                live.pop_back();
+            }
+        }
+
+        size_t held = baseline;
+        for (const auto& b : live) held += b.num;
+        CHECK(frames->GetStats().allocated_frames == held);
+        for (const auto& b : live) frames->FreeFrames(FrameID {b.start}, b.num);
+        const auto stats = frames->GetStats();
+        CHECK(stats.allocated_frames == baseline);
+        CHECK(stats.largest_free_run == kEnd - kFirst - 1100);
+
+        delete frames;
+    }
+
+    // 全て使い切ると失敗し、解放したフレームは次の確保で再利用されること
+    void TestFreeAndReuse() {
+        auto frames = NewManager();
+        const size_t total = kEnd - kFirst;
+        const auto all = frames->AllocateFrames(total);
+        CHECK(!all.error && all.value.ID() == kFirst);
+        CHECK(frames->AllocateFrames(1).error);
+
+        CHECK(!frames->FreeFrames(FrameID {kFirst + 4000}, 16));
+        CHECK(frames->AllocateFrames(17).error);
+        const auto f = frames->AllocateFrames(16);
+        CHECK(!f.error && f.value.ID() == kFirst + 4000);
+
+        CHECK(frames->AllocateFrames(0).error);
+        CHECK(frames->FreeFrames(FrameID {kEnd - 1}, 2).Cause() == Error::kIndexOutOfRange);
+        CHECK(frames->GetStats().largest_free_run == 0);
+
+        delete frames;
+    }
+
+    // AllocateFramesBelow は上限より前からだけ確保すること
+    void TestAllocateBelow() {
+        auto frames = NewManager();
+        const FrameID limit {kFirst + 64};
+
+        // 上限の前後にまたがって確保し、上限より前の部分だけを空ける
+        CHECK(!frames->AllocateFrames(100).error);
+        CHECK(!frames->FreeFrames(FrameID {kFirst}, 64));
+
+        for (int i = 0; i < 8; ++i) {
+            const auto f = frames->AllocateFramesBelow(8, limit);
+            CHECK(!f.error);
+            CHECK(f.value.ID() + 8 <= limit.ID());
+        }
+        CHECK(frames->AllocateFramesBelow(1, limit).error);
+        CHECK(frames->AllocateFramesBelow(0, limit).error);
+
+        delete frames;
+    }
+
+    // 扱える上限を超えるメモリマップは上限で切り詰め、それより上の領域は無視すること
+    void TestClampMemoryMap() {
+        const uint64_t kMax = BitmapMemoryManager::kMaxPhysicalMemoryBytes;
+        auto pages = [](uint64_t bytes) {
+            return bytes / kUEFIPageSize;
+        };
+        MemoryDescriptor descs[] = {
+            {static_cast<uint32_t>(MemoryType::kEfiConventionalMemory), 0x100000, 0,
+                pages(64_MiB), 0},
+            {static_cast<uint32_t>(MemoryType::kEfiConventionalMemory), kMax - 1_GiB, 0,
+                pages(2_GiB), 0},
+            {static_cast<uint32_t>(MemoryType::kEfiMemoryMappedIO), kMax + 4_GiB, 0,
+                pages(1_GiB), 0},
+            {static_cast<uint32_t>(MemoryType::kEfiConventionalMemory), kMax + 8_GiB, 0,
+                pages(16_GiB), 0},
+        };
+        const MemoryMap map {sizeof(descs), descs, sizeof(descs), 0, sizeof(MemoryDescriptor), 1};
+        InitializeMemoryManager(map);
+
+        const auto stats = memory_manager->GetStats();
+        CHECK(stats.total_frames == BitmapMemoryManager::kFrameCount - 1);
+        // 物理アドレス 0 から 1MiB の手前までと、64MiB の後ろから上限の 1GiB 手前までの隙間
+        CHECK(stats.allocated_frames
+            == (0x100000 + kMax - 1_GiB - (0x100000 + 64_MiB)) / kBytesPerFrame - 1);
+        CHECK(stats.largest_free_run == 1_GiB / kBytesPerFrame);
+
+        const auto f = memory_manager->AllocateFrames(1_GiB / kBytesPerFrame);
+        CHECK(!f.error && f.value.ID() == (kMax - 1_GiB) / kBytesPerFrame);
+        CHECK(memory_manager->AllocateFrames(1_GiB / kBytesPerFrame).error);
+    }
+}  // namespace
+
+int main() {
+    TestNoDoubleHandout();
+    TestFreeAndReuse();
+    TestAllocateBelow();
+    TestClampMemoryMap();
+    return test::Finish("test_memory_manager");
+}
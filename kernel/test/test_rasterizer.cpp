@@ -0,0 +1,197 @@
+/**
+ * 線分と多角形の描画のテスト (ホスト上で実行する)
+ * 頂点が画面から遠く離れていても (int の範囲の端でも)、__int128 で同じ式を計算した結果と
+ * 1ピクセルも違わずに描けることを確かめる。
+ *
+ * 使い方: make test (kernel/ で実行する)
+ **/
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "../rasterizer.hpp"
+#include "test.hpp"
+
+namespace {
+    using i128 = __int128;
+
+    const int kWidth = 64, kHeight = 48;
+
+    struct Screen {
+        uint32_t pixels[kWidth * kHeight];
+        FrameBufferConfig config;
+
+        Screen() : pixels {}, config {} {
+            config.frame_buffer = reinterpret_cast<uint8_t*>(pixels);
+            config.pixels_per_scan_line = kWidth;
+            config.horizontal_resolution = kWidth;
+            config.vertical_resolution = kHeight;
+            config.pixel_format = kPixelBGRResv8BitPerColor;
+            config.frame_buffer_size = sizeof(pixels);
+        }
+
+        bool At(int x, int y) const {
+            return pixels[y * kWidth + x] != 0;
+        }
+    };
+
+    const Rectangle kScreenRect {0, 0, kWidth, kHeight};
+    const PixelColor kWhite {255, 255, 255};
+
+    i128 FloorDiv(i128 a, i128 b) {
+        return a / b - (a % b != 0 && (a < 0) != (b < 0));
+    }
+
+    // rasterizer.cpp の Bresenham の式を、画面内の主軸の座標について直接計算する
+    void ReferenceLine(Point p0, Point p1, bool (&expected)[kHeight][kWidth]) {
+        const bool steep = std::abs(long {p1.y} - p0.y) > std::abs(long {p1.x} - p0.x);
+        i128 u0 = steep ? p0.y : p0.x, v0 = steep ? p0.x : p0.y;
+        i128 u1 = steep ? p1.y : p1.x, v1 = steep ? p1.x : p1.y;
+        if (u0 > u1) {
+            std::swap(u0, u1);
+            std::swap(v0, v1);
+        }
+        const i128 du = u1 - u0, dv = v1 > v0 ? v1 - v0 : v0 - v1;
+        const i128 sv = v1 >= v0 ? 1 : -1;
+        auto set = [&](i128 x, i128 y) {
+            if (0 <= x && x < kWidth && 0 <= y && y < kHeight) expected[int(y)][int(x)] = true;
+        };
+        if (du == 0) {
+            set(p0.x, p0.y);
+            return;
+        }
+        const i128 umax = steep ? kHeight : kWidth;
+        for (i128 u = std::max<i128>(u0, 0); u <= std::min<i128>(u1, umax - 1); ++u) {
+            const i128 v = v0 + sv * FloorDiv(2 * dv * (u - u0) + du, 2 * du);
+            steep ? set(v, u) : set(u, v);
+        }
+    }
+
+    /**
+     * rasterizer.cpp の走査線アルゴリズムと同じ固定小数点数の交点を求め、偶奇規則で塗る
+     * 各辺の交点は、画面内で最初に交わる行で正確に求め、以降の行は dx ずつ進める
+     **/
+    void ReferencePolygon(const Point* points, int n, bool (&expected)[kHeight][kWidth]) {
+        const i128 one = 1 << 16;
+        i128 y_min = points[0].y;
+        for (int i = 1; i < n; ++i) y_min = std::min<i128>(y_min, points[i].y);
+        const i128 first_row = std::max<i128>(y_min, 0);
+        for (int y = 0; y < kHeight; ++y) {
+            std::vector<i128> xs;
+            for (int i = 0; i < n; ++i) {
+                Point a = points[i], b = points[(i + 1) % n];
+                if (a.y == b.y) continue;
+                if (a.y > b.y) std::swap(a, b);
+                const i128 y_begin = std::max<i128>(a.y, first_row);
+                if (y < y_begin || y >= b.y) continue;
+                const i128 ex = i128 {b.x} - a.x, ey = i128 {b.y} - a.y;
+                const i128 x0 = a.x * one + FloorDiv((2 * (y_begin - a.y) + 1) * ex * one, 2 * ey);
+                xs.push_back(x0 + (y - y_begin) * FloorDiv(ex * one, ey));
+            }
+            std::sort(xs.begin(), xs.end());
+            for (size_t i = 0; i + 1 < xs.size(); i += 2) {
+                const i128 begin = FloorDiv(xs[i] + one / 2 - 1, one);
+                const i128 end = FloorDiv(xs[i + 1] + one / 2 - 1, one);
+                for (i128 x = std::max<i128>(begin, 0); x < std::min<i128>(end, kWidth); ++x) {
+                    expected[y][int(x)] = true;
+                }
+            }
+        }
+    }
+
+    bool Matches(const Screen& screen, const bool (&expected)[kHeight][kWidth]) {
+        for (int y = 0; y < kHeight; ++y) {
+            for (int x = 0; x < kWidth; ++x) {
+                if (screen.At(x, y) != expected[y][x]) return false;
+            }
+        }
+        return true;
+    }
+
+    uint32_t seed = 2024;
+    uint32_t Next() {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    }
+
+    // 画面の近く、遠く、int の範囲の端のいずれかの座標を選ぶ
+    int RandomCoord(int extent) {
+        switch (Next() % 4) {
+        case 0:
+            return static_cast<int>(Next() % (3 * extent)) - extent;
+        case 1:
+            return static_cast<int>(Next() % 20000000) - 10000000;
+        case 2:
+            return INT_MIN + static_cast<int>(Next() % 1000);
+        default:
+            return INT_MAX - static_cast<int>(Next() % 1000);
+        }
+    }
+
+    Point RandomPoint() {
+        return {RandomCoord(kWidth), RandomCoord(kHeight)};
+    }
+
+    // int の範囲の端から端まで引いた対角線は、画面内で x == y のピクセルだけを通る
+    void TestDiagonalAcrossIntRange() {
+        auto screen = new Screen;
+        DrawLine(screen->config, kScreenRect, {INT_MIN, INT_MIN}, {INT_MAX, INT_MAX}, kWhite);
+        for (int y = 0; y < kHeight; ++y) {
+            for (int x = 0; x < kWidth; ++x) {
+                CHECK(screen->At(x, y) == (x == y));
+            }
+        }
+        delete screen;
+    }
+
+    // 画面をすっぽり覆う巨大な三角形は、画面全体を塗る
+    void TestHugeTriangleCoversScreen() {
+        auto screen = new Screen;
+        const Point points[] = {{INT_MIN, INT_MIN}, {INT_MAX, INT_MIN + 1}, {0, INT_MAX}};
+        CHECK(FillPolygon(screen->config, kScreenRect, points, 3, kWhite));
+        for (int y = 0; y < kHeight; ++y) {
+            for (int x = 0; x < kWidth; ++x) CHECK(screen->At(x, y));
+        }
+        delete screen;
+    }
+
+    void TestRandomLines() {
+        auto screen = new Screen;
+        static bool expected[kHeight][kWidth];
+        for (int i = 0; i < 20000; ++i) {
+            const Point p0 = RandomPoint(), p1 = RandomPoint();
+            memset(screen->pixels, 0, sizeof(screen->pixels));
+            memset(expected, 0, sizeof(expected));
+            DrawLine(screen->config, kScreenRect, p0, p1, kWhite);
+            ReferenceLine(p0, p1, expected);
+            CHECK(Matches(*screen, expected));
+        }
+        delete screen;
+    }
+
+    void TestRandomPolygons() {
+        auto screen = new Screen;
+        static bool expected[kHeight][kWidth];
+        for (int i = 0; i < 5000; ++i) {
+            Point points[6];
+            const int n = 3 + Next() % 4;
+            for (int k = 0; k < n; ++k) points[k] = RandomPoint();
+            memset(screen->pixels, 0, sizeof(screen->pixels));
+            memset(expected, 0, sizeof(expected));
+            FillPolygon(screen->config, kScreenRect, points, n, kWhite);
+            ReferencePolygon(points, n, expected);
+            CHECK(Matches(*screen, expected));
+        }
+        delete screen;
+    }
+}  // namespace
+
+int main() {
+    TestDiagonalAcrossIntRange();
+    TestHugeTriangleCoversScreen();
+    TestRandomLines();
+    TestRandomPolygons();
+    return test::Finish("test_rasterizer");
+}
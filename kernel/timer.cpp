@@ -0,0 +1,177 @@
+#include "timer.hpp"
+
+#include <algorithm>
+#include <cpuid.h>
+#include <new>
+#include "acpi.hpp"
+#include "asmfunc.h"
+#include "interrupt.hpp"
+#include "local_apic.hpp"
+#include "trace.hpp"
+
+namespace {
+    // LVT Timer: bit 16 はマスク、bit 18:17 はモード (0: ワンショット, 2: TSC-deadline)
+    const uint32_t kLVTMasked = 1u << 16;
+    const uint32_t kLVTModeTSCDeadline = 2u << 17;
+    // 分周比 1
+    const uint32_t kDivideBy1 = 0b1011;
+    const uint32_t kIA32TSCDeadline = 0x6e0;
+
+    // 較正に使う時間
+    const unsigned long kCalibrationMicroseconds = 50000;
+
+    alignas(TimerManager) char timer_manager_buf[sizeof(TimerManager)];
+
+    // CPUID.01H:ECX[24] が Local APIC タイマーの TSC-deadline モードに対応していることを示す
+    bool SupportsTSCDeadline() {
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+        return ecx & (1u << 24);
+    }
+
+    // TSC を基準に usec マイクロ秒待つ。PM タイマーが無いときに使う
+    void WaitTSC(uint64_t tsc_per_us, unsigned long usec) {
+        const uint64_t end = ReadTSC() + tsc_per_us * usec;
+        while (ReadTSC() < end) {
+            __asm__ volatile("pause");
+        }
+    }
+}  // namespace
+
+TimerManager* timer_manager;
+
+TimerManager::TimerManager(uint64_t tsc_per_us, uint64_t lapic_per_tsc_q32, bool use_tsc_deadline) :
+    tsc_per_us_ {tsc_per_us},
+    lapic_per_tsc_q32_ {lapic_per_tsc_q32},
+    use_tsc_deadline_ {use_tsc_deadline},
+    num_timers_ {0},
+    armed_ {false},
+    armed_deadline_ {0},
+    expired_ {false},
+    latency_ {0, UINT64_MAX, 0, 0} {
+    LocalAPICRegister(kLAPICRegisterLVTTimer) = InterruptVector::kLocalAPICTimer
+        | (use_tsc_deadline_ ? kLVTModeTSCDeadline : 0);
+}
+
+bool TimerManager::ScheduleAt(uint64_t deadline, TimerCallback callback, void* context) {
+    InterruptGuard guard;
+    if (num_timers_ == kMaxTimers) return false;
+
+    timers_[num_timers_++] = {deadline, callback, context};
+    std::push_heap(timers_, timers_ + num_timers_, Later);
+    // 先頭が入れ替わったときだけ設定し直す
+    if (!armed_ || deadline < armed_deadline_) {
+        Arm(timers_[0].deadline);
+    }
+    return true;
+}
+
+bool TimerManager::ScheduleAfter(uint64_t usec, TimerCallback callback, void* context) {
+    return ScheduleAt(ReadTSC() + usec * tsc_per_us_, callback, context);
+}
+
+void TimerManager::RunExpired() {
+    while (true) {
+        Timer timer;
+        {
+            InterruptGuard guard;
+            expired_.store(false, std::memory_order_relaxed);
+            if (num_timers_ == 0) return;
+            if (timers_[0].deadline > ReadTSC()) {
+                Arm(timers_[0].deadline);
+                return;
+            }
+            std::pop_heap(timers_, timers_ + num_timers_, Later);
+            timer = timers_[--num_timers_];
+        }
+        // コールバックの中で ScheduleAt を呼んでも良いように、割り込みを許可した状態で呼ぶ
+        timer.callback(timer.context, timer.deadline);
+    }
+}
+
+void TimerManager::OnInterrupt() {
+    const uint64_t now = ReadTSC();
+    if (!armed_) return;
+
+    if (now < armed_deadline_) {
+        // カウント数への換算の誤差で少し早く割り込んだ場合は、残りの時間で設定し直す
+        Arm(armed_deadline_);
+        return;
+    }
+
+    const uint64_t latency = now - armed_deadline_;
+    ++latency_.count;
+    latency_.total_cycles += latency;
+    latency_.min_cycles = std::min(latency_.min_cycles, latency);
+    latency_.max_cycles = std::max(latency_.max_cycles, latency);
+
+    armed_ = false;
+    expired_.store(true, std::memory_order_release);
+}
+
+TimerManager::LatencyStats TimerManager::TakeLatencyStats() {
+    InterruptGuard guard;
+    const LatencyStats stats = latency_;
+    latency_ = {0, UINT64_MAX, 0, 0};
+    return stats;
+}
+
+void TimerManager::Arm(uint64_t deadline) {
+    armed_deadline_ = deadline;
+    armed_ = true;
+    if (use_tsc_deadline_) {
+        // 過去の値を書き込むと直ちに割り込みが起きる
+        WriteMSR(kIA32TSCDeadline, deadline);
+        return;
+    }
+
+    const uint64_t now = ReadTSC();
+    const uint64_t delta = deadline > now ? deadline - now : 0;
+    uint64_t count = (static_cast<unsigned __int128>(delta) * lapic_per_tsc_q32_) >> 32;
+    // 32 ビットに収まらない場合は途中で一度割り込み、OnInterrupt で残りを設定し直す
+    count = std::min<uint64_t>(std::max<uint64_t>(count, 1), UINT32_MAX);
+    LocalAPICRegister(kLAPICRegisterInitialCount) = count;
+}
+
+Error InitializeLAPICTimer(uint64_t loader_tsc_per_us) {
+    const bool use_pm_timer = acpi::fadt != nullptr;
+    if (!use_pm_timer && loader_tsc_per_us == 0) {
+        return MAKE_ERROR(Error::kNotSupported);
+    }
+
+    // Local APIC はファームウェアが有効にしているとは限らない。MADT があればそのベースアドレスを使う
+    if (acpi::madt) {
+        SetLocalAPICBase(acpi::madt->local_apic_address);
+    }
+    EnableLocalAPIC();
+
+    // マスクしたワンショットモードで最大値から数え下げ、一定時間に進んだカウント数を測る
+    LocalAPICRegister(kLAPICRegisterDivideConfig) = kDivideBy1;
+    LocalAPICRegister(kLAPICRegisterLVTTimer) = kLVTMasked | InterruptVector::kLocalAPICTimer;
+    LocalAPICRegister(kLAPICRegisterInitialCount) = UINT32_MAX;
+    const uint64_t tsc_start = ReadTSC();
+    if (use_pm_timer) {
+        acpi::WaitMicroseconds(kCalibrationMicroseconds);
+    } else {
+        WaitTSC(loader_tsc_per_us, kCalibrationMicroseconds);
+    }
+    const uint64_t lapic_ticks = UINT32_MAX - LocalAPICRegister(kLAPICRegisterCurrentCount);
+    const uint64_t tsc_ticks = ReadTSC() - tsc_start;
+    LocalAPICRegister(kLAPICRegisterInitialCount) = 0;
+
+    const uint64_t tsc_per_us
+        = use_pm_timer ? tsc_ticks / kCalibrationMicroseconds : loader_tsc_per_us;
+    const uint64_t lapic_per_tsc_q32 = (lapic_ticks << 32) / tsc_ticks;
+    if (tsc_per_us == 0 || lapic_per_tsc_q32 == 0) {
+        return MAKE_ERROR(Error::kNotSupported);
+    }
+
+    timer_manager = new (timer_manager_buf)
+        TimerManager {tsc_per_us, lapic_per_tsc_q32, SupportsTSCDeadline()};
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+extern "C" void LAPICTimerOnInterrupt() {
+    if (timer_manager) timer_manager->OnInterrupt();
+    NotifyEndOfInterrupt();
+}
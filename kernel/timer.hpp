@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "error.hpp"
+
+/**
+ * Local APIC タイマーによるワンショットのタイマー
+ * 時刻は TSC のカウント値で表し、周期的な割り込み (tick) は使わない。
+ * 登録されたタイマーのうち最も期限の早いものに合わせて、その都度 Local APIC タイマーを設定する。
+ * 期限が来ると割り込みハンドラは期限切れの印を付けるだけで、コールバックは
+ * RunExpired を呼んだ通常の処理の中で実行される。コールバックでは描画やログ出力をして良い。
+ **/
+using TimerCallback = void (*)(void* context, uint64_t deadline);
+
+struct Timer {
+    uint64_t deadline;
+    TimerCallback callback;
+    void* context;
+};
+
+class TimerManager {
+public:
+    static const size_t kMaxTimers = 64;
+
+    // 割り込みの遅延 (期限から割り込みハンドラに入るまでの TSC のカウント数) の統計
+    struct LatencyStats {
+        uint64_t count;
+        uint64_t min_cycles, max_cycles, total_cycles;
+    };
+
+    /**
+     * tsc_per_us は TSC の周波数 (MHz)、lapic_per_tsc_q32 は TSC 1カウントあたりの
+     * Local APIC タイマーのカウント数を 2^32 倍した値
+     * use_tsc_deadline が true なら、TSC-deadline モードで期限の TSC を直接設定する
+     **/
+    TimerManager(uint64_t tsc_per_us, uint64_t lapic_per_tsc_q32, bool use_tsc_deadline);
+
+    /**
+     * deadline (TSC のカウント値) に callback(context, deadline) を呼ぶように登録する
+     * 登録数が kMaxTimers に達していれば false を返す。割り込みハンドラからは呼ばないこと
+     **/
+    bool ScheduleAt(uint64_t deadline, TimerCallback callback, void* context);
+    // 現在から usec マイクロ秒後に呼ぶように登録する
+    bool ScheduleAfter(uint64_t usec, TimerCallback callback, void* context);
+
+    // 期限を過ぎたタイマーのコールバックを期限の早い順に呼ぶ
+    void RunExpired();
+    // 期限を過ぎたタイマーがあって RunExpired を呼ぶ必要があるか
+    bool HasExpired() const {
+        return expired_.load(std::memory_order_acquire);
+    }
+
+    // Local APIC タイマーの割り込みハンドラから呼ぶ
+    void OnInterrupt();
+
+    // 遅延の統計を返し、集計をやり直す
+    LatencyStats TakeLatencyStats();
+
+    uint64_t TSCPerMicrosecond() const {
+        return tsc_per_us_;
+    }
+    bool UsesTSCDeadline() const {
+        return use_tsc_deadline_;
+    }
+
+private:
+    // 期限の早いものを先頭にするための比較 (std::push_heap は最大ヒープを作る)
+    static bool Later(const Timer& a, const Timer& b) {
+        return a.deadline > b.deadline;
+    }
+    // Local APIC タイマーが deadline に割り込みを起こすように設定する
+    void Arm(uint64_t deadline);
+
+    const uint64_t tsc_per_us_;
+    const uint64_t lapic_per_tsc_q32_;
+    const bool use_tsc_deadline_;
+
+    Timer timers_[kMaxTimers];
+    size_t num_timers_;
+
+    // 以下は割り込みハンドラと共有する
+    volatile bool armed_;
+    volatile uint64_t armed_deadline_;
+    std::atomic<bool> expired_;
+    LatencyStats latency_;
+};
+
+extern TimerManager* timer_manager;
+
+/**
+ * Local APIC タイマーと TSC の周波数を較正し、timer_manager を生成する
+ * ACPI PM タイマーが使えればそれを基準にし、使えなければブートローダが
+ * UEFI の Stall で測った TSC の周波数 (loader_tsc_per_us) を基準にする。
+ * BSP の Local APIC は (MADT があればそのベースアドレスで) ここで有効にする。
+ * InitializeInterrupt と acpi::Initialize の後に BSP から呼ぶ
+ **/
+Error InitializeLAPICTimer(uint64_t loader_tsc_per_us);
+
+extern "C" void LAPICTimerOnInterrupt();
@@ -0,0 +1,76 @@
+#include "trace.hpp"
+
+#include <cstring>
+#include "console.hpp"
+#include "format.hpp"
+#include "serial.hpp"
+
+namespace {
+    BootTrace trace;
+
+    BootTraceSample* FindOrAddSample(const char* name, uint64_t start_tsc) {
+        for (uint32_t i = 0; i < trace.num_samples; ++i) {
+            if (strncmp(trace.samples[i].name, name, kBootTraceNameLength) == 0) {
+                return &trace.samples[i];
+            }
+        }
+        if (trace.num_samples == kBootTraceMaxSamples) {
+            return nullptr;
+        }
+
+        BootTraceSample* sample = &trace.samples[trace.num_samples++];
+        strncpy(sample->name, name, kBootTraceNameLength - 1);
+        sample->name[kBootTraceNameLength - 1] = '\0';
+        sample->start_tsc = start_tsc;
+        sample->cycles = 0;
+        sample->count = 0;
+        return sample;
+    }
+}  // namespace
+
+void InitializeTrace(const BootTrace& loader_trace) {
+    trace = loader_trace;
+    if (trace.num_samples > kBootTraceMaxSamples) {
+        trace.num_samples = kBootTraceMaxSamples;
+    }
+}
+
+void RecordTrace(const char* name, uint64_t start_tsc, uint64_t end_tsc) {
+    if (BootTraceSample* sample = FindOrAddSample(name, start_tsc)) {
+        sample->cycles += end_tsc - start_tsc;
+        ++sample->count;
+    }
+}
+
+void PrintTrace() {
+    if (trace.num_samples == 0) return;
+
+    // TSC の周波数が分からなければ、時間の列は 0 になる
+    const uint64_t tsc_per_us = trace.tsc_per_us;
+    auto to_us = [tsc_per_us](uint64_t cycles) -> uint64_t {
+        return tsc_per_us ? cycles / tsc_per_us : 0;
+    };
+    const uint64_t origin = trace.samples[0].start_tsc;
+
+    printk("%-24s %10s %10s %12s %6s\n", "phase", "start[us]", "total[us]", "cycles", "count");
+    char line[128];
+    for (uint32_t i = 0; i < trace.num_samples; ++i) {
+        const BootTraceSample& s = trace.samples[i];
+        const uint64_t start_us = to_us(s.start_tsc - origin);
+        printk("%-24s %10llu %10llu %12llu %6llu\n",
+            s.name,
+            static_cast<unsigned long long>(start_us),
+            static_cast<unsigned long long>(to_us(s.cycles)),
+            static_cast<unsigned long long>(s.cycles),
+            static_cast<unsigned long long>(s.count));
+        SNPrintf(line,
+            sizeof(line),
+            "trace,%s,%llu,%llu,%llu,%llu\n",
+            s.name,
+            static_cast<unsigned long long>(start_us),
+            static_cast<unsigned long long>(to_us(s.cycles)),
+            static_cast<unsigned long long>(s.cycles),
+            static_cast<unsigned long long>(s.count));
+        SerialWrite(line);
+    }
+}
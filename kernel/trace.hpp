@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include "boot_trace.hpp"
+
+inline uint64_t ReadTSC() {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+}
+
+// ブートローダの計測結果を引き継ぐ。以降の計測結果はその後ろに追加される
+void InitializeTrace(const BootTrace& loader_trace);
+
+/**
+ * name の区間 [start_tsc, end_tsc) を記録する
+ * 同じ名前の区間を何度も記録した場合は、1つの行に回数と合計を積算する
+ * name は文字列リテラルなど、比較できるあいだ有効な文字列であること
+ **/
+void RecordTrace(const char* name, uint64_t start_tsc, uint64_t end_tsc);
+
+/**
+ * 生成されてから破棄されるまでの区間を name として記録する
+ * 例: { ScopedTrace trace {"FillScreen"}; writer.FillRect(...); }
+ **/
+class ScopedTrace {
+public:
+    explicit ScopedTrace(const char* name) : name_ {name}, start_tsc_ {ReadTSC()} {}
+    ~ScopedTrace() {
+        RecordTrace(name_, start_tsc_, ReadTSC());
+    }
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    const char* name_;
+    uint64_t start_tsc_;
+};
+
+/**
+ * 計測結果を表にしてコンソールへ表示し、同じ内容を機械的に読める形でシリアルポートへ書き出す
+ * シリアルの各行は次の形式:
+ *   trace,<name>,<start_us>,<total_us>,<cycles>,<count>
+ * start_us は最初の記録 (ブートローダの起動直後) からの経過時間
+ **/
+void PrintTrace();
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * ワークスティーリング用の両端キュー (Chase-Lev 方式、容量固定)
+ * 所有者の CPU だけが末尾 (bottom) に Push / Pop し、他の CPU は先頭 (top) から Steal する。
+ * 所有者側はほとんどの場合アトミックな読み書きだけで済み、
+ * 最後の1要素を取り合うときと Steal のときだけ compare-and-swap を使う。
+ * 容量 N は2の累乗。満杯なら Push は false を返すので、呼び出し側がその場で処理する。
+ **/
+template <typename T, size_t N>
+class WorkStealingDeque {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    WorkStealingDeque() : top_ {0}, bottom_ {0} {}
+
+    // 所有者: 末尾に追加する
+    bool Push(const T& item) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        const int64_t t = top_.load(std::memory_order_acquire);
+        if (b - t >= static_cast<int64_t>(N)) return false;
+        items_[b & (N - 1)] = item;
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 所有者: 末尾から取り出す (後に入れたものから処理するのでキャッシュに残っていることが多い)
+    bool Pop(T& item) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // 空だった
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = items_[b & (N - 1)];
+        if (t < b) return true;
+
+        // 最後の1要素は Steal と取り合いになるので、top を進められた方が取る
+        const bool won = top_.compare_exchange_strong(
+            t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    // 他の CPU: 先頭から盗む
+    bool Steal(T& item) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return false;
+
+        item = items_[t & (N - 1)];
+        return top_.compare_exchange_strong(
+            t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    bool Empty() const {
+        return bottom_.load(std::memory_order_acquire) <= top_.load(std::memory_order_acquire);
+    }
+
+private:
+    // top_ と bottom_ は別の CPU が書き換えるので、別々のキャッシュラインに置く
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    alignas(64) T items_[N];
+};
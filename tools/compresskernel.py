@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""kernel.elf の LOAD セグメントを LZ4 ブロック形式で圧縮したカーネルイメージを作る
+
+ブートローダはファイルの読み込みに時間がかかるので、読み込むバイト数を減らす。
+デバッグ情報などのセクションは含めず、LOAD セグメントの p_filesz 分だけを圧縮する。
+
+出力の形式 (リトルエンディアン):
+  ヘッダ         magic "YKZ1" (u32), セグメント数 (u32), エントリポイント (u64)
+  セグメント表   vaddr, filesz, memsz, 圧縮データのオフセット, 圧縮データの大きさ (各 u64)
+  圧縮データ     セグメントごとに独立した LZ4 ブロック
+"""
+
+import argparse
+import struct
+
+MAGIC = b'YKZ1'
+PT_LOAD = 1
+
+MIN_MATCH = 4
+MAX_OFFSET = 0xffff
+# LZ4 ブロックの終端規則: 最後の5バイトはリテラル、最後の一致は終端の12バイトより前で始まる
+LAST_LITERALS = 5
+MF_LIMIT = 12
+
+
+def load_segments(elf: bytes):
+    if elf[:4] != b'\x7fELF' or elf[4] != 2:
+        raise ValueError('not a 64-bit ELF file')
+    entry, phoff = struct.unpack_from('<QQ', elf, 24)
+    phentsize, phnum = struct.unpack_from('<HH', elf, 54)
+    segments = []
+    for i in range(phnum):
+        p_type, _, p_offset, p_vaddr, _, p_filesz, p_memsz, _ = struct.unpack_from(
+            '<IIQQQQQQ', elf, phoff + i * phentsize)
+        if p_type != PT_LOAD:
+            continue
+        segments.append((p_vaddr, p_memsz, elf[p_offset:p_offset + p_filesz]))
+    return entry, segments
+
+
+def write_length(out: bytearray, n: int):
+    # 4ビットのフィールドに収まらない長さは 255 の並びと残りで表す
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def write_sequence(out: bytearray, literals: bytes, offset: int, match_len: int):
+    lit_len = len(literals)
+    token = min(lit_len, 15) << 4
+    if match_len:
+        token |= min(match_len - MIN_MATCH, 15)
+    out.append(token)
+    if lit_len >= 15:
+        write_length(out, lit_len - 15)
+    out += literals
+    if match_len:
+        out += struct.pack('<H', offset)
+        if match_len - MIN_MATCH >= 15:
+            write_length(out, match_len - MIN_MATCH - 15)
+
+
+def compress_block(src: bytes) -> bytes:
+    """貪欲法で一致を探す LZ4 ブロック圧縮。直前に現れた4バイト列の位置を辞書で覚える"""
+    out = bytearray()
+    n = len(src)
+    last_match_start = n - MF_LIMIT
+    match_end_limit = n - LAST_LITERALS
+    table = {}
+    anchor = 0
+    i = 0
+    while i < last_match_start:
+        key = src[i:i + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = i
+        if candidate is None or i - candidate > MAX_OFFSET:
+            i += 1
+            continue
+
+        length = MIN_MATCH
+        while i + length < match_end_limit and src[candidate + length] == src[i + length]:
+            length += 1
+        write_sequence(out, src[anchor:i], i - candidate, length)
+
+        # 一致した範囲の途中の位置も辞書に登録しておく
+        for j in range(i + 1, min(i + length, last_match_start)):
+            table[src[j:j + MIN_MATCH]] = j
+        i += length
+        anchor = i
+
+    write_sequence(out, src[anchor:], 0, 0)
+    return bytes(out)
+
+
+def compress_kernel(elf: bytes) -> bytes:
+    entry, segments = load_segments(elf)
+    header_size = 16 + 40 * len(segments)
+    table = bytearray()
+    data = bytearray()
+    for vaddr, memsz, contents in segments:
+        block = compress_block(contents)
+        table += struct.pack('<QQQQQ', vaddr, len(contents), memsz, header_size + len(data),
+                             len(block))
+        data += block
+    return MAGIC + struct.pack('<IQ', len(segments), entry) + bytes(table) + bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('kernel', help='path to kernel.elf')
+    parser.add_argument('-o', help='path to an output file', default='kernel.lz4')
+    ns = parser.parse_args()
+
+    with open(ns.kernel, 'rb') as f:
+        elf = f.read()
+    image = compress_kernel(elf)
+    with open(ns.o, 'wb') as out:
+        out.write(image)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+"""テキスト形式のフォント (hankaku.txt) を1行1バイトのビットマップに変換する
+
+各文字は 8x16 ドットで、'.' が背景、'@' (または '*') が前景を表す。
+ビットマップ以外の行 (文字コードの見出しなど) は読み飛ばす。
+"""
+
+import argparse
+import functools
+import re
+
+BITMAP_PATTERN = re.compile(r'([.*@]+)')
+
+
+def compile(src: str) -> bytes:
+    result = []
+    for line in src.splitlines():
+        m = BITMAP_PATTERN.match(line)
+        if not m:
+            continue
+        bits = [(0 if x == '.' else 1) for x in m.group(1)]
+        bits_int = functools.reduce(lambda a, b: 2 * a + b, bits)
+        result.append(bits_int.to_bytes(1, byteorder='little'))
+    return b''.join(result)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('font', help='path to a font file')
+    parser.add_argument('-o', help='path to an output file', default='font.out')
+    ns = parser.parse_args()
+
+    with open(ns.o, 'wb') as out, open(ns.font) as font:
+        out.write(compile(font.read()))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""カーネルがシリアルポートへ書き出したスナップショット (snap,... の行) を PNG に戻す
+
+入力はシリアルポートのログ全体でよく、snap, で始まらない行は読み飛ばす。
+符号化の形式は kernel/snapshot.hpp を参照。差分のスナップショットは、直前のスナップショット
+(同じ矩形) の画素に重ねて復元する。
+
+スナップショットごとに PNG を書き出し、1行ずつ次の情報を出力する:
+  <seq> <x>,<y> <width>x<height> key|delta <符号化したバイト数> <変化した画素数> <所要時間> <sha256>
+sha256 は RGB の画素列のハッシュで、描画の実装を変えても同じ画面になることを CI で確かめるのに使う。
+所要時間は符号化にかかった時間 (シリアルポートへの送信は含まない) で、
+ログに "timer: <N> MHz TSC" の行があればミリ秒、無ければ TSC のカウント数で表す。
+"""
+
+import argparse
+import base64
+import hashlib
+import os
+import re
+import struct
+import sys
+import zlib
+
+OP_SKIP = 0
+OP_RUN = 1
+OP_COPY = 2
+
+
+def read_varint(data: bytes, pos: int):
+    value = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7f) << shift
+        if b < 0x80:
+            return value, pos
+        shift += 7
+
+
+def decode(data: bytes, pixels: bytearray, delta: bool):
+    """data の操作の列を RGB の画素列 pixels (前回の内容) に適用し、変化した画素数を返す"""
+    pos = 0
+    out = 0
+    changed = 0
+    total = len(pixels) // 3
+    while pos < len(data):
+        op = data[pos]
+        count, pos = read_varint(data, pos + 1)
+        if out + count > total:
+            raise ValueError('operation runs past the end of the image')
+        if op == OP_SKIP:
+            if not delta:
+                raise ValueError('SKIP in a key frame')
+        elif op == OP_RUN:
+            pixels[3 * out:3 * (out + count)] = data[pos:pos + 3] * count
+            pos += 3
+            changed += count
+        elif op == OP_COPY:
+            pixels[3 * out:3 * (out + count)] = data[pos:pos + 3 * count]
+            pos += 3 * count
+            changed += count
+        else:
+            raise ValueError(f'unknown operation {op}')
+        out += count
+    if out != total:
+        raise ValueError(f'decoded {out} of {total} pixels')
+    return changed
+
+
+def png_chunk(kind: bytes, body: bytes) -> bytes:
+    return struct.pack('>I', len(body)) + kind + body + struct.pack('>I', zlib.crc32(kind + body))
+
+
+def write_png(path: str, width: int, height: int, pixels: bytes):
+    """8 ビット RGB の PNG を書き出す。各行の先頭にフィルタの種類 0 (None) を付けて zlib で圧縮する"""
+    stride = 3 * width
+    raw = b''.join(b'\x00' + pixels[y * stride:(y + 1) * stride] for y in range(height))
+    ihdr = struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0)
+    with open(path, 'wb') as f:
+        f.write(b'\x89PNG\r\n\x1a\n')
+        f.write(png_chunk(b'IHDR', ihdr))
+        f.write(png_chunk(b'IDAT', zlib.compress(raw, 6)))
+        f.write(png_chunk(b'IEND', b''))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('log', nargs='?', help='path to a serial log (default: stdin)')
+    parser.add_argument('-o', help='directory for PNG files', default='snapshots')
+    ns = parser.parse_args()
+
+    os.makedirs(ns.o, exist_ok=True)
+    log = open(ns.log, 'r', errors='replace') if ns.log else sys.stdin
+    tsc_mhz = None
+    previous = None  # (x, y, width, height, pixels)
+    current = None
+    failed = False
+    for line in log:
+        line = line.strip()
+        m = re.search(r'timer: (\d+) MHz TSC', line)
+        if m:
+            tsc_mhz = int(m.group(1))
+        if not line.startswith('snap,'):
+            continue
+        fields = line.split(',')
+        if fields[1] == 'begin':
+            seq, x, y, width, height, key = map(int, fields[2:8])
+            current = {'seq': seq, 'rect': (x, y, width, height), 'key': key, 'data': bytearray()}
+        elif fields[1] == 'data' and current is not None:
+            current['data'] += base64.b64decode(fields[2])
+        elif fields[1] == 'end' and current is not None:
+            seq, size, changed = int(fields[2]), int(fields[3]), int(fields[4])
+            crc, cycles = int(fields[5], 16), int(fields[6])
+            snap, current = current, None
+            x, y, width, height = snap['rect']
+            data = bytes(snap['data'])
+            if seq != snap['seq'] or len(data) != size or zlib.crc32(data) != crc:
+                print(f'{seq}: corrupted snapshot, skipped', file=sys.stderr)
+                failed = True
+                previous = None
+                continue
+            delta = not snap['key']
+            if delta and (previous is None or previous[0] != snap['rect']):
+                print(f'{seq}: delta without a previous snapshot, skipped', file=sys.stderr)
+                failed = True
+                continue
+            pixels = bytearray(previous[1]) if delta else bytearray(3 * width * height)
+            try:
+                decoded_changed = decode(data, pixels, delta)
+            except (ValueError, IndexError) as e:
+                print(f'{seq}: {e}', file=sys.stderr)
+                failed = True
+                previous = None
+                continue
+            if decoded_changed != changed:
+                print(f'{seq}: {decoded_changed} pixels decoded, {changed} reported',
+                      file=sys.stderr)
+                failed = True
+            previous = (snap['rect'], pixels)
+            write_png(os.path.join(ns.o, f'snap-{seq:04d}.png'), width, height, bytes(pixels))
+
+            elapsed = f'{cycles / tsc_mhz / 1000:.3f}ms' if tsc_mhz else f'{cycles}cycles'
+            digest = hashlib.sha256(pixels).hexdigest()
+            print(f'{seq} {x},{y} {width}x{height} {"delta" if delta else "key"} '
+                  f'{size} {changed} {elapsed} {digest}')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()